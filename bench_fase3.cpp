@@ -0,0 +1,1838 @@
+#define BIBLIOTECADB_SIN_MAIN
+#include "fase3.cpp"
+
+// La Biblioteca de tareaaaaa.cpp (sin su menú), para contar sus reservas en el modo reservas
+namespace tarea {
+#define TAREA_SIN_MAIN
+#include "tareaaaaa.cpp"
+}
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <new>
+#include <random>
+#ifdef __GLIBC__
+#include <malloc.h>  // mallinfo2: heap en uso
+#endif
+
+/*
+ * Benchmarks de BibliotecaDB (fase3.cpp).
+ * Compilar: g++ -std=c++17 -O2 -pthread bench_fase3.cpp -o bench_fase3
+ * Uso: ./bench_fase3 [inserciones|integridad|carga|snapshot|wal|guardado|memoria|fechas|columnas|consultas|ranking|motor|busqueda|calendario|lote|listados|borrados|reservas|concurrencia|servidor] [N] [socket]
+ *      ./bench_fase3 generar N [dir] [zipf] [activos] [semilla]   (CSV sintéticos con sesgo realista)
+ *      ./bench_fase3 suite N [zipf] [activos] [semilla]           (todas las operaciones, CSV en stdout)
+ */
+
+// Cuenta las reservas del programa entero (para medir la presión sobre el allocator).
+// noinline: si GCC ve el free() dentro de un delete lo toma por un par new/free mezclado.
+#if defined(__GNUC__)
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+static atomic<size_t> RESERVAS{0};
+BENCH_NOINLINE void* operator new(size_t n) {
+    RESERVAS.fetch_add(1, memory_order_relaxed);
+    if (void* p = malloc(n ? n : 1)) return p;
+    throw bad_alloc();
+}
+BENCH_NOINLINE void operator delete(void* p) noexcept { free(p); }
+BENCH_NOINLINE void operator delete(void* p, size_t) noexcept { free(p); }
+void* operator new[](size_t n) { return operator new(n); }
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete[](void* p, size_t) noexcept { operator delete(p); }
+// Las nothrow también (get_temporary_buffer, p. ej.): si no, ASan ve su new emparejado con nuestro free
+void* operator new(size_t n, const nothrow_t&) noexcept {
+    RESERVAS.fetch_add(1, memory_order_relaxed);
+    return malloc(n ? n : 1);
+}
+void* operator new[](size_t n, const nothrow_t&) noexcept { return operator new(n, nothrow); }
+void operator delete(void* p, const nothrow_t&) noexcept { operator delete(p); }
+void operator delete[](void* p, const nothrow_t&) noexcept { operator delete(p); }
+
+static size_t heapEnUso() {
+#ifdef __GLIBC__
+    struct mallinfo2 m = mallinfo2();
+    return m.uordblks + m.hblkhd;  // Bloques grandes van por mmap y no cuentan en uordblks
+#else
+    return 0;
+#endif
+}
+
+using Reloj = chrono::steady_clock;
+
+static double msDesde(Reloj::time_point t0) {
+    return chrono::duration<double, milli>(Reloj::now() - t0).count();
+}
+
+static double percentil(vector<double>& v, double p) {
+    if (v.empty()) return 0;
+    size_t k = min(v.size() - 1, size_t(p * double(v.size())));
+    nth_element(v.begin(), v.begin() + ptrdiff_t(k), v.end());
+    return v[k];
+}
+
+// Filas como eran antes del pool y el diccionario: un std::string por campo de texto
+struct AutorStr { int id; string nombre, nacionalidad; };
+struct LibroStr { int id; string titulo, isbn; int ano, id_autor; };
+struct EstudianteStr { int id; string nombre, grado; };
+struct PrestamoStr { int id, id_libro, id_estudiante; string fecha_prestamo, fecha_devolucion; };
+
+// Datos sintéticos: N préstamos, N/4 libros, N/10 estudiantes, N/20 autores
+struct Datos {
+    vector<AutorStr> autores;
+    vector<LibroStr> libros;
+    vector<EstudianteStr> estudiantes;
+    vector<PrestamoStr> prestamos;
+};
+
+static const char* NOMBRES[] = {"Ana", "Benjamin", "Camila", "Diego", "Elena", "Francisco", "Gabriela", "Hugo",
+                                "Isidora", "Joaquin", "Karen", "Lucas", "Martina", "Nicolas", "Olivia", "Pedro"};
+static const char* APELLIDOS[] = {"Gonzalez", "Munoz", "Rojas", "Diaz", "Perez", "Soto", "Contreras", "Silva",
+                                  "Martinez", "Sepulveda", "Morales", "Rodriguez", "Lopez", "Fuentes", "Hernandez", "Torres"};
+static const char* PAISES[] = {"Chile", "Argentina", "Peru", "Mexico", "Colombia", "Espana", "Uruguay", "Francia"};
+
+static string nombrePersona(int i) {
+    return string(NOMBRES[i % 16]) + " " + APELLIDOS[(i / 16) % 16] + " " + APELLIDOS[(i / 256) % 16];
+}
+
+// Día k desde 2023-01-01 como AAAA-MM-DD (años de 365 días, suficiente para datos sintéticos)
+static string fechaDia(int k) {
+    static const int dias[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    int ano = 2023 + k / 365, d = k % 365, mes = 0;
+    while (d >= dias[mes]) d -= dias[mes++];
+    char buf[32];
+    snprintf(buf, sizeof buf, "%04d-%02d-%02d", ano, mes + 1, d + 1);
+    return buf;
+}
+
+static Datos generarDatos(int n) {
+    Datos d;
+    int nAut = max(1, n / 20), nLib = max(1, n / 4), nEst = max(1, n / 10);
+    for (int i = 1; i <= nAut; i++) d.autores.push_back({i, nombrePersona(i), PAISES[i % 8]});
+    for (int i = 1; i <= nLib; i++) {
+        string titulo = "Libro " + to_string(i) + (i % 7 == 0 ? ", \"edicion anotada\"" : " de " + nombrePersona(i));  // Necesita esc()
+        d.libros.push_back({i, titulo, "978-" + to_string(1000000000 + i), 1900 + i % 120, 1 + i % nAut});
+    }
+    for (int i = 1; i <= nEst; i++) d.estudiantes.push_back({i, nombrePersona(i * 7), to_string(1 + i % 4) + "º Medio"});
+    // Cada libro se presta y se devuelve en rondas; la última ronda queda activa
+    for (int i = 1; i <= n; i++) {
+        bool activo = i > n - nLib;
+        int dia = i % 700;
+        d.prestamos.push_back({i, 1 + (i - 1) % nLib, 1 + i % nEst, fechaDia(dia), activo ? "" : fechaDia(dia + 14)});
+    }
+    return d;
+}
+
+// Datos con sesgo realista, para la suite y para generar CSV de prueba:
+// - libros por autor según Zipf (y como cada libro se presta parecido, también los préstamos);
+// - préstamos de 3 a 90 días que no se solapan en un mismo libro, con ids en orden de fecha;
+// - una fracción activa en el último mes, a lo más uno por libro;
+// - textos con comas, comillas y tildes que pasan por esc().
+struct ConfigDatos {
+    int n = 20000;          // Préstamos; libros N/4, estudiantes N/10 y autores N/20 como en generarDatos
+    double zipf = 1.0;      // Exponente de la popularidad de los autores (0 = uniforme)
+    double activos = 0.08;  // Fracción de préstamos sin devolver (tope: uno por libro)
+    uint64_t semilla = 42;
+};
+
+static const char* PALABRAS[] = {"Canción", "Noche", "Río", "Corazón", "Días", "Ciudad", "Invierno", "Niños",
+                                 "Memoria", "Jardín", "Sombra", "Viaje", "Mar", "Fuego", "Silencio", "Tiempo"};
+static const char* ARTICULOS[] = {"El", "La", "Los", "Las"};
+
+static Datos generarDatosRealistas(const ConfigDatos& cfg) {
+    mt19937_64 rng(cfg.semilla);
+    auto uniforme = [&](int desde, int hasta) { return uniform_int_distribution<int>(desde, hasta)(rng); };
+    auto probabilidad = [&](double p) { return uniform_real_distribution<double>(0, 1)(rng) < p; };
+    int n = max(1, cfg.n), nAut = max(1, n / 20), nLib = max(1, n / 4), nEst = max(1, n / 10);
+    Datos d;
+
+    for (int i = 1; i <= nAut; i++) {
+        string nombre = nombrePersona(uniforme(0, 1 << 12));
+        if (probabilidad(0.3)) {  // "Apellido, Nombre" como en un catálogo
+            size_t sp = nombre.find(' ');
+            nombre = nombre.substr(sp + 1) + ", " + nombre.substr(0, sp);
+        }
+        d.autores.push_back({i, nombre, PAISES[uniforme(0, 7)]});
+    }
+
+    // Popularidad de autores: peso 1/rango^zipf, con los rangos repartidos al azar entre los ids
+    vector<int> porRango(static_cast<size_t>(nAut));
+    for (int i = 0; i < nAut; i++) porRango[size_t(i)] = i + 1;
+    shuffle(porRango.begin(), porRango.end(), rng);
+    vector<double> acumulado(static_cast<size_t>(nAut));
+    double suma = 0;
+    for (int k = 0; k < nAut; k++) acumulado[size_t(k)] = suma += 1.0 / pow(double(k + 1), cfg.zipf);
+    auto autorZipf = [&] {
+        double u = uniform_real_distribution<double>(0, suma)(rng);
+        size_t k = size_t(lower_bound(acumulado.begin(), acumulado.end(), u) - acumulado.begin());
+        return porRango[min(k, size_t(nAut) - 1)];
+    };
+    for (int i = 1; i <= nLib; i++) {
+        string titulo = string(ARTICULOS[uniforme(0, 3)]) + " " + PALABRAS[uniforme(0, 15)] + " de " + PALABRAS[uniforme(0, 15)];
+        if (probabilidad(0.1)) titulo += ", tomo " + to_string(uniforme(1, 4));            // Coma: va entre comillas
+        if (probabilidad(0.03)) titulo = "\"" + titulo + "\" (edición comentada)";      // Comillas: se duplican
+        d.libros.push_back({i, titulo, "978-" + to_string(1000000000 + i), uniforme(1850, 2024), autorZipf()});
+    }
+    for (int i = 1; i <= nEst; i++) d.estudiantes.push_back({i, nombrePersona(uniforme(0, 1 << 12)), to_string(uniforme(1, 4)) + "º Medio"});
+
+    // Dos años de préstamos; los devueltos terminan antes del último mes, donde empiezan los activos
+    const int DIAS = 730, ULTIMO_MES = DIAS - 30;
+    int nActivos = min(nLib, int(double(n) * cfg.activos + 0.5)), nHistoricos = n - nActivos;
+    vector<int> libreDesde(static_cast<size_t>(nLib) + 1);
+    for (auto& x : libreDesde) x = uniforme(0, 60);
+    struct Fila { int dia, libro, estudiante, devolucion; };
+    vector<Fila> filas;
+    filas.reserve(size_t(n));
+    exponential_distribution<double> espera(1.0 / 25), duracion(1.0 / 12);
+    for (int i = 0; i < nHistoricos; i++) {
+        Fila f{};
+        for (int intento = 0; intento < 64; intento++) {  // Un libro con hueco antes del último mes
+            f.libro = uniforme(1, nLib);
+            f.dia = libreDesde[size_t(f.libro)] + int(espera(rng));
+            f.devolucion = f.dia + min(90, 3 + int(duracion(rng)));
+            if (f.devolucion < ULTIMO_MES) break;
+        }
+        if (f.devolucion >= ULTIMO_MES) {  // Sin hueco (N enorme frente a los libros): se acepta el solape
+            f.dia = uniforme(0, ULTIMO_MES - 100);
+            f.devolucion = f.dia + 14;
+        } else {
+            libreDesde[size_t(f.libro)] = f.devolucion + 1;
+        }
+        f.estudiante = uniforme(1, nEst);
+        filas.push_back(f);
+    }
+    vector<int> libros(static_cast<size_t>(nLib));
+    for (int i = 0; i < nLib; i++) libros[size_t(i)] = i + 1;
+    for (int i = 0; i < nActivos; i++) {  // Libros distintos: Fisher-Yates parcial
+        swap(libros[size_t(i)], libros[size_t(uniforme(i, nLib - 1))]);
+        filas.push_back({uniforme(ULTIMO_MES, DIAS - 1), libros[size_t(i)], uniforme(1, nEst), -1});
+    }
+    stable_sort(filas.begin(), filas.end(), [](const Fila& a, const Fila& b) { return a.dia < b.dia; });
+    for (size_t i = 0; i < filas.size(); i++) {
+        const Fila& f = filas[i];
+        d.prestamos.push_back({int(i) + 1, f.libro, f.estudiante, fechaDia(f.dia), f.devolucion < 0 ? "" : fechaDia(f.devolucion)});
+    }
+    return d;
+}
+
+// Réplica de las comprobaciones lineales (any_of) previas a los índices, como referencia
+struct DBLineal {
+    vector<AutorStr> autores;
+    vector<LibroStr> libros;
+    vector<EstudianteStr> estudiantes;
+    vector<PrestamoStr> prestamos;
+
+    template <class T>
+    static bool existe(const vector<T>& v, int id) {
+        return any_of(v.begin(), v.end(), [id](auto& x){ return x.id == id; });
+    }
+    bool libroDisponible(int id_libro) {
+        for (auto& p : prestamos) if (p.id_libro == id_libro && p.fecha_devolucion.empty()) return false;
+        return true;
+    }
+    bool addAutor(int id, string_view nombre, string_view nac) {
+        if (existe(autores, id)) return false;
+        autores.push_back({id, string(nombre), string(nac)});
+        return true;
+    }
+    bool addLibro(int id, string_view titulo, string_view isbn, int ano, int id_autor) {
+        if (existe(libros, id) || !existe(autores, id_autor)) return false;
+        libros.push_back({id, string(titulo), string(isbn), ano, id_autor});
+        return true;
+    }
+    bool addEstudiante(int id, string_view nombre, string_view grado) {
+        if (existe(estudiantes, id)) return false;
+        estudiantes.push_back({id, string(nombre), string(grado)});
+        return true;
+    }
+    bool addPrestamo(int id, int id_libro, int id_est, string_view fecha) {
+        if (existe(prestamos, id)) return false;
+        if (!existe(libros, id_libro) || !existe(estudiantes, id_est)) return false;
+        if (!libroDisponible(id_libro)) return false;
+        prestamos.push_back({id, id_libro, id_est, string(fecha), ""});
+        return true;
+    }
+    bool devolverPrestamo(int id, string_view fecha) {
+        for (auto& p : prestamos) {
+            if (p.id == id) {
+                if (!p.fecha_devolucion.empty()) return false;
+                p.fecha_devolucion = fecha;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// Inserta todo el dataset por la API CRUD; devuelve ms. Los préstamos históricos
+// se insertan activos y se devuelven enseguida (addPrestamo + devolverPrestamo).
+template <class Base>
+static double insertarTodo(Base& db, const Datos& d, size_t& aceptados) {
+    auto t0 = Reloj::now();
+    aceptados = 0;
+    for (auto& a : d.autores) aceptados += db.addAutor(a.id, a.nombre, a.nacionalidad);
+    for (auto& l : d.libros) aceptados += db.addLibro(l.id, l.titulo, l.isbn, l.ano, l.id_autor);
+    for (auto& e : d.estudiantes) aceptados += db.addEstudiante(e.id, e.nombre, e.grado);
+    for (auto& p : d.prestamos) {
+        aceptados += db.addPrestamo(p.id, p.id_libro, p.id_estudiante, p.fecha_prestamo);
+        if (!p.fecha_devolucion.empty()) db.devolverPrestamo(p.id, p.fecha_devolucion);
+    }
+    return msDesde(t0);
+}
+
+static void benchInserciones(int n) {
+    Datos d = generarDatos(n);
+    size_t filas = d.autores.size() + d.libros.size() + d.estudiantes.size() + d.prestamos.size();
+    cout << "== Inserciones masivas (N=" << n << ", " << filas << " filas) ==\n";
+
+    size_t okIdx = 0;
+    DB db;
+    double msIdx = insertarTodo(db, d, okIdx);
+    if (n <= 50000) {  // La réplica lineal es cuadrática: solo como referencia en N pequeños
+        size_t okLineal = 0;
+        DBLineal lineal;
+        double msLineal = insertarTodo(lineal, d, okLineal);
+        cout << "antes (any_of lineal): " << msLineal << " ms, " << filas / msLineal * 1000 << " filas/s\n";
+        if (okLineal != okIdx) cout << "aceptadas DISTINTAS: " << okLineal << " vs " << okIdx << "\n";
+    }
+    cout << "despues (indice hash): " << msIdx << " ms, " << filas / msIdx * 1000 << " filas/s\n";
+    cout << "indices inconsistentes: " << db.verificarIndices() << "\n";
+}
+
+// Intentos de borrado de todos los autores y estudiantes (todos referenciados => rechazados)
+static void benchIntegridad(int n) {
+    Datos d = generarDatos(n);
+    DB db;
+    size_t ok = 0;
+    insertarTodo(db, d, ok);
+    cout << "== Borrados con integridad referencial (N=" << n << ") ==\n";
+
+    auto t0 = Reloj::now();
+    size_t rechazados = 0;
+    for (auto& a : d.autores) rechazados += !db.deleteAutor(a.id);
+    for (auto& e : d.estudiantes) rechazados += !db.deleteEstudiante(e.id);
+    double msRefs = msDesde(t0);
+
+    // Referencia: las comprobaciones por barrido que hacían deleteAutor/deleteEstudiante
+    t0 = Reloj::now();
+    size_t rechazadosLineal = 0;
+    for (auto& a : d.autores)
+        rechazadosLineal += any_of(db.libros.begin(), db.libros.end(), [&](auto& l){ return l.id_autor == a.id; });
+    for (auto& e : d.estudiantes)
+        rechazadosLineal += any_of(db.prestamos.id_estudiante.begin(), db.prestamos.id_estudiante.end(), [&](int x){ return x == e.id; });
+    double msLineal = msDesde(t0);
+
+    size_t intentos = d.autores.size() + d.estudiantes.size();
+    cout << "antes (barrido): " << msLineal << " ms para " << intentos << " comprobaciones\n";
+    cout << "despues (refs):  " << msRefs << " ms, rechazados " << rechazados << " / " << rechazadosLineal << "\n";
+    cout << "indices inconsistentes: " << db.verificarIndices() << "\n";
+}
+
+// Cargador previo (getline + splitCSV + stoi), como referencia de throughput
+static vector<string> splitCSVAnterior(const string& s) {
+    vector<string> out;
+    string cur;
+    bool inq = false;
+    for (char c : s) {
+        if (c == '"') { inq = !inq; cur.push_back(c); }
+        else if (c == ',' && !inq) { out.push_back(cur); cur.clear(); }
+        else cur.push_back(c);
+    }
+    out.push_back(cur);
+    for (auto& x : out) {
+        if (x.size() >= 2 && x.front() == '"' && x.back() == '"') x = x.substr(1, x.size() - 2);
+    }
+    return out;
+}
+
+template <class T, class Fila>
+static size_t cargarAnterior(const string& path, size_t minCampos, vector<T>& out, Fila fila) {
+    ifstream f(path);
+    string line;
+    getline(f, line);
+    while (getline(f, line)) {
+        if (line.empty()) continue;
+        auto v = splitCSVAnterior(line);
+        if (v.size() < minCampos) continue;
+        out.push_back(fila(v));
+    }
+    return out.size();
+}
+static size_t cargarPrestamosAnterior(const string& path, vector<PrestamoStr>& out) {
+    return cargarAnterior(path, 5, out, [](vector<string>& v) {
+        return PrestamoStr{stoi(v[0]), stoi(v[1]), stoi(v[2]), v[3], v[4]};
+    });
+}
+
+static double megas(const string& path) { return double(filesystem::file_size(path)) / (1 << 20); }
+
+static void benchCarga(int n) {
+    Datos d = generarDatos(n);
+    DB db;
+    size_t ok = 0;
+    insertarTodo(db, d, ok);
+    string dir = "bench_datos";
+    filesystem::create_directories(dir);
+    db.saveAutores(dir + "/autores.csv");
+    db.saveLibros(dir + "/libros.csv");
+    db.saveEstudiantes(dir + "/estudiantes.csv");
+    db.savePrestamos(dir + "/prestamos.csv");
+    double mb = megas(dir + "/autores.csv") + megas(dir + "/libros.csv") + megas(dir + "/estudiantes.csv") + megas(dir + "/prestamos.csv");
+    cout << "== Carga CSV (N=" << n << ", " << mb << " MB) ==\n";
+
+    // El cargador anterior ya no produce filas de DB: se mide solo su parseo (sin índices)
+    vector<PrestamoStr> ant;
+    auto t0 = Reloj::now();
+    cargarPrestamosAnterior(dir + "/prestamos.csv", ant);
+    double msAnt = msDesde(t0);
+    double mbPrest = megas(dir + "/prestamos.csv");
+    cout << "prestamos.csv antes (getline+splitCSV, sin indices): " << msAnt << " ms, " << mbPrest / msAnt * 1000 << " MB/s\n";
+
+    DB carga;
+    t0 = Reloj::now();
+    carga.loadPrestamos(dir + "/prestamos.csv");
+    double msPrest = msDesde(t0);
+    cout << "prestamos.csv despues (mmap+from_chars): " << msPrest << " ms, " << mbPrest / msPrest * 1000 << " MB/s\n";
+
+    t0 = Reloj::now();
+    carga.loadAutores(dir + "/autores.csv");
+    carga.loadLibros(dir + "/libros.csv");
+    carga.loadEstudiantes(dir + "/estudiantes.csv");
+    carga.loadPrestamos(dir + "/prestamos.csv");
+    double msTodo = msDesde(t0);
+    cout << "4 tablas en serie: " << msTodo << " ms, " << mb / msTodo * 1000 << " MB/s\n";
+
+    DATA_DIR = dir;
+    MODO_CSV = true;  // Solo los CSV, aunque otro benchmark haya dejado un snapshot en dir
+    DB par;
+    t0 = Reloj::now();
+    cargarTodo(par);  // Tablas a la vez + trozos en paralelo + validación
+    double msPar = msDesde(t0);
+    MODO_CSV = false;
+    cout << "cargarTodo en paralelo (" << DB::hilos() << " hilos): " << msPar << " ms, " << mb / msPar * 1000 << " MB/s\n";
+
+    size_t distintos = 0;
+    for (size_t i = 0; i < d.libros.size(); i++) distintos += par.libros[i].titulo != d.libros[i].titulo;
+    cout << "titulos distintos tras ida y vuelta por esc(): " << distintos << "\n";
+    distintos = par.prestamos.size() != d.prestamos.size();
+    for (size_t i = 0; !distintos && i < d.prestamos.size(); i++) distintos += par.prestamos[i].id != d.prestamos[i].id;
+    cout << "prestamos fuera de orden tras unir trozos: " << distintos << "\n";
+}
+
+// Guardado previo (ofstream y << campo a campo, directo sobre el archivo), como referencia
+static void guardarAnterior(const Datos& db, const string& dir) {
+    ofstream fa(dir + "/autores.csv");
+    fa << "id,nombre,nacionalidad\n";
+    for (auto& a : db.autores) fa << a.id << "," << DB::esc(a.nombre) << "," << DB::esc(a.nacionalidad) << "\n";
+    ofstream fl(dir + "/libros.csv");
+    fl << "id,titulo,isbn,ano_publicacion,id_autor\n";
+    for (auto& l : db.libros) fl << l.id << "," << DB::esc(l.titulo) << "," << DB::esc(l.isbn) << "," << l.ano << "," << l.id_autor << "\n";
+    ofstream fe(dir + "/estudiantes.csv");
+    fe << "id,nombre,grado\n";
+    for (auto& e : db.estudiantes) fe << e.id << "," << DB::esc(e.nombre) << "," << DB::esc(e.grado) << "\n";
+    ofstream fp(dir + "/prestamos.csv");
+    fp << "id,id_libro,id_estudiante,fecha_prestamo,fecha_devolucion\n";
+    for (auto& p : db.prestamos)
+        fp << p.id << "," << p.id_libro << "," << p.id_estudiante << "," << DB::esc(p.fecha_prestamo) << "," << DB::esc(p.fecha_devolucion) << "\n";
+}
+
+static void benchGuardado(int n) {
+    Datos d = generarDatos(n);
+    DB db;
+    size_t ok = 0;
+    insertarTodo(db, d, ok);
+    string dir = "bench_datos";
+    filesystem::create_directories(dir);
+    DATA_DIR = dir;
+
+    auto t0 = Reloj::now();
+    guardarAnterior(d, dir);
+    double msAnt = msDesde(t0);
+    double mb = megas(dir + "/autores.csv") + megas(dir + "/libros.csv") + megas(dir + "/estudiantes.csv") + megas(dir + "/prestamos.csv");
+    t0 = Reloj::now();
+    bool guardado = exportarCSV(db);
+    double msNuevo = msDesde(t0);
+    double mb2 = megas(dir + "/autores.csv") + megas(dir + "/libros.csv") + megas(dir + "/estudiantes.csv") + megas(dir + "/prestamos.csv");
+    cout << "== Guardado CSV (N=" << n << ", " << mb << " MB) ==\n";
+    cout << "antes (ofstream <<): " << msAnt << " ms, " << mb / msAnt * 1000 << " MB/s\n";
+    cout << "despues (buffer + tmp/rename, " << DB::hilos() << " hilos): " << msNuevo << " ms, " << mb2 / msNuevo * 1000
+         << " MB/s" << (guardado ? "" : "  (ERROR)") << (mb == mb2 ? "" : "  (TAMAÑO DISTINTO)") << "\n";
+}
+
+// Persistencia completa: CSV (4 archivos) contra snapshot binario, tiempo y tamaño
+static void benchSnapshot(int n) {
+    Datos d = generarDatos(n);
+    DB db;
+    size_t ok = 0;
+    insertarTodo(db, d, ok);
+    string dir = "bench_datos";
+    filesystem::create_directories(dir);
+    DATA_DIR = dir;
+    size_t filas = d.autores.size() + d.libros.size() + d.estudiantes.size() + d.prestamos.size();
+    cout << "== CSV vs snapshot binario (N=" << n << ", " << filas << " filas) ==\n";
+
+    auto t0 = Reloj::now();
+    exportarCSV(db);
+    double msCsvSave = msDesde(t0);
+    double mbCsv = megas(dir + "/autores.csv") + megas(dir + "/libros.csv") + megas(dir + "/estudiantes.csv") + megas(dir + "/prestamos.csv");
+    DB csv;
+    t0 = Reloj::now();
+    importarCSV(csv);
+    double msCsvLoad = msDesde(t0);
+
+    t0 = Reloj::now();
+    bool guardado = db.guardarSnapshot(dir + SNAPSHOT);
+    double msBinSave = msDesde(t0);
+    DB bin;
+    string error;
+    t0 = Reloj::now();
+    bool cargado = bin.cargarSnapshot(dir + SNAPSHOT, error);
+    double msBinLoad = msDesde(t0);
+    if (!guardado || !cargado) {
+        cout << "snapshot fallido: " << error << "\n";
+        return;
+    }
+
+    cout << "CSV:      guardar " << msCsvSave << " ms, cargar " << msCsvLoad << " ms, " << mbCsv << " MB\n";
+    cout << "snapshot: guardar " << msBinSave << " ms, cargar " << msBinLoad << " ms, " << megas(dir + SNAPSHOT) << " MB\n";
+    size_t distintos = bin.prestamos.size() != csv.prestamos.size() || bin.libros.size() != csv.libros.size();
+    for (size_t i = 0; !distintos && i < bin.libros.size(); i++) distintos += bin.libros[i].titulo != csv.libros[i].titulo;
+    for (size_t i = 0; !distintos && i < bin.prestamos.size(); i++)
+        distintos += bin.prestamos[i].fecha_devolucion != csv.prestamos[i].fecha_devolucion;
+    cout << "diferencias snapshot vs CSV: " << distintos << ", indices inconsistentes: " << bin.verificarIndices() << "\n";
+}
+
+// WAL: coste de cada cambio, de "guardar" al salir y de reaplicar al arrancar, frente al snapshot completo
+static void benchWAL(int n) {
+    Datos d = generarDatos(n);
+    DB db;
+    size_t ok = 0;
+    insertarTodo(db, d, ok);
+    string dir = "bench_datos";
+    filesystem::create_directories(dir);
+    DATA_DIR = dir;
+    remove((dir + WAL).c_str());
+    remove((dir + WAL_VIEJO).c_str());
+    cout << "== WAL (N=" << n << ") ==\n";
+
+    auto t0 = Reloj::now();
+    db.guardarSnapshot(dir + SNAPSHOT, 0);
+    double msSnapshot = msDesde(t0);
+
+    const int K = 20000;
+    int base = n * 10;
+    for (int modo = 0; modo < 2; modo++) {
+        CONFIG_WAL.fsyncMs = modo == 0 ? 0 : -1;
+        REGISTRO.abrir(dir + WAL, REGISTRO.ultimoLsn(), CONFIG_WAL);
+        db.wal = &REGISTRO;
+        t0 = Reloj::now();
+        for (int i = 0; i < K; i++) {
+            int id = base + modo * K + i;
+            db.addEstudiante(id, "Nuevo " + to_string(i), "1º Medio");
+            db.updateEstudiante(id, "Nuevo " + to_string(i) + " bis", "2º Medio");
+        }
+        double msOps = msDesde(t0);
+        t0 = Reloj::now();
+        guardarTodo(db);
+        double msGuardar = msDesde(t0);
+        cout << (modo == 0 ? "fsync por grupo: " : "fsync nunca:     ") << 2 * K << " cambios en " << msOps << " ms ("
+             << 2 * K / msOps * 1000 << " ops/s), guardar al salir " << msGuardar << " ms\n";
+    }
+    cout << "snapshot completo (lo que costaba guardar antes): " << msSnapshot << " ms\n";
+
+    // Arranque con WAL pendiente: el snapshot es el de antes de los cambios, todo sale del WAL
+    DB r;
+    t0 = Reloj::now();
+    cargarTodo(r, false);
+    cout << "arranque snapshot + " << REGISTRO.ultimoLsn() << " registros de WAL: " << msDesde(t0) << " ms, estudiantes "
+         << r.estudiantes.size() << " / " << db.estudiantes.size() << "\n";
+
+    t0 = Reloj::now();
+    compactar(db);
+    double msPausa = msDesde(t0);
+    t0 = Reloj::now();
+    guardarTodo(db);  // Espera al hilo del snapshot
+    cout << "compactacion: pausa del menu " << msPausa << " ms, snapshot en segundo plano " << msDesde(t0) << " ms\n";
+    REGISTRO.cerrar();
+    db.wal = nullptr;
+}
+
+// Memoria de las tablas cargadas desde CSV: filas con std::string por campo (cargador anterior)
+// contra filas compactas + pool + diccionario. Se mide el heap en uso (mallinfo2) y las reservas
+// de la carga, ambos sin los índices (iguales en los dos casos).
+static void soltarIndices(DB& db) {
+    unordered_map<int, size_t>().swap(db.idxAutores);
+    unordered_map<int, size_t>().swap(db.idxLibros);
+    unordered_map<int, size_t>().swap(db.idxEstudiantes);
+    unordered_map<int, size_t>().swap(db.idxPrestamos);
+    unordered_map<int, vector<int>>().swap(db.activosPorLibro);
+    unordered_map<int, vector<int>>().swap(db.activosPorEstudiante);
+    unordered_map<int, int>().swap(db.librosPorAutor);
+    set<pair<int, int>>().swap(db.rankingAutores);
+    unordered_map<int, int>().swap(db.prestamosPorEstudiante);
+    unordered_map<int, int>().swap(db.prestamosPorLibro);
+}
+
+static void benchMemoria(int n) {
+    string dir = "bench_datos";
+    filesystem::create_directories(dir);
+    guardarAnterior(generarDatos(n), dir);
+    cout << "== Memoria por fila tras cargar CSV (N=" << n << ") ==\n";
+    if (!heapEnUso()) cout << "(sin mallinfo2: solo se cuentan reservas)\n";
+
+    auto medir = [](const char* tabla, auto cargarAntes, auto cargarDespues) {
+        size_t h0 = heapEnUso(), r0 = RESERVAS;
+        size_t filas = cargarAntes();
+        double bAntes = double(heapEnUso() - h0) / filas, rAntes = double(RESERVAS - r0) / filas;
+        h0 = heapEnUso();
+        r0 = RESERVAS;
+        {
+            DB db;
+            cargarDespues(db);
+            size_t reservas = RESERVAS - r0;
+            soltarIndices(db);
+            double bDespues = double(heapEnUso() - h0) / filas;
+            size_t r1 = RESERVAS;
+            db.reconstruirIndices();  // Lo que costaron los índices dentro de la carga
+            double rDespues = double(reservas - (RESERVAS - r1)) / filas;
+            printf("%-12s %9zu filas: antes %6.1f B/fila (%.3f reservas/fila), despues %6.1f B/fila (%.3f reservas/fila)\n",
+                   tabla, filas, bAntes, rAntes, bDespues, rDespues);
+        }
+    };
+    // Cada "antes" deja sus filas vivas en v mientras se mide el "despues"; se liberan al salir
+    {
+        vector<AutorStr> v;
+        medir("autores", [&] {
+            cargarAnterior(dir + "/autores.csv", 3, v, [](vector<string>& c) { return AutorStr{stoi(c[0]), c[1], c[2]}; });
+            v.shrink_to_fit();
+            return v.size();
+        }, [&](DB& db) { db.loadAutores(dir + "/autores.csv"); });
+    }
+    {
+        vector<LibroStr> v;
+        medir("libros", [&] {
+            cargarAnterior(dir + "/libros.csv", 5, v, [](vector<string>& c) {
+                return LibroStr{stoi(c[0]), c[1], c[2], stoi(c[3]), stoi(c[4])};
+            });
+            v.shrink_to_fit();
+            return v.size();
+        }, [&](DB& db) { db.loadLibros(dir + "/libros.csv"); });
+    }
+    {
+        vector<EstudianteStr> v;
+        medir("estudiantes", [&] {
+            cargarAnterior(dir + "/estudiantes.csv", 3, v, [](vector<string>& c) { return EstudianteStr{stoi(c[0]), c[1], c[2]}; });
+            v.shrink_to_fit();
+            return v.size();
+        }, [&](DB& db) {
+            db.loadEstudiantes(dir + "/estudiantes.csv");
+            cout << "(diccionario: " << db.dicc.size() << " valores, " << db.dicc.bytes() << " B)\n";
+        });
+    }
+    {
+        vector<PrestamoStr> v;
+        medir("prestamos", [&] {
+            cargarPrestamosAnterior(dir + "/prestamos.csv", v);
+            v.shrink_to_fit();
+            return v.size();
+        }, [&](DB& db) { db.loadPrestamos(dir + "/prestamos.csv"); });
+    }
+}
+
+// Recorridos sobre la tabla de préstamos: fechas AAAA-MM-DD en std::string contra nº de día
+static void benchFechas(int n) {
+    Datos d = generarDatos(n);
+    DB db;
+    for (auto& p : d.prestamos) {
+        Fecha fp, fd;
+        leerFecha(p.fecha_prestamo, fp);
+        leerFecha(p.fecha_devolucion, fd);
+        db.prestamos.push_back(Prestamo{p.id, p.id_libro, p.id_estudiante, fp, fd});
+    }
+    cout << "== Recorridos de prestamos por fecha (N=" << n << ", " << sizeof(PrestamoStr) << " -> "
+         << sizeof(Prestamo) << " B/fila) ==\n";
+    const int REP = 20;
+    string desde = "2023-06-01", hasta = "2023-09-30";
+    Fecha fDesde, fHasta;
+    leerFecha(desde, fDesde);
+    leerFecha(hasta, fHasta);
+
+    size_t activosA = 0, rangoA = 0;
+    auto t0 = Reloj::now();
+    for (int k = 0; k < REP; k++) {
+        for (auto& p : d.prestamos) {
+            activosA += p.fecha_devolucion.empty();
+            rangoA += p.fecha_prestamo >= desde && p.fecha_prestamo <= hasta;
+        }
+    }
+    double msA = msDesde(t0) / REP;
+    size_t activosD = 0, rangoD = 0;
+    t0 = Reloj::now();
+    for (int k = 0; k < REP; k++) {
+        for (size_t i = 0; i < db.prestamos.size(); i++) {
+            activosD += db.prestamos.activo(i);
+            rangoD += db.prestamos.fecha_prestamo[i] >= fDesde && db.prestamos.fecha_prestamo[i] <= fHasta;
+        }
+    }
+    double msD = msDesde(t0) / REP;
+    cout << "activos + rango " << desde << ".." << hasta << " antes (string): " << msA << " ms, despues (dia): " << msD
+         << " ms, mismos resultados: " << (activosA == activosD && rangoA == rangoD ? "si" : "NO") << "\n";
+
+    size_t malas = 0;
+    for (Fecha f = diaDeFecha(1900, 1, 1); f < diaDeFecha(2100, 1, 1); f++) {
+        Fecha g;
+        malas += !leerFecha(textoFecha(f), g) || g != f;
+    }
+    cout << "ida y vuelta AAAA-MM-DD 1900..2099 con diferencias: " << malas << "\n";
+}
+
+// Barridos "estudiante = X y activo" / "libro = X y activo" sin índices: filas Prestamo contra
+// las columnas de TablaPrestamos con filtrarRangos (clave en [X, X] y devolución en [SIN_FECHA, SIN_FECHA]). Filas generadas directo (N puede ser 20M).
+static void benchColumnas(int n) {
+    int nLib = max(1, n / 4), nEst = max(1, n / 10);
+    vector<Prestamo> filas;
+    filas.reserve(size_t(n));
+    for (int i = 1; i <= n; i++) {
+        bool activo = i > n - nLib;
+        filas.push_back(Prestamo{i, 1 + (i - 1) % nLib, 1 + i % nEst, i % 700, activo ? SIN_FECHA : i % 700 + 14});
+    }
+    TablaPrestamos tabla(filas);
+    const char* simd =
+#if defined(__AVX2__)
+        "AVX2";
+#elif defined(BIBLIOTECADB_SSE2)
+        "SSE2";
+#else
+        "escalar";
+#endif
+    cout << "== Barridos de prestamos sin indice (N=" << n << ", filtro " << simd << ") ==\n";
+
+    const int K = 20;
+    auto medir = [&](const char* que, int Prestamo::*campo, vector<int> TablaPrestamos::*col, int rango) {
+        size_t hallA = 0, hallB = 0;
+        auto t0 = Reloj::now();
+        for (int k = 0; k < K; k++) {
+            int x = 1 + int((uint64_t(k) * 2654435761u) % unsigned(rango));
+            for (auto& p : filas) hallA += p.*campo == x && p.activo();
+        }
+        double msA = msDesde(t0) / K;
+        t0 = Reloj::now();
+        for (int k = 0; k < K; k++) {
+            int x = 1 + int((uint64_t(k) * 2654435761u) % unsigned(rango));
+            hallB += tabla.filtrarRangos({{col, x, x}, {&TablaPrestamos::fecha_devolucion, SIN_FECHA, SIN_FECHA}}).size();
+        }
+        double msB = msDesde(t0) / K;
+        double gb = 2 * double(n) * sizeof(int32_t) / 1e9;  // La clave y fecha_devolucion
+        printf("%-22s filas: %8.2f ms/barrido, columnas: %7.2f ms/barrido (%.1f GB/s), mismos resultados: %s\n",
+               que, msA, msB, gb / msB * 1000, hallA == hallB ? "si" : "NO");
+    };
+    medir("estudiante = X, activo", &Prestamo::id_estudiante, &TablaPrestamos::id_estudiante, nEst);
+    medir("libro = X, activo", &Prestamo::id_libro, &TablaPrestamos::id_libro, nLib);
+    auto t0 = Reloj::now();
+    size_t activos = tabla.contarActivos();
+    cout << "contarActivos: " << msDesde(t0) << " ms (" << activos << ")\n";
+}
+
+// Opción 17 para todos los estudiantes: join con find_if sobre libros (anterior), join por
+// idxLibros estudiante a estudiante, y la versión por lotes
+static void benchConsultas(int n) {
+    Datos d = generarDatos(n);
+    DB db;
+    size_t aceptados;
+    insertarTodo(db, d, aceptados);
+    vector<int> ids;
+    for (auto& e : d.estudiantes) ids.push_back(e.id);
+    cout << "== Libros prestados por estudiante (N=" << n << ", " << ids.size() << " estudiantes, "
+         << db.activosPorLibro.size() << " activos) ==\n";
+
+    // Mejor de REP vueltas de cada variante (la primera paga cachés frías)
+    const int REP = 5;
+    auto medir = [&](auto f, size_t& hall) {
+        double mejor = 1e18;
+        for (int r = 0; r < REP; r++) {
+            hall = 0;
+            auto t0 = Reloj::now();
+            f(hall);
+            mejor = min(mejor, msDesde(t0));
+        }
+        return mejor;
+    };
+    size_t hallA, hallB, hallC;
+    double msA = medir([&](size_t& hall) {
+        for (int id : ids) {
+            auto act = db.activosPorEstudiante.find(id);
+            if (act == db.activosPorEstudiante.end()) continue;
+            for (int id_p : act->second) {
+                int id_libro = db.prestamos.id_libro[db.idxPrestamos.at(id_p)];
+                hall += find_if(db.libros.begin(), db.libros.end(), [&](auto& l) { return l.id == id_libro; }) != db.libros.end();
+            }
+        }
+    }, hallA);
+    double msB = medir([&](size_t& hall) { for (int id : ids) hall += db.librosPrestadosPorEstudiante(id).size(); }, hallB);
+    double msC = medir([&](size_t& hall) { for (auto& v : db.librosPrestadosPorEstudiantes(ids)) hall += v.size(); }, hallC);
+    // Referencia: la misma consulta por lotes como una pasada por la tabla de préstamos
+    size_t hallD;
+    double msD = medir([&](size_t& hall) {
+        unordered_map<int, vector<DB::LibroPrestado>> porEst;
+        for (int id : ids) porEst[id];
+        DB::LibroPrestado lp;
+        for (size_t i = 0; i < db.prestamos.size(); i++) {
+            if (!db.prestamos.activo(i)) continue;
+            auto it = porEst.find(db.prestamos.id_estudiante[i]);
+            if (it != porEst.end() && db.libroPrestado(i, lp)) it->second.push_back(lp), hall++;
+        }
+    }, hallD);
+    cout << "antes (find_if sobre libros): " << msA << " ms\n";
+    cout << "despues, de a uno (idxLibros): " << msB << " ms\n";
+    cout << "despues, por lotes (indice): " << msC << " ms; como pasada por la tabla: " << msD << " ms\n";
+    cout << "mismos resultados: " << (hallA == hallB && hallB == hallC && hallC == hallD ? "si" : "NO") << " (" << hallC << ")\n";
+}
+
+// Opción 18 (top 10): recuento + sort completo + find_if por nombre (anterior), lectura del ranking
+// mantenido y recálculo con selección parcial; y lo que cuesta mantenerlo en cambios de autor
+static void benchRanking(int n) {
+    Datos d = generarDatos(n);
+    DB db;
+    size_t aceptados;
+    insertarTodo(db, d, aceptados);
+    cout << "== Ranking de autores (N=" << n << ", " << db.autores.size() << " autores, " << db.libros.size() << " libros) ==\n";
+    const int REP = 200, TOP = 10;
+
+    auto anterior = [&] {
+        unordered_map<int, int> cnt;
+        for (auto& l : db.libros) cnt[l.id_autor]++;
+        vector<pair<int, int>> v(cnt.begin(), cnt.end());
+        sort(v.begin(), v.end(), [](auto& a, auto& b) { return a.second > b.second; });
+        size_t largo = 0;
+        for (int i = 0; i < TOP && i < int(v.size()); i++) {
+            auto it = find_if(db.autores.begin(), db.autores.end(), [&](auto& a) { return a.id == v[i].first; });
+            largo += it->nombre.size();
+        }
+        return largo;
+    };
+    size_t basura = 0;
+    auto t0 = Reloj::now();
+    for (int r = 0; r < REP; r++) basura += anterior();
+    double msA = msDesde(t0) / REP;
+    t0 = Reloj::now();
+    for (int r = 0; r < REP; r++) basura += db.topAutores(TOP).size();
+    double msB = msDesde(t0) / REP;
+    t0 = Reloj::now();
+    for (int r = 0; r < REP; r++) basura += db.topAutoresRecalculado(TOP).size();
+    double msC = msDesde(t0) / REP;
+    cout << "antes (recuento + sort + find_if): " << msA << " ms/consulta\n";
+    cout << "despues (ranking mantenido): " << msB * 1000 << " us/consulta, recalculado (partial_sort): " << msC << " ms\n";
+    cout << "mismo top " << TOP << ": " << (db.topAutores(TOP) == db.topAutoresRecalculado(TOP) ? "si" : "NO") << " (" << basura % 2 << ")\n";
+
+    // Mover libros entre autores: cada updateLibro toca dos entradas del ranking
+    int nAut = int(db.autores.size());
+    t0 = Reloj::now();
+    for (auto& l : d.libros) db.updateLibro(l.id, l.titulo, l.isbn, l.ano, 1 + (l.id_autor * 7) % nAut);
+    double msUpd = msDesde(t0);
+    cout << d.libros.size() << " updateLibro con cambio de autor: " << msUpd << " ms, indices inconsistentes: "
+         << db.verificarIndices() << ", mismo top: " << (db.topAutores(TOP) == db.topAutoresRecalculado(TOP) ? "si" : "NO") << "\n";
+}
+
+static void benchMotor(int n) {
+    Datos d = generarDatos(n);
+    DB db;
+    size_t aceptados;
+    insertarTodo(db, d, aceptados);
+    MotorConsultas motor(db);
+    cout << "== Motor de consultas contra bucles a mano (N=" << n << ") ==\n";
+
+    const int REP = 5;
+    auto medir = [&](auto f) {
+        double mejor = 1e18;
+        for (int r = 0; r < REP; r++) {
+            auto t0 = Reloj::now();
+            f();
+            mejor = min(mejor, msDesde(t0));
+        }
+        return mejor;
+    };
+    auto comparar = [&](const char* nombre, const Consulta& q, auto aMano) {
+        ResultadoConsulta res;
+        string error;
+        size_t filasMano = 0;
+        double msMotor = medir([&] {
+            if (!motor.ejecutar(q, res, error)) cerr << "error: " << error << "\n";
+        });
+        double msMano = medir([&] { filasMano = aMano(); });
+        cout << nombre << ": motor " << msMotor << " ms (" << res.plan << ", " << res.examinadas
+             << " examinadas), a mano " << msMano << " ms; mismas filas: "
+             << (res.filas.size() == filasMano ? "si" : "NO") << " (" << filasMano << ")\n";
+    };
+
+    int est = max(1, n / 10) / 2;
+    Consulta activos{TablaConsulta::Prestamo, {{"prestamo.id_estudiante", OpFiltro::Igual, to_string(est)},
+                                               {"prestamo.fecha_devolucion", OpFiltro::Igual, ""}},
+                     {"prestamo.id", "libro.titulo"}, "", ""};
+    comparar("activos de un estudiante", activos, [&] {
+        vector<vector<string>> filas;
+        for (Prestamo p : db.prestamos)
+            if (p.id_estudiante == est && p.activo())
+                if (const Libro* l = db.buscarLibro(p.id_libro)) filas.push_back({to_string(p.id), string(l->titulo)});
+        return filas.size();
+    });
+
+    Fecha desde = diaDeFecha(2024, 3, 1), hasta = diaDeFecha(2024, 3, 31);
+    Consulta rango{TablaConsulta::Prestamo, {{"prestamo.fecha_prestamo", OpFiltro::MayorIgual, textoFecha(desde)},
+                                             {"prestamo.fecha_prestamo", OpFiltro::MenorIgual, textoFecha(hasta)}},
+                   {"prestamo.id", "prestamo.fecha_prestamo"}, "", ""};
+    comparar("prestamos de un mes", rango, [&] {
+        vector<vector<string>> filas;
+        for (Prestamo p : db.prestamos)
+            if (p.fecha_prestamo >= desde && p.fecha_prestamo <= hasta) filas.push_back({to_string(p.id), textoFecha(p.fecha_prestamo)});
+        return filas.size();
+    });
+
+    Consulta porPais{TablaConsulta::Prestamo, {}, {}, "autor.nacionalidad", "cantidad", true};
+    comparar("prestamos por pais del autor", porPais, [&] {
+        unordered_map<string_view, size_t> cuenta;
+        for (Prestamo p : db.prestamos) {
+            const Libro* l = db.buscarLibro(p.id_libro);
+            const Autor* a = l ? db.buscarAutor(l->id_autor) : nullptr;
+            if (a) cuenta[db.dicc.texto(a->nacionalidad)]++;
+        }
+        vector<pair<string_view, size_t>> orden(cuenta.begin(), cuenta.end());
+        sort(orden.begin(), orden.end(), [](auto& a, auto& b) { return a.second > b.second; });
+        vector<vector<string>> filas;
+        for (auto& [pais, k] : orden) filas.push_back({string(pais), to_string(k)});
+        return filas.size();
+    });
+
+    Consulta anotados{TablaConsulta::Libro, {{"libro.titulo", OpFiltro::Contiene, "anotada"}},
+                      {"libro.id", "libro.titulo", "autor.nombre"}, "", "libro.ano", true, 10};
+    comparar("10 ediciones anotadas mas nuevas", anotados, [&] {
+        vector<const Libro*> ls;
+        for (auto& l : db.libros)
+            if (l.titulo.find("anotada") != string_view::npos && db.buscarAutor(l.id_autor)) ls.push_back(&l);
+        size_t k = min<size_t>(10, ls.size());
+        partial_sort(ls.begin(), ls.begin() + static_cast<ptrdiff_t>(k), ls.end(),
+                     [](const Libro* a, const Libro* b) { return a->ano > b->ano; });
+        vector<vector<string>> filas;
+        for (size_t i = 0; i < k; i++)
+            filas.push_back({to_string(ls[i]->id), string(ls[i]->titulo), string(db.buscarAutor(ls[i]->id_autor)->nombre)});
+        return filas.size();
+    });
+}
+
+static void benchBusqueda(int n) {
+    // n títulos de dos a cuatro palabras de un vocabulario, más un número que los distingue
+    static const char* PALABRAS[] = {"sombra", "viento", "ciudad", "mar", "noche", "jardin", "camino", "historia",
+                                     "Señor", "anillos", "ladrona", "libros", "tiempo", "cien", "años", "soledad",
+                                     "casa", "espiritus", "amor", "guerra", "paz", "isla", "tesoro", "rio",
+                                     "montaña", "invierno", "verano", "reino", "dragon", "canción", "estrella", "lobo"};
+    DB db;
+    int nAut = max(1, n / 20);
+    for (int i = 1; i <= nAut; i++) db.addAutor(i, nombrePersona(i), PAISES[i % 8]);
+    vector<string> titulos;
+    for (int i = 1; i <= n; i++) {
+        unsigned h = unsigned(i) * 2654435761u;
+        string t = string(i % 3 ? "El " : "La ") + PALABRAS[h % 32] + " de " + PALABRAS[(h >> 5) % 32];
+        if (h & 1024) t += string(" y ") + PALABRAS[(h >> 10) % 32];
+        t += " " + to_string(i);
+        db.addLibro(i, t, "isbn", 2000, 1 + i % nAut);
+        titulos.push_back(move(t));
+    }
+    cout << "== Busqueda de libros por texto (" << n << " titulos, " << nAut << " autores) ==\n";
+    auto t0 = Reloj::now();
+    db.buscarLibrosPorTexto("x", 1);  // Arma los índices
+    cout << "armar indices: " << msDesde(t0) << " ms\n";
+
+    // Antes: Biblioteca::buscarLibro compara el título exacto recorriendo todo; para algo parcial
+    // lo mínimo es recorrer los títulos ya normalizados con find
+    vector<string> normalizados;
+    for (auto& t : titulos) normalizados.push_back(normalizarTexto(t));
+    string exacto = titulos[size_t(n) / 2];
+    vector<string> consultas = {exacto, "el sombra de mar", "tesoro de", "ladrona de libros 12", "montana y drag",
+                                "cancion", "sombre de vento", nombrePersona(nAut / 2)};
+    for (auto& q : consultas) {
+        const int REP = 5;
+        double msIdx = 1e18, msLineal = 1e18;
+        size_t hallIdx = 0, hallLineal = 0;
+        for (int r = 0; r < REP; r++) {
+            t0 = Reloj::now();
+            hallIdx = db.buscarLibrosPorTexto(q, 20).size();
+            msIdx = min(msIdx, msDesde(t0));
+            t0 = Reloj::now();
+            string nq = normalizarTexto(q);
+            hallLineal = 0;
+            for (auto& t : normalizados) hallLineal += t.find(nq) != string::npos;
+            msLineal = min(msLineal, msDesde(t0));
+        }
+        cout << "\"" << q << "\": indice " << msIdx << " ms (" << hallIdx << " resultados), recorrido "
+             << msLineal << " ms (" << hallLineal << " con la subcadena)\n";
+    }
+    int nUpd = min(n, 10000);
+    t0 = Reloj::now();
+    for (int i = 1; i <= nUpd; i++) db.updateLibro(i, titulos[size_t(i - 1)] + " (reedicion)", "isbn", 2001, 1 + i % nAut);
+    cout << nUpd << " updateLibro con indices de texto al dia: " << msDesde(t0) << " ms\n";
+}
+
+static void benchCalendario(int n) {
+    Datos d = generarDatos(n);
+    DB db;
+    size_t aceptados;
+    insertarTodo(db, d, aceptados);
+    cout << "== Informes por fecha (N=" << n << ", " << db.prestamos.size() << " prestamos) ==\n";
+    const int REP = 5;
+    auto medir = [&](auto f) {
+        double mejor = 1e18;
+        for (int r = 0; r < REP; r++) {
+            auto t0 = Reloj::now();
+            f();
+            mejor = min(mejor, msDesde(t0));
+        }
+        return mejor;
+    };
+    Fecha desde = diaDeFecha(2024, 1, 1), hasta = diaDeFecha(2024, 12, 31);
+    vector<Fecha> cortes;  // Inicio de cada mes de 2024 y el 2025-01-01
+    for (int m = 1; m <= 12; m++) cortes.push_back(diaDeFecha(2024, m, 1));
+    cortes.push_back(diaDeFecha(2025, 1, 1));
+    const TablaPrestamos& t = db.prestamos;
+
+    // Informe mensual de 2024: iniciados, devueltos, días de los devueltos y activos al cierre
+    vector<DB::ResumenPeriodo> cal;
+    vector<array<int64_t, 4>> barrido;
+    double msCal = medir([&] { cal = db.serieMensual(desde, hasta); });
+    double msBarrido = medir([&] {
+        barrido.assign(12, {0, 0, 0, 0});
+        for (size_t i = 0; i < t.size(); i++) {
+            Fecha fp = t.fecha_prestamo[i], fd = t.fecha_devolucion[i];
+            for (int m = 0; m < 12; m++) {
+                Fecha fin = cortes[size_t(m) + 1] - 1;
+                barrido[size_t(m)][0] += fp >= cortes[size_t(m)] && fp <= fin;
+                bool dev = fd != SIN_FECHA && fd >= cortes[size_t(m)] && fd <= fin;
+                barrido[size_t(m)][1] += dev;
+                barrido[size_t(m)][2] += dev ? fd - fp : 0;
+                barrido[size_t(m)][3] += fp <= fin && (fd == SIN_FECHA || fd > fin);
+            }
+        }
+    });
+    bool iguales = cal.size() == 12;
+    for (size_t m = 0; iguales && m < 12; m++)
+        iguales = cal[m].iniciados == barrido[m][0] && cal[m].devueltos == barrido[m][1] &&
+                  cal[m].diasDevueltos == barrido[m][2] && cal[m].activosAlCierre == barrido[m][3];
+    cout << "informe mensual 2024: calendario " << msCal << " ms, barrido por columnas " << msBarrido
+         << " ms; mismos resultados: " << (iguales ? "si" : "NO") << "\n";
+
+    // Antes: las fechas como texto, parseadas en cada pasada
+    size_t textoIni = 0, calIni = 0;
+    double msTexto = medir([&] {
+        textoIni = 0;
+        for (auto& p : d.prestamos) {
+            Fecha fp;
+            textoIni += leerFecha(p.fecha_prestamo, fp) && fp >= cortes[2] && fp < cortes[3];
+        }
+    });
+    double msIds = medir([&] { calIni = db.prestamosIniciadosEntre(cortes[2], cortes[3] - 1).size(); });
+    cout << "prestamos iniciados en marzo 2024: calendario " << msIds << " ms, parseando texto " << msTexto
+         << " ms; mismos: " << (textoIni == calIni ? "si" : "NO") << " (" << calIni << ")\n";
+
+    vector<DB::DuracionGrado> grados;
+    map<string_view, pair<int64_t, int64_t>> porGrado;
+    double msGrado = medir([&] { grados = db.duracionPorGrado(desde, hasta); });
+    double msGradoBarrido = medir([&] {
+        porGrado.clear();
+        for (Prestamo p : t) {
+            if (p.activo() || p.fecha_devolucion < desde || p.fecha_devolucion > hasta) continue;
+            const Estudiante* e = db.buscarEstudiante(p.id_estudiante);
+            auto& g = porGrado[db.dicc.texto(e ? e->grado : TEXTO_VACIO)];
+            g.first++;
+            g.second += p.fecha_devolucion - p.fecha_prestamo;
+        }
+    });
+    iguales = grados.size() == porGrado.size();
+    for (auto& g : grados) iguales = iguales && porGrado[g.grado] == make_pair(g.devueltos, g.dias);
+    cout << "duracion media por grado 2024: calendario " << msGrado << " ms, barrido " << msGradoBarrido
+         << " ms; mismos resultados: " << (iguales ? "si" : "NO") << "\n";
+
+    auto t0 = Reloj::now();
+    CalendarioPrestamos c;
+    c.construir(t, [&](size_t i) {
+        const Estudiante* e = db.buscarEstudiante(t.id_estudiante[i]);
+        return e ? e->grado : TEXTO_VACIO;
+    });
+    cout << "armar el calendario desde la tabla: " << msDesde(t0) << " ms; verificarIndices: "
+         << db.verificarIndices() << " inconsistentes\n";
+
+    // Cambiar de grado no reescribe la historia: lo ya devuelto queda en el grado de entonces
+    const Estudiante& e = db.estudiantes[0];
+    db.updateEstudiante(e.id, string(e.nombre), "Egresado");
+    size_t egresados = 0;
+    for (auto& g : db.duracionPorGrado(desde, hasta)) egresados += g.grado == "Egresado";
+    cout << "tras cambiar de grado a un estudiante: grupo nuevo " << (egresados ? "SI" : "no")
+         << ", verificarIndices: " << db.verificarIndices() << " inconsistentes\n";
+}
+
+// Listado completo de préstamos: cout fila a fila (como antes, con y sin endl) contra el bloque de
+// SalidaListado, todo a /dev/null. Después, una página de 50 lejos del principio por offset y por cursor.
+static void benchListados(int n) {
+    Datos d = generarDatos(n);
+    DB db;
+    size_t aceptados;
+    insertarTodo(db, d, aceptados);
+    const TablaPrestamos& t = db.prestamos;
+    cout << "== Listados (N=" << n << ", " << t.size() << " prestamos) ==\n";
+    const int REP = 5;
+    auto medir = [&](auto f) {
+        double mejor = 1e18;
+        for (int r = 0; r < REP; r++) {
+            auto t0 = Reloj::now();
+            f();
+            mejor = min(mejor, msDesde(t0));
+        }
+        return mejor;
+    };
+    auto porStream = [&](ostream& out, bool conEndl) {
+        out << "Préstamos:\n";
+        for (Prestamo p : t) {
+            out << "[" << p.id << "] Libro " << p.id_libro << " a Est " << p.id_estudiante << " (" << textoFecha(p.fecha_prestamo);
+            if (p.activo()) out << " - ACTIVO)";
+            else out << " - Devuelto " << textoFecha(p.fecha_devolucion) << ")";
+            if (conEndl) out << endl;
+            else out << "\n";
+        }
+        out.flush();
+    };
+    ofstream nulo("/dev/null");
+    FILE* fnulo = fopen("/dev/null", "wb");
+    if (!nulo || !fnulo) {
+        cout << "no se pudo abrir /dev/null\n";
+        return;
+    }
+    double msEndl = medir([&] { porStream(nulo, true); });
+    double msStream = medir([&] { porStream(nulo, false); });
+    string error;
+    double msBloque = medir([&] {
+        SalidaListado out(fnulo);
+        db.listar("prestamos", DB::Pagina(), out, error);
+    });
+    // Que las tres escriban lo mismo
+    ostringstream a;
+    porStream(a, false);
+    FILE* tmp = tmpfile();
+    {
+        SalidaListado out(tmp);
+        db.listar("prestamos", DB::Pagina(), out, error);
+    }
+    string b(size_t(ftell(tmp)), '\0');
+    rewind(tmp);
+    size_t leidos = fread(&b[0], 1, b.size(), tmp);
+    fclose(tmp);
+    cout << "listar prestamos completo: cout con endl " << msEndl << " ms, cout con \\n " << msStream << " ms, SalidaListado "
+         << msBloque << " ms; misma salida: " << (leidos == b.size() && a.str() == b ? "si" : "NO") << "\n";
+
+    // Una página de 50 al 90% de la tabla: offset (desde=) contra cursor (despues=)
+    const size_t LIM = 50, prof = t.size() * 9 / 10;
+    auto pagina = [&](DB::OrdenListado orden, bool cursor) {
+        DB::Pagina p;
+        p.orden = orden;
+        p.limite = LIM;
+        if (cursor) {
+            // El cursor es el id de la última fila de la página anterior en ese orden
+            vector<int> ids(t.id);
+            if (orden == DB::OrdenListado::Id) sort(ids.begin(), ids.end());
+            if (orden == DB::OrdenListado::Fecha) {
+                vector<size_t> pos(t.size());
+                for (size_t i = 0; i < pos.size(); i++) pos[i] = i;
+                sort(pos.begin(), pos.end(), [&](size_t x, size_t y) {
+                    return make_pair(t.fecha_prestamo[x], t.id[x]) < make_pair(t.fecha_prestamo[y], t.id[y]);
+                });
+                for (size_t i = 0; i < pos.size(); i++) ids[i] = t.id[pos[i]];
+            }
+            p.conCursor = true;
+            p.despuesDe = ids[prof - 1];
+        } else {
+            p.desde = prof;
+        }
+        string primera;
+        double ms = medir([&] {
+            SalidaListado out(fnulo);
+            db.listar("prestamos", p, out, error);
+        });
+        FILE* f = tmpfile();
+        {
+            SalidaListado out(f);
+            db.listar("prestamos", p, out, error);
+        }
+        primera.resize(size_t(ftell(f)));
+        rewind(f);
+        primera.resize(fread(&primera[0], 1, primera.size(), f));
+        fclose(f);
+        return make_pair(ms, primera);
+    };
+    const char* nombres[] = {"tabla", "id", "fecha"};
+    for (auto orden : {DB::OrdenListado::Tabla, DB::OrdenListado::Id, DB::OrdenListado::Fecha}) {
+        auto cursor = pagina(orden, true);
+        if (orden == DB::OrdenListado::Fecha) {
+            cout << "pagina de " << LIM << " al 90% por fecha: cursor " << cursor.first << " ms\n";
+            continue;
+        }
+        auto offset = pagina(orden, false);
+        cout << "pagina de " << LIM << " al 90% por " << nombres[int(orden)] << ": offset " << offset.first << " ms, cursor "
+             << cursor.first << " ms; mismas filas: " << (offset.second == cursor.second ? "si" : "NO") << "\n";
+    }
+    fclose(fnulo);
+}
+
+// Purga de fin de año: los préstamos devueltos antes de 2024, uno a uno. Antes cada borrado corría
+// la cola de las columnas y sus posiciones en el índice (se miden los primeros y se extrapola);
+// ahora es una lápida y la compactación va por tramos, como la corre mantenimiento entre comandos.
+static void benchBorrados(int n) {
+    Datos d = generarDatos(n);
+    DB db;
+    size_t aceptados;
+    insertarTodo(db, d, aceptados);
+    Fecha corte = diaDeFecha(2024, 1, 1);
+    vector<int> ids = db.prestamosDevueltosEntre(SIN_FECHA, corte - 1);
+    cout << "== Borrados (N=" << n << ", " << db.prestamos.size() << " prestamos, " << ids.size() << " a purgar) ==\n";
+
+    double msAntes;
+    size_t muestra = min<size_t>(ids.size(), 2000);
+    {
+        TablaPrestamos t = db.prestamos;
+        unordered_map<int, size_t> idx = db.idxPrestamos;
+        auto t0 = Reloj::now();
+        for (size_t k = 0; k < muestra; k++) {
+            size_t pos = idx.at(ids[k]);
+            idx.erase(ids[k]);
+            for (vector<int>* c : {&t.id, &t.id_libro, &t.id_estudiante, &t.fecha_prestamo, &t.fecha_devolucion})
+                c->erase(c->begin() + ptrdiff_t(pos));
+            for (size_t i = pos; i < t.size(); i++) {
+                auto it = idx.find(t.id[i]);
+                if (it != idx.end() && it->second == i + 1) it->second = i;
+            }
+        }
+        msAntes = msDesde(t0);
+    }
+    cout << "antes (erase y corrimiento): " << msAntes * 1000 / double(max<size_t>(muestra, 1)) << " us por borrado, ~"
+         << msAntes * double(ids.size()) / double(max<size_t>(muestra, 1)) / 1000 << " s la purga entera (medidos " << muestra << ")\n";
+
+    auto t0 = Reloj::now();
+    size_t purgados = db.purgarDevueltos(corte);
+    double msPurga = msDesde(t0);
+    cout << "lapidas: " << purgados << " borrados en " << msPurga << " ms (" << msPurga * 1000 / double(max<size_t>(purgados, 1))
+         << " us por borrado); verificarIndices: " << db.verificarIndices() << " inconsistentes\n";
+
+    // Lo que ven los recorridos tiene que ser lo mismo antes y después de compactar
+    auto exportar = [&] {
+        string ruta = "bench_borrados.csv";
+        db.savePrestamos(ruta);
+        ifstream f(ruta);
+        string s((istreambuf_iterator<char>(f)), istreambuf_iterator<char>());
+        remove(ruta.c_str());
+        return s;
+    };
+    string conLapidas = exportar();
+    Consulta q;
+    q.desde = TablaConsulta::Prestamo;
+    q.donde = {{"prestamo.fecha_prestamo", OpFiltro::MayorIgual, "2023-06-01"}};
+    q.agruparPor = "prestamo.id_libro";
+    ResultadoConsulta r1, r2;
+    string error;
+    MotorConsultas(db).ejecutar(q, r1, error);
+
+    vector<double> tramos;
+    t0 = Reloj::now();
+    bool quedan = true;
+    while (quedan) {
+        auto t1 = Reloj::now();
+        quedan = db.compactarBorradas();
+        tramos.push_back(msDesde(t1));
+    }
+    double msCompactar = msDesde(t0);
+    MotorConsultas(db).ejecutar(q, r2, error);
+    cout << "compactacion: " << tramos.size() << " tramos de hasta " << DB::TRAMO_COMPACTACION << " filas, " << msCompactar
+         << " ms en total, tramo mas largo " << *max_element(tramos.begin(), tramos.end()) << " ms; quedan " << db.prestamos.size()
+         << " filas\n";
+    cout << "mismo CSV y misma consulta antes y despues de compactar: "
+         << (conLapidas == exportar() && r1.filas == r2.filas ? "si" : "NO") << "; verificarIndices: " << db.verificarIndices()
+         << " inconsistentes\n";
+}
+
+// Como era la Biblioteca de tareaaaaa.cpp: el constructor copia sus argumentos, agregarLibro
+// copia el Libro al vector y porTitulo guarda otra copia del título normalizado
+struct LibroCopiado {
+    string titulo, autor;
+    int anio;
+    bool disponible;
+    LibroCopiado(string t, string a, int y) : titulo(t), autor(a), anio(y), disponible(true) {}
+};
+struct BibliotecaCopiada {
+    vector<LibroCopiado> coleccion;
+    unordered_map<string, size_t> porTitulo;
+    vector<string> titulos, autores;
+    void agregarLibro(const LibroCopiado& l) {
+        coleccion.push_back(l);
+        titulos.push_back(tarea::normalizar(l.titulo));
+        autores.push_back(tarea::normalizar(l.autor));
+        porTitulo.emplace(titulos.back(), coleccion.size() - 1);
+    }
+};
+
+// Reservas del allocator por operación del CRUD sobre una DB ya cargada (sin los índices de
+// texto, que se arman en la primera búsqueda) y por libro agregado a la Biblioteca de tareaaaaa.cpp. Los textos de entrada se
+// arman antes de medir: solo cuenta lo que reserva cada operación. Al final, que las
+// referencias guardadas sigan valiendo tras crecer y compactar.
+static void benchReservas(int n) {
+    Datos d = generarDatos(n);
+    DB db;
+    size_t aceptados;
+    insertarTodo(db, d, aceptados);
+    int k = max(1, n / 10);
+    int nAut = int(d.autores.size()), nLib = int(d.libros.size()), nEst = int(d.estudiantes.size()), nPres = int(d.prestamos.size());
+    vector<string> nombres, titulos;
+    for (int i = 0; i < k; i++) {
+        nombres.push_back(nombrePersona(i * 7 + 3));
+        titulos.push_back("Obra reeditada numero " + to_string(i));
+    }
+    cout << "== Reservas por operacion (N=" << n << ", " << k << " de cada una) ==\n";
+    auto medir = [&](const char* op, auto hacer) {
+        size_t r0 = RESERVAS, p0 = db.pool.bytesUsados();
+        int ok = 0;
+        for (int i = 0; i < k; i++) ok += hacer(i);
+        printf("%-36s %7.3f reservas/op, %5.1f B de pool/op (%d/%d aceptadas)\n", op, double(RESERVAS - r0) / k,
+               double(db.pool.bytesUsados() - p0) / k, ok, k);
+    };
+    medir("addAutor", [&](int i) { return db.addAutor(nAut + 1 + i, nombres[i], "Chile"); });
+    medir("updateAutor (mismo texto)", [&](int i) { return db.updateAutor(nAut + 1 + i, nombres[i], "Chile"); });
+    medir("updateAutor (texto nuevo)", [&](int i) { return db.updateAutor(nAut + 1 + i, nombres[(i + 1) % k], "Peru"); });
+    medir("addLibro", [&](int i) { return db.addLibro(nLib + 1 + i, titulos[i], "978-0", 2000, 1 + i % nAut); });
+    medir("updateLibro (mismo texto)", [&](int i) { return db.updateLibro(nLib + 1 + i, titulos[i], "978-0", 2001, 1 + i % nAut); });
+    medir("updateLibro (otro autor)", [&](int i) { return db.updateLibro(nLib + 1 + i, titulos[i], "978-0", 2001, 1 + (i + 1) % nAut); });
+    medir("addEstudiante", [&](int i) { return db.addEstudiante(nEst + 1 + i, nombres[i], "1º Medio"); });
+    medir("updateEstudiante (mismo texto)", [&](int i) { return db.updateEstudiante(nEst + 1 + i, nombres[i], "2º Medio"); });
+    Fecha hoy = diaDeFecha(2024, 3, 1);
+    medir("addPrestamo + devolverPrestamo", [&](int i) {
+        return db.addPrestamo(nPres + 1 + i, nLib + 1 + i, nEst + 1 + i, hoy) && db.devolverPrestamo(nPres + 1 + i, hoy + 7);
+    });
+
+    // Biblioteca: copias de antes contra construir en el lugar con los textos movidos
+    vector<string> ts, as;
+    for (int i = 0; i < k; i++) {
+        ts.push_back("Titulo de prueba numero " + to_string(i));  // Más largo que el SSO: copiarlo reserva
+        as.push_back(nombrePersona(i) + " Jr.");
+    }
+    vector<string> ts2 = ts, as2 = as;
+    double rAntes, rDespues;
+    {
+        BibliotecaCopiada bib;
+        size_t r0 = RESERVAS;
+        for (int i = 0; i < k; i++) bib.agregarLibro(LibroCopiado(ts[i], as[i], 2000));
+        rAntes = double(RESERVAS - r0) / k;
+    }
+    tarea::Biblioteca bib;
+    tarea::Libro& primero = bib.agregarLibro(move(ts2[0]), move(as2[0]), 2000);
+    size_t r0 = RESERVAS;
+    for (int i = 1; i < k; i++) bib.agregarLibro(move(ts2[i]), move(as2[i]), 2000);
+    rDespues = double(RESERVAS - r0) / max(1, k - 1);
+    printf("Biblioteca::agregarLibro: antes (copias) %.3f reservas/libro, despues (en el lugar) %.3f reservas/libro\n", rAntes, rDespues);
+
+    // Referencias estables: la del primer libro de la Biblioteca tras k altas, y una RefFila de la
+    // DB al último autor agregado tras borrar los otros agregados (sin libros) y compactar
+    bool bibOk = bib.buscarLibro(ts[0]) == &primero && primero.titulo == ts[0];
+    int idRef = nAut + k;
+    RefFila<Autor> ref = db.refAutor(idRef);
+    string nombreRef(ref->nombre);
+    uintptr_t dirAntes = uintptr_t(db.buscarAutor(idRef));
+    int borrados = 0;
+    for (int id = nAut + 1; id < idRef; id++) borrados += db.deleteAutor(id);
+    while (db.compactarBorradas()) {}
+    bool movida = uintptr_t(db.buscarAutor(idRef)) != dirAntes;
+    printf("referencias: Biblioteca %s tras %d altas; RefFila %s tras %d borrados y compactar (fila %s)\n",
+           bibOk ? "valida" : "INVALIDA", k - 1, ref && ref->nombre == nombreRef ? "valida" : "INVALIDA", borrados,
+           movida ? "movida" : "en su lugar");
+    cout << "verificarIndices: " << db.verificarIndices() << " inconsistentes\n";
+}
+
+// Alta de un curso nuevo: N/10 estudiantes y N/2 préstamos (los activos al final, uno por libro)
+// fila a fila por el CRUD contra importar() en bloque, los dos anotando en un WAL sin fsync
+static void benchLote(int n) {
+    Datos d = generarDatos(n);
+    int nLib = int(d.libros.size()), nEst = int(d.estudiantes.size());
+    int nuevosEst = max(1, n / 10), nuevosPrest = max(nLib, n / 2);
+    vector<EstudianteStr> est;
+    for (int i = 0; i < nuevosEst; i++) est.push_back({nEst + 1 + i, nombrePersona(i * 13), "1º Medio"});
+    vector<LoteImportacion::FilaPrestamo> pres;
+    for (int i = 0; i < nuevosPrest; i++) {
+        bool activo = i >= nuevosPrest - nLib;
+        Fecha fp = diaDeFecha(2025, 3, 1) + i % 200;
+        pres.push_back({n + 1 + i, 1 + i % nLib, nEst + 1 + i % nuevosEst, fp, activo ? SIN_FECHA : fp + 10});
+    }
+    string dir = "bench_datos";
+    filesystem::create_directories(dir);
+    ConfigWAL cfg;
+    cfg.fsyncMs = -1;
+    cout << "== Importacion en bloque (N=" << n << "): " << nuevosEst << " estudiantes y " << nuevosPrest << " prestamos nuevos ==\n";
+
+    auto preparar = [&](DB& db, RegistroWAL& w, const string& wal) {
+        size_t ok;
+        insertarTodo(db, d, ok);
+        for (int id_l = 1; id_l <= nLib; id_l++) {  // Fin de curso: se devuelve todo
+            auto it = db.activosPorLibro.find(id_l);
+            if (it != db.activosPorLibro.end()) db.devolverPrestamo(it->second.front(), diaDeFecha(2025, 2, 1));
+        }
+        remove(wal.c_str());
+        w.abrir(wal, 0, cfg);
+        db.wal = &w;
+    };
+
+    DB uno;
+    RegistroWAL walUno;
+    preparar(uno, walUno, dir + "/fila_a_fila.wal");
+    size_t aceptadosUno = 0;
+    auto t0 = Reloj::now();
+    for (auto& e : est) aceptadosUno += uno.addEstudiante(e.id, e.nombre, e.grado);
+    for (auto& p : pres) aceptadosUno += uno.addPrestamo(p.id, p.id_libro, p.id_estudiante, p.fecha_prestamo, p.fecha_devolucion);
+    walUno.sincronizar();
+    double msUno = msDesde(t0);
+
+    DB bloque;
+    RegistroWAL walBloque;
+    preparar(bloque, walBloque, dir + "/bloque.wal");
+    LoteImportacion lote;
+    for (auto& e : est) lote.estudiantes.push_back({e.id, e.nombre, e.grado});
+    lote.prestamos = pres;
+    InformeImportacion inf;
+    t0 = Reloj::now();
+    bloque.importar(lote, inf);
+    walBloque.sincronizar();
+    double msBloque = msDesde(t0);
+    cout << "fila a fila: " << msUno << " ms (" << aceptadosUno << " aceptadas); importar: " << msBloque << " ms ("
+         << inf.estudiantes + inf.prestamos << " aceptadas, " << inf.rechazos.size() << " rechazos); x" << msUno / msBloque << "\n";
+    cout << "WAL: " << filesystem::file_size(dir + "/fila_a_fila.wal") / 1024 << " KB en " << aceptadosUno << " registros contra "
+         << filesystem::file_size(dir + "/bloque.wal") / 1024 << " KB en uno\n";
+    cout << "verificarIndices: fila a fila " << uno.verificarIndices() << ", bloque " << bloque.verificarIndices()
+         << " inconsistentes; mismos prestamos: " << (uno.prestamos.id == bloque.prestamos.id ? "si" : "NO") << "\n";
+
+    // Un lote con un error: todo o nada, y todos los problemas en el informe
+    LoteImportacion malo;
+    malo.prestamos = {pres.front(), {n * 10, nLib + 5, 1, diaDeFecha(2025, 6, 1), SIN_FECHA}, {n * 10 + 1, 1, 1, diaDeFecha(2025, 6, 1), SIN_FECHA}};
+    size_t antes = bloque.prestamos.size();
+    t0 = Reloj::now();
+    bloque.importar(malo, inf);
+    cout << "lote con 3 filas malas: " << inf.rechazos.size() << " rechazos (" << inf.rechazos[0].motivo << ", "
+         << inf.rechazos[1].motivo << ", " << inf.rechazos[2].motivo << "), confirmado " << (inf.confirmado ? "SI" : "no")
+         << ", prestamos sin cambios: " << (bloque.prestamos.size() == antes ? "si" : "NO") << "\n";
+
+    // Reaplicar el WAL del bloque sobre la base reproduce lo mismo
+    walBloque.cerrar();
+    DB r;
+    RegistroWAL nada;
+    preparar(r, nada, dir + "/nada.wal");
+    nada.cerrar();
+    r.wal = nullptr;
+    size_t aplicados = 0, fallidos = 0;
+    t0 = Reloj::now();
+    RegistroWAL::reproducir(dir + "/bloque.wal", 0, false, [&](OpWAL op, LectorRegistroWAL l) { fallidos += !r.aplicarWAL(op, l); }, aplicados);
+    cout << "reaplicar el WAL del bloque: " << msDesde(t0) << " ms, " << aplicados << " registros (" << fallidos
+         << " fallidos), mismos prestamos: " << (r.prestamos.id == bloque.prestamos.id ? "si" : "NO") << "\n";
+}
+
+// Varios hilos sobre una DBCompartida: mostradores que compiten por los mismos libros,
+// lectores en paralelo y lectores con un escritor a la vez
+static void benchConcurrencia(int n) {
+    Datos d = generarDatos(n);
+    DBCompartida compartida;
+    DB& db = compartida.sinLock();
+    size_t aceptados;
+    insertarTodo(db, d, aceptados);
+    int nLib = int(d.libros.size()), nEst = int(d.estudiantes.size());
+    cout << "== Concurrencia (N=" << n << ", " << thread::hardware_concurrency() << " nucleos) ==\n";
+
+    // Libros libres: los devuelve todos y cada hilo intenta prestarlos todos con sus propios ids
+    for (int id_l = 1; id_l <= nLib; id_l++) {
+        auto it = db.activosPorLibro.find(id_l);
+        if (it != db.activosPorLibro.end()) db.devolverPrestamo(it->second.front(), diaDeFecha(2025, 1, 1));
+    }
+    const int HILOS = 8;
+    int idBase = n + 1;
+    vector<int> ganados(HILOS, 0);
+    vector<thread> hs;
+    auto t0 = Reloj::now();
+    for (int h = 0; h < HILOS; h++) {
+        hs.emplace_back([&, h] {
+            for (int k = 0; k < nLib; k++) {
+                int id_l = 1 + (k + h * 977) % nLib;  // Cada hilo arranca en otro punto para chocar en el medio
+                ganados[h] += compartida.addPrestamo(idBase + h * nLib + k, id_l, 1 + (k % nEst), diaDeFecha(2025, 2, 1));
+            }
+        });
+    }
+    for (auto& h : hs) h.join();
+    double msCarrera = msDesde(t0);
+    int total = 0;
+    for (int g : ganados) total += g;
+    size_t dobles = 0;
+    for (auto& kv : db.activosPorLibro) dobles += kv.second.size() > 1;
+    cout << HILOS << " hilos prestando los mismos " << nLib << " libros: " << total << " prestamos ("
+         << (total == nLib ? "uno por libro" : "MAL") << "), libros con dos activos: " << dobles
+         << ", verificarIndices: " << db.verificarIndices() << " inconsistentes, " << msCarrera << " ms\n";
+
+    // Lecturas de mostrador: disponibilidad, libros de un estudiante, título copiado fuera del lock
+    auto lectura = [&](uint32_t& x) {
+        x = x * 1103515245u + 12345u;
+        int id_l = 1 + int(x % uint32_t(nLib)), id_e = 1 + int((x >> 8) % uint32_t(nEst));
+        size_t r = compartida.libroDisponible(id_l);
+        r += compartida.leer([&](const DB& v) { return v.librosPrestadosPorEstudiante(id_e).size(); });
+        r += compartida.leer([&](const DB& v) {
+            const Libro* l = v.buscarLibro(id_l);
+            return l ? string(l->titulo) : string();
+        }).size();
+        return r;
+    };
+    const double MS = 300;
+    auto correr = [&](int lectores, bool conEscritor, size_t& escrituras) {
+        atomic<bool> parar{false};
+        atomic<size_t> lecturas{0};
+        escrituras = 0;
+        vector<thread> ts;
+        for (int h = 0; h < lectores; h++) {
+            ts.emplace_back([&, h] {
+                uint32_t x = 12345u + uint32_t(h);
+                size_t hechas = 0, basura = 0;
+                while (!parar.load(memory_order_relaxed)) {
+                    basura += lectura(x);
+                    hechas++;
+                }
+                lecturas += hechas + (basura == SIZE_MAX);
+            });
+        }
+        if (conEscritor) {
+            ts.emplace_back([&] {
+                int id = idBase + HILOS * nLib;
+                for (int k = 0; !parar.load(memory_order_relaxed); k++, id++) {
+                    int id_l = 1 + k % nLib;
+                    auto act = compartida.leer([&](const DB& v) {
+                        auto it = v.activosPorLibro.find(id_l);
+                        return it == v.activosPorLibro.end() ? -1 : it->second.front();
+                    });
+                    if (act >= 0) escrituras += compartida.devolverPrestamo(act, diaDeFecha(2025, 3, 1));
+                    escrituras += compartida.addPrestamo(id, id_l, 1 + k % nEst, diaDeFecha(2025, 3, 2));
+                }
+            });
+        }
+        this_thread::sleep_for(chrono::duration<double, milli>(MS));
+        parar = true;
+        for (auto& t : ts) t.join();
+        return double(lecturas.load()) / (MS / 1000);
+    };
+    size_t esc;
+    double base = 0;
+    for (int lectores : {1, 2, 4, 8}) {
+        double ops = correr(lectores, false, esc);
+        if (lectores == 1) base = ops;
+        cout << lectores << " lectores: " << size_t(ops) << " lecturas/s (x" << ops / base << ")\n";
+    }
+    for (int lectores : {1, 4}) {
+        double ops = correr(lectores, true, esc);
+        cout << lectores << " lectores + 1 escritor: " << size_t(ops) << " lecturas/s, "
+             << size_t(double(esc) / (MS / 1000)) << " escrituras/s\n";
+    }
+    size_t dobles2 = 0;
+    for (auto& kv : db.activosPorLibro) dobles2 += kv.second.size() > 1;
+    cout << "al final: libros con dos activos: " << dobles2 << ", verificarIndices: " << db.verificarIndices()
+         << " inconsistentes\n";
+
+    // Búsqueda de texto concurrente: el primero arma los índices, el resto solo lee
+    atomic<size_t> hallados{0};
+    hs.clear();
+    for (int h = 0; h < 4; h++)
+        hs.emplace_back([&] { hallados += compartida.buscarLibrosPorTexto("gonzalez", 5).size(); });
+    for (auto& h : hs) h.join();
+    cout << "4 busquedas de texto simultaneas: " << hallados << " resultados\n";
+}
+
+static ConfigDatos configDatos(int n, int argc, char** argv, int desde) {
+    ConfigDatos cfg;
+    cfg.n = n;
+    if (argc > desde) cfg.zipf = atof(argv[desde]);
+    if (argc > desde + 1) cfg.activos = atof(argv[desde + 1]);
+    if (argc > desde + 2) cfg.semilla = strtoull(argv[desde + 2], nullptr, 10);
+    return cfg;
+}
+
+// Escribe los cuatro CSV de generarDatosRealistas en dir (para cargarlos con fase3 --importar-csv)
+static void generarCSV(const ConfigDatos& cfg, const string& dir) {
+    Datos d = generarDatosRealistas(cfg);
+    filesystem::create_directories(dir);
+    guardarAnterior(d, dir);
+    size_t activos = 0;
+    for (auto& p : d.prestamos) activos += p.fecha_devolucion.empty();
+    cout << dir << ": " << d.autores.size() << " autores, " << d.libros.size() << " libros, " << d.estudiantes.size() << " estudiantes, "
+         << d.prestamos.size() << " préstamos (" << activos << " activos), zipf " << cfg.zipf << ", semilla " << cfg.semilla << "\n";
+}
+
+/*
+ * Suite de regresión: carga, guardado, cada método CRUD, libroDisponible y las dos consultas
+ * del menú sobre datos realistas, sin WAL. Salida CSV en stdout (las líneas # son comentarios):
+ *   operacion,n,ops,fallidas,total_ms,ops_s,p50_us,p90_us,p99_us,max_us
+ * Cada operación se mide por separado; fallidas son las que devolvieron false (deberían ser 0).
+ */
+struct ResultadoSuite {
+    vector<double> us;
+    size_t fallidas = 0;
+};
+
+static void informarSuite(const char* operacion, int n, ResultadoSuite& r) {
+    double total = 0;
+    for (double x : r.us) total += x;
+    double maximo = r.us.empty() ? 0 : *max_element(r.us.begin(), r.us.end());
+    cout << operacion << "," << n << "," << r.us.size() << "," << r.fallidas << "," << total / 1000 << ","
+         << (total > 0 ? double(r.us.size()) / total * 1e6 : 0) << "," << percentil(r.us, 0.50) << "," << percentil(r.us, 0.90) << ","
+         << percentil(r.us, 0.99) << "," << maximo << "\n";
+}
+
+// Corre f(i) k veces midiendo cada llamada; f devuelve si la operación salió bien
+template <class F>
+static void medirSuite(const char* operacion, int n, int k, F f) {
+    ResultadoSuite r;
+    r.us.reserve(size_t(k));
+    for (int i = 0; i < k; i++) {
+        auto t0 = Reloj::now();
+        bool ok = f(i);
+        r.us.push_back(msDesde(t0) * 1000);
+        r.fallidas += !ok;
+    }
+    informarSuite(operacion, n, r);
+}
+
+static void benchSuite(const ConfigDatos& cfg) {
+    string dir = "bench_suite";
+    Datos d = generarDatosRealistas(cfg);
+    filesystem::create_directories(dir);
+    remove((dir + SNAPSHOT).c_str());
+    guardarAnterior(d, dir);
+    int n = cfg.n, nAut = int(d.autores.size()), nLib = int(d.libros.size()), nEst = int(d.estudiantes.size());
+    cout << "# suite N=" << n << " zipf=" << cfg.zipf << " activos=" << cfg.activos << " semilla=" << cfg.semilla << " autores=" << nAut
+         << " libros=" << nLib << " estudiantes=" << nEst << " prestamos=" << d.prestamos.size() << " hilos=" << DB::hilos() << "\n";
+    cout << "operacion,n,ops,fallidas,total_ms,ops_s,p50_us,p90_us,p99_us,max_us\n";
+
+    const int REPETICIONES = 3;
+    DATA_DIR = dir;
+    auto db = make_unique<DB>();
+    MODO_CSV = true;
+    medirSuite("cargar_csv", n, REPETICIONES, [&](int) {
+        db = make_unique<DB>();
+        cargarTodo(*db, false);
+        return db->prestamos.size() == d.prestamos.size();
+    });
+    MODO_CSV = false;
+    medirSuite("guardar_csv", n, REPETICIONES, [&](int) { return exportarCSV(*db); });
+    medirSuite("guardar_snapshot", n, REPETICIONES, [&](int) { return db->guardarSnapshot(dir + SNAPSHOT); });
+    medirSuite("cargar_snapshot", n, REPETICIONES, [&](int) {
+        db = make_unique<DB>();
+        cargarTodo(*db, false);
+        return db->prestamos.size() == d.prestamos.size();
+    });
+    DB& b = *db;
+
+    // Operaciones sueltas: k de cada una sobre ids al azar (o nuevos, por encima de los del lote)
+    int k = max(1000, min(n / 10, 20000));
+    mt19937_64 rng(cfg.semilla + 1);
+    auto azar = [&](int hasta) { return uniform_int_distribution<int>(1, hasta)(rng); };
+    int base = 10 * n;  // Ids nuevos sin chocar con los generados
+    medirSuite("libroDisponible", n, k, [&](int) { b.libroDisponible(azar(nLib)); return true; });
+    medirSuite("librosPrestadosPorEstudiante", n, k, [&](int) { return b.librosPrestadosPorEstudiante(azar(nEst)).size() < size_t(nLib); });
+    medirSuite("topAutores", n, k, [&](int) { return !b.topAutores(10).empty(); });
+
+    medirSuite("addAutor", n, k, [&](int i) { return b.addAutor(base + i, "Autor Nuevo " + to_string(i), "Chile"); });
+    medirSuite("updateAutor", n, k, [&](int i) { return b.updateAutor(azar(nAut), "Autor, Renombrado " + to_string(i), "Peru"); });
+    medirSuite("addLibro", n, k, [&](int i) { return b.addLibro(base + i, "Libro Nuevo " + to_string(i), "978-0", 2024, azar(nAut)); });
+    medirSuite("updateLibro", n, k, [&](int i) {
+        int id = azar(nLib);
+        return b.updateLibro(id, "Titulo \"revisado\" " + to_string(i), "978-1", 2000, d.libros[size_t(id - 1)].id_autor);
+    });
+    medirSuite("addEstudiante", n, k, [&](int i) { return b.addEstudiante(base + i, "Estudiante Nuevo " + to_string(i), "1º Medio"); });
+    medirSuite("updateEstudiante", n, k, [&](int i) { return b.updateEstudiante(azar(nEst), "Estudiante " + to_string(i), "2º Medio"); });
+    // Préstamos sobre los libros nuevos (libres), devueltos y luego borrados como históricos
+    medirSuite("addPrestamo", n, k, [&](int i) { return b.addPrestamo(base + i, base + i, azar(nEst), "2025-01-10"); });
+    medirSuite("devolverPrestamo", n, k, [&](int i) { return b.devolverPrestamo(base + i, "2025-01-20"); });
+    medirSuite("deletePrestamo", n, k, [&](int i) { return b.deletePrestamo(base + i); });
+    medirSuite("deleteLibro", n, k, [&](int i) { return b.deleteLibro(base + i); });
+    medirSuite("deleteEstudiante", n, k, [&](int i) { return b.deleteEstudiante(base + i); });
+    medirSuite("deleteAutor", n, k, [&](int i) { return b.deleteAutor(base + i); });
+    cout << "# verificarIndices: " << b.verificarIndices() << " inconsistentes\n";
+}
+
+#ifdef BIBLIOTECADB_POSIX
+// Generador de carga para el modo servidor: cada conexión es un hilo que mantiene `profundidad`
+// pedidos en vuelo (pipelining) y mide cada uno desde que se envía hasta que llega su respuesta.
+// Mezcla de mostrador: disponibilidad, libros de un estudiante, préstamo activo de un libro (motor de
+// consultas, por índice), altas y devoluciones.
+struct ResultadoCarga {
+    size_t respuestas = 0, rechazadas = 0, errores = 0;
+    vector<double> latenciasUs;
+    double segundos = 0;
+};
+
+static int conectarServidor(const string& ruta) {
+    sockaddr_un dir{};
+    dir.sun_family = AF_UNIX;
+    if (ruta.size() >= sizeof(dir.sun_path)) return -1;
+    memcpy(dir.sun_path, ruta.c_str(), ruta.size() + 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&dir), sizeof(dir)) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+static ResultadoCarga generarCarga(const string& ruta, int conexiones, int profundidad, double ms, int nLib, int nEst, int idBase) {
+    vector<ResultadoCarga> porHilo(static_cast<size_t>(conexiones));
+    vector<thread> hs;
+    auto t0 = Reloj::now();
+    for (int h = 0; h < conexiones; h++) {
+        hs.emplace_back([&, h] {
+            ResultadoCarga& r = porHilo[size_t(h)];
+            int fd = conectarServidor(ruta);
+            if (fd < 0) { r.errores++; return; }
+            uint32_t x = 777u + uint32_t(h) * 7919u;
+            int propio = idBase + h * 10000000, altas = 0;
+            deque<Reloj::time_point> enVuelo;
+            string salida, entrada;
+            char buf[64 * 1024];
+            auto fin = t0 + chrono::duration<double, milli>(ms);
+            while (true) {
+                bool seguir = Reloj::now() < fin;
+                if (!seguir && enVuelo.empty()) break;
+                salida.clear();
+                while (seguir && int(enVuelo.size()) < profundidad) {
+                    x = x * 1103515245u + 12345u;
+                    int id_l = 1 + int((x >> 4) % uint32_t(nLib)), id_e = 1 + int((x >> 12) % uint32_t(nEst));
+                    EscritorMensaje m;
+                    uint32_t tipo = x % 10;
+                    if (tipo < 5) m.byte(uint8_t(OpLectura::Disponible)).entero(id_l);
+                    else if (tipo < 7) m.byte(uint8_t(OpLectura::PrestadosEstudiante)).entero(id_e);
+                    else if (tipo < 8) {
+                        Consulta q{TablaConsulta::Prestamo,
+                                   {{"prestamo.id_libro", OpFiltro::Igual, to_string(id_l)}, {"prestamo.fecha_devolucion", OpFiltro::Igual, ""}},
+                                   {"prestamo.id", "libro.titulo", "estudiante.nombre"}, "", "", false, 5};
+                        escribirConsulta(m.byte(uint8_t(OpLectura::Consultar)), q);
+                    } else if (tipo < 9) {
+                        m.byte(uint8_t(OpWAL::AddPrestamo)).entero(propio + altas++).entero(id_l).entero(id_e).texto("2025-05-01").texto("");
+                    } else {
+                        m.byte(uint8_t(OpWAL::DevPrestamo)).entero(propio + max(0, altas - 3)).texto("2025-05-10");
+                    }
+                    salida += m.cerrar();
+                    enVuelo.push_back(Reloj::now());
+                }
+                for (size_t env = 0; env < salida.size();) {
+                    ssize_t n = send(fd, salida.data() + env, salida.size() - env, MSG_NOSIGNAL);
+                    if (n <= 0) { r.errores++; close(fd); return; }
+                    env += size_t(n);
+                }
+                ssize_t n = read(fd, buf, sizeof(buf));
+                if (n <= 0) { r.errores++; break; }
+                entrada.append(buf, size_t(n));
+                size_t ini = 0;
+                while (entrada.size() - ini >= 4) {
+                    uint32_t largo;
+                    memcpy(&largo, entrada.data() + ini, 4);
+                    if (entrada.size() - ini - 4 < largo) break;
+                    auto estado = EstadoRespuesta(uint8_t(entrada[ini + 4]));
+                    r.rechazadas += estado == EstadoRespuesta::Rechazada;
+                    r.errores += estado == EstadoRespuesta::Error;
+                    r.respuestas++;
+                    r.latenciasUs.push_back(chrono::duration<double, micro>(Reloj::now() - enVuelo.front()).count());
+                    enVuelo.pop_front();
+                    ini += 4 + largo;
+                }
+                entrada.erase(0, ini);
+            }
+            close(fd);
+        });
+    }
+    for (auto& t : hs) t.join();
+    ResultadoCarga total;
+    total.segundos = msDesde(t0) / 1000;
+    for (auto& r : porHilo) {
+        total.respuestas += r.respuestas;
+        total.rechazadas += r.rechazadas;
+        total.errores += r.errores;
+        total.latenciasUs.insert(total.latenciasUs.end(), r.latenciasUs.begin(), r.latenciasUs.end());
+    }
+    return total;
+}
+
+// Sin ruta levanta un servidor en este proceso con N préstamos sintéticos; con ruta carga
+// contra uno ya corriendo (fase3 --servidor=ruta; ojo: sus altas y devoluciones quedan en esa DB)
+static void benchServidor(int n, const string& rutaExterna) {
+    int nLib = max(1, n / 4), nEst = max(1, n / 10);
+    DBCompartida compartida;
+    ServidorDB servidor(compartida, max(2u, thread::hardware_concurrency()));
+    thread hiloServidor;
+    string ruta = rutaExterna;
+    if (ruta.empty()) {
+        Datos d = generarDatos(n);
+        size_t aceptados;
+        insertarTodo(compartida.sinLock(), d, aceptados);
+        ruta = "/tmp/bench_fase3_" + to_string(getpid()) + ".sock";
+        string error;
+        if (!servidor.abrir(ruta, error)) {
+            cout << "no se pudo abrir el servidor: " << error << "\n";
+            return;
+        }
+        hiloServidor = thread([&] { servidor.correr(); });
+    }
+    cout << "== Servidor (N=" << n << ", " << ruta << ", " << thread::hardware_concurrency() << " nucleos) ==\n";
+    int idBase = n + 1;
+    for (auto cfg : {pair<int, int>{1, 1}, {1, 32}, {4, 1}, {4, 32}, {16, 8}}) {
+        ResultadoCarga r = generarCarga(ruta, cfg.first, cfg.second, 500, nLib, nEst, idBase);
+        idBase += 1000000;
+        double p50 = percentil(r.latenciasUs, 0.50), p99 = percentil(r.latenciasUs, 0.99);
+        cout << cfg.first << " conexiones x " << cfg.second << " en vuelo: " << size_t(double(r.respuestas) / r.segundos)
+             << " pedidos/s, p50 " << p50 << " us, p99 " << p99 << " us (rechazados " << r.rechazadas << ", errores "
+             << r.errores << ")\n";
+    }
+    if (hiloServidor.joinable()) {
+        servidor.detener();
+        hiloServidor.join();
+        size_t dobles = 0;
+        for (auto& kv : compartida.sinLock().activosPorLibro) dobles += kv.second.size() > 1;
+        cout << "libros con dos activos: " << dobles << ", verificarIndices: " << compartida.sinLock().verificarIndices()
+             << " inconsistentes\n";
+    }
+}
+#endif
+
+int main(int argc, char** argv) {
+    string que = argc > 1 ? argv[1] : "inserciones";
+    int n = argc > 2 ? atoi(argv[2]) : 20000;
+    if (que == "inserciones") benchInserciones(n);
+    else if (que == "integridad") benchIntegridad(n);
+    else if (que == "carga") benchCarga(n);
+    else if (que == "snapshot") benchSnapshot(n);
+    else if (que == "wal") benchWAL(n);
+    else if (que == "guardado") benchGuardado(n);
+    else if (que == "memoria") benchMemoria(n);
+    else if (que == "fechas") benchFechas(n);
+    else if (que == "columnas") benchColumnas(n);
+    else if (que == "consultas") benchConsultas(n);
+    else if (que == "ranking") benchRanking(n);
+    else if (que == "motor") benchMotor(n);
+    else if (que == "busqueda") benchBusqueda(n);
+    else if (que == "calendario") benchCalendario(n);
+    else if (que == "lote") benchLote(n);
+    else if (que == "listados") benchListados(n);
+    else if (que == "borrados") benchBorrados(n);
+    else if (que == "reservas") benchReservas(n);
+    else if (que == "concurrencia") benchConcurrencia(n);
+    else if (que == "suite") benchSuite(configDatos(n, argc, argv, 3));
+    else if (que == "generar") generarCSV(configDatos(n, argc, argv, 4), argc > 3 ? argv[3] : "bench_generado");
+#ifdef BIBLIOTECADB_POSIX
+    else if (que == "servidor") benchServidor(n, argc > 3 ? argv[3] : "");
+#endif
+    else {
+        cerr << "Benchmark desconocido: " << que << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -4,9 +4,55 @@
 #include <fstream>
 #include <algorithm>
 #include <unordered_map>
+#include <unordered_set>
+#include <set>      // Ranking de autores y prefijos de búsqueda ordenados
+#include <map>      // Calendario de préstamos por día
+#include <memory>   // unique_ptr (bloques del pool de textos)
 #include <sstream>  // Para stringstream en op18
 #include <limits>   // FIX: Para numeric_limits<streamsize>
-#include <cstdlib>  // Para system(mkdir)
+#include <cstdlib>  // atoi, _exit
+#include <cstdint>  // SIZE_MAX
+#include <climits>  // INT_MIN/INT_MAX
+#include <cstddef>  // ptrdiff_t
+#include <cstdio>   // fopen/fread (lectura por bloques sin mmap)
+#include <cstring>  // memchr
+#include <cctype>   // isalnum, tolower (normalizarTexto)
+#include <cmath>    // ceil
+#include <bitset>   // Conteo de trigramas comunes
+#include <charconv> // from_chars
+#include <string_view>
+#include <type_traits>  // is_trivially_copyable
+#include <thread>   // Carga y validación en paralelo
+#include <future>
+#include <mutex>
+#include <shared_mutex>  // DBCompartida: lecturas en paralelo, escrituras exclusivas
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <filesystem>  // resize_file para cortar la cola dañada del WAL
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>     // open
+#include <sys/mman.h>  // mmap
+#include <sys/stat.h>  // fstat
+#include <unistd.h>    // close, fsync
+#include <sys/socket.h>  // Modo servidor: socket local
+#include <sys/un.h>
+#include <poll.h>
+#include <csignal>     // SIGINT/SIGTERM paran el servidor, SIGPIPE se ignora
+#define BIBLIOTECADB_POSIX 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>  // Barridos SIMD de la tabla de préstamos (AVX2 si se compila con -mavx2)
+#define BIBLIOTECADB_SSE2 1
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>  // __rdtsc: reloj de la instrumentación
+#define BIBLIOTECADB_TSC 1
+#elif defined(_M_X64)
+#include <intrin.h>
+#define BIBLIOTECADB_TSC 1
+#endif
 
 using namespace std;
 
@@ -14,396 +60,5210 @@ using namespace std;
  * Fase 3: Implementación en C++ de BibliotecaDB.
  * Entidades: Autor, Libro, Estudiante, Préstamo.
  * Soporte CRUD completo con validaciones.
- * Persistencia en CSV (.txt) con fstream.
- * Consultas: Libros por estudiante (activos), ranking autores por libros.
+ * Almacenamiento en memoria: filas compactas (textos en un pool, préstamos por columnas) y
+ * borrados con lápidas que se compactan de a tramos.
+ * Persistencia: por defecto snapshot binario columnar (data/biblioteca.snap) + WAL incremental
+ * (data/biblioteca.wal) compactado en segundo plano; CSV con --csv o para importar/exportar.
+ * Consultas: Libros por estudiante (activos), ranking autores por libros, motor con filtros y joins.
  * Manejo errores: IDs únicos, FKs válidas, integridad referencial.
- * Relaciones: Simuladas con bucles (no SQL).
+ * Relaciones: índices hash id->posición por tabla y conteos inversos de FK, así las búsquedas
+ * y validaciones de PK/FK son O(1) (no SQL).
+ * Modo servidor (--servidor): la misma DB atendida por un socket local para varios clientes.
  */
 
+// Las filas no tienen std::string propios: nombres, títulos e ISBN son vistas sobre DB::pool y los
+// textos muy repetidos (nacionalidad, grado) son ids de 4 bytes en DB::dicc.
 struct Autor {
     int id;
-    string nombre;
-    string nacionalidad;
+    string_view nombre;
+    uint32_t nacionalidad;  // Id en DB::dicc
 };
 
 struct Libro {
     int id;
-    string titulo;
-    string isbn;
+    string_view titulo;
+    string_view isbn;
     int ano;
     int id_autor;  // FK a Autor
 };
 
 struct Estudiante {
     int id;
-    string nombre;
-    string grado;  // e.g., "2º Bachillerato"
+    string_view nombre;
+    uint32_t grado;  // e.g., "2º Bachillerato" (id en DB::dicc)
 };
 
+const uint32_t TEXTO_VACIO = 0;  // Id de "" en todo Diccionario
+
+// Fecha como nº de día desde 1970-01-01 (gregoriano). Se parsea una vez al cargar o al leer
+// del menú; en CSV, menú y listados sigue siendo AAAA-MM-DD.
+using Fecha = int32_t;
+const Fecha SIN_FECHA = INT32_MIN;  // Préstamo sin devolver ("" en el CSV)
+
+inline Fecha diaDeFecha(int a, int m, int d) {
+    a -= m <= 2;
+    int era = (a >= 0 ? a : a - 399) / 400;
+    int ae = a - era * 400;
+    int de = ae * 365 + ae / 4 - ae / 100 + (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    return era * 146097 + de - 719468;
+}
+
+inline void fechaDeDia(Fecha f, int& a, int& m, int& d) {
+    f += 719468;
+    int era = (f >= 0 ? f : f - 146096) / 146097;
+    int de = f - era * 146097;
+    int ae = (de - de / 1460 + de / 36524 - de / 146096) / 365;
+    int da = de - (365 * ae + ae / 4 - ae / 100);
+    int mp = (5 * da + 2) / 153;
+    d = da - (153 * mp + 2) / 5 + 1;
+    m = mp < 10 ? mp + 3 : mp - 9;
+    a = ae + era * 400 + (m <= 2);
+}
+
+// AAAA-MM-DD estricto con día válido para el mes; "" es SIN_FECHA. false si no se entiende.
+inline bool leerFecha(string_view s, Fecha& f) {
+    if (s.empty()) { f = SIN_FECHA; return true; }
+    if (s.size() != 10 || s[4] != '-' || s[7] != '-') return false;
+    int v[3] = {0, 0, 0};
+    for (size_t i = 0; i < 10; i++) {
+        if (i == 4 || i == 7) continue;
+        if (s[i] < '0' || s[i] > '9') return false;  // Sin signos ni espacios
+        int& x = v[i < 4 ? 0 : i < 7 ? 1 : 2];
+        x = x * 10 + (s[i] - '0');
+    }
+    static const int diasMes[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    bool bisiesto = v[0] % 4 == 0 && (v[0] % 100 != 0 || v[0] % 400 == 0);
+    if (v[1] < 1 || v[1] > 12 || v[2] < 1 || v[2] > diasMes[v[1] - 1] + (v[1] == 2 && bisiesto)) return false;
+    f = diaDeFecha(v[0], v[1], v[2]);
+    return true;
+}
+
+// Escribe f como AAAA-MM-DD en out (10 bytes) y devuelve el final; SIN_FECHA no escribe nada
+inline char* escribirFecha(Fecha f, char* out) {
+    if (f == SIN_FECHA) return out;
+    int a, m, d;
+    fechaDeDia(f, a, m, d);
+    const int v[3] = {a, m, d}, largo[3] = {4, 2, 2};
+    for (int i = 0; i < 3; i++) {
+        for (int k = largo[i] - 1, x = v[i]; k >= 0; k--, x /= 10) out[k] = char('0' + x % 10);
+        out += largo[i];
+        if (i < 2) *out++ = '-';
+    }
+    return out;
+}
+
+inline string textoFecha(Fecha f) {
+    char buf[10];
+    return string(buf, escribirFecha(f, buf));
+}
+
 struct Prestamo {
     int id;
     int id_libro;  // FK a Libro
     int id_estudiante;  // FK a Estudiante
-    string fecha_prestamo;
-    string fecha_devolucion;  // "" si activo
+    Fecha fecha_prestamo;
+    Fecha fecha_devolucion;  // SIN_FECHA si activo
+    bool activo() const { return fecha_devolucion == SIN_FECHA; }
 };
+static_assert(is_trivially_copyable<Prestamo>::value && sizeof(Prestamo) == 20, "Prestamo: 5 enteros sin punteros");
 
-struct DB {
-    vector<Autor> autores;
-    vector<Libro> libros;
-    vector<Estudiante> estudiantes;
-    vector<Prestamo> prestamos;
+// Tabla de préstamos por columnas (una por campo): los recorridos por id_libro/id_estudiante y
+// estado leen solo esas columnas, seguidas en memoria. Las filas se arman al vuelo como Prestamo.
+class TablaPrestamos {
+public:
+    vector<int> id, id_libro, id_estudiante;
+    vector<Fecha> fecha_prestamo, fecha_devolucion;
 
-    // Utilidades CSV: Split y escape para comas/comillas
-    static vector<string> splitCSV(const string& s) {
-        vector<string> out;
-        string cur;
-        bool inq = false;
-        for (char c : s) {
-            if (c == '"') { inq = !inq; cur.push_back(c); }
-            else if (c == ',' && !inq) { out.push_back(cur); cur.clear(); }
-            else cur.push_back(c);
+    TablaPrestamos() = default;
+    explicit TablaPrestamos(const vector<Prestamo>& filas) {
+        reserve(filas.size());
+        for (auto& p : filas) push_back(p);
+    }
+
+    size_t size() const { return id.size(); }
+    bool empty() const { return id.empty(); }
+    Prestamo operator[](size_t i) const {
+        return Prestamo{id[i], id_libro[i], id_estudiante[i], fecha_prestamo[i], fecha_devolucion[i]};
+    }
+    bool activo(size_t i) const { return fecha_devolucion[i] == SIN_FECHA; }
+
+    void push_back(const Prestamo& p) {
+        id.push_back(p.id);
+        id_libro.push_back(p.id_libro);
+        id_estudiante.push_back(p.id_estudiante);
+        fecha_prestamo.push_back(p.fecha_prestamo);
+        fecha_devolucion.push_back(p.fecha_devolucion);
+    }
+    void reserve(size_t n) { columnas([n](auto& c) { c.reserve(n); }); }
+    void resize(size_t n) { columnas([n](auto& c) { c.resize(n); }); }
+    void clear() { columnas([](auto& c) { c.clear(); }); }
+    void shrink_to_fit() { columnas([](auto& c) { c.shrink_to_fit(); }); }
+    // Copia la fila desde sobre hacia (compactación)
+    void mover(size_t desde, size_t hacia) { columnas([=](auto& c) { c[hacia] = c[desde]; }); }
+
+    // Recorrido por valor (for (Prestamo p : tabla))
+    class const_iterator {
+    public:
+        const_iterator(const TablaPrestamos* t, size_t i) : t(t), i(i) {}
+        Prestamo operator*() const { return (*t)[i]; }
+        const_iterator& operator++() { i++; return *this; }
+        bool operator!=(const const_iterator& o) const { return i != o.i; }
+        bool operator==(const const_iterator& o) const { return i == o.i; }
+    private:
+        const TablaPrestamos* t;
+        size_t i;
+    };
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, size()); }
+
+    // Posiciones (en orden) de las filas con cada columna dentro de su rango cerrado [lo, hi]
+    struct Rango {
+        vector<int> TablaPrestamos::*col;
+        int32_t lo, hi;
+    };
+    vector<size_t> filtrarRangos(const vector<Rango>& rangos) const;
+    size_t contarActivos() const {
+        size_t n = 0;
+        for (Fecha f : fecha_devolucion) n += f == SIN_FECHA;  // El compilador lo vectoriza
+        return n;
+    }
+
+private:
+    template <class F>
+    void columnas(F f) {
+        f(id); f(id_libro); f(id_estudiante); f(fecha_prestamo); f(fecha_devolucion);
+    }
+};
+
+// x en [lo, hi] es (x - lo) <= (hi - lo) sin signo; SSE2/AVX2 solo comparan con signo, así que
+// se invierte el bit de signo de los dos lados. 8 (AVX2) o 4 (SSE2) filas por paso.
+inline vector<size_t> TablaPrestamos::filtrarRangos(const vector<Rango>& rangos) const {
+    vector<size_t> out;
+    size_t n = size(), k = rangos.size(), i = 0;
+    vector<const int*> cols;
+    vector<uint32_t> lo, ancho;
+    for (auto& r : rangos) {
+        if (r.lo > r.hi) return out;
+        cols.push_back((this->*r.col).data());
+        lo.push_back(uint32_t(r.lo));
+        ancho.push_back(uint32_t(r.hi) - uint32_t(r.lo));
+    }
+#if defined(__AVX2__)
+    const __m256i signo = _mm256_set1_epi32(INT32_MIN);
+    for (; i + 8 <= n; i += 8) {
+        __m256i fuera = _mm256_setzero_si256();
+        for (size_t j = 0; j < k; j++) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cols[j] + i));
+            __m256i d = _mm256_xor_si256(_mm256_sub_epi32(x, _mm256_set1_epi32(int(lo[j]))), signo);
+            fuera = _mm256_or_si256(fuera, _mm256_cmpgt_epi32(d, _mm256_xor_si256(_mm256_set1_epi32(int(ancho[j])), signo)));
+        }
+        int m = ~_mm256_movemask_ps(_mm256_castsi256_ps(fuera)) & 0xFF;
+        for (int b = 0; m; b++, m >>= 1) if (m & 1) out.push_back(i + b);
+    }
+#elif defined(BIBLIOTECADB_SSE2)
+    const __m128i signo = _mm_set1_epi32(INT32_MIN);
+    for (; i + 4 <= n; i += 4) {
+        __m128i fuera = _mm_setzero_si128();
+        for (size_t j = 0; j < k; j++) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cols[j] + i));
+            __m128i d = _mm_xor_si128(_mm_sub_epi32(x, _mm_set1_epi32(int(lo[j]))), signo);
+            fuera = _mm_or_si128(fuera, _mm_cmpgt_epi32(d, _mm_xor_si128(_mm_set1_epi32(int(ancho[j])), signo)));
+        }
+        int m = ~_mm_movemask_ps(_mm_castsi128_ps(fuera)) & 0xF;
+        for (int b = 0; m; b++, m >>= 1) if (m & 1) out.push_back(i + b);
+    }
+#endif
+    for (; i < n; i++) {
+        bool ok = true;
+        for (size_t j = 0; j < k && ok; j++) ok = uint32_t(cols[j][i]) - lo[j] <= ancho[j];
+        if (ok) out.push_back(i);
+    }
+    return out;
+}
+
+/*
+ * Filas borradas (lápidas) de una tabla de la DB. Borrar es marcar la fila: nada se corre y las
+ * posiciones del resto siguen valiendo; los recorridos saltan las marcadas. La compactación
+ * (DB::compactarBorradas) las saca de a tramos, corriendo las vivas hacia adelante en orden.
+ * El bitmap puede quedar más corto que la tabla: lo que no alcanza está vivo, así las altas no
+ * lo tocan.
+ */
+class Lapidas {
+public:
+    // Compactación en curso: [0, escritura) ya está compactado, [escritura, lectura) son filas
+    // muertas (las ya corridas quedan marcadas) y de lectura en adelante falta revisar
+    size_t lectura = 0, escritura = 0;
+    bool compactando = false;
+
+    bool borrada(size_t i) const { return i / 64 < bits.size() && (bits[i / 64] >> (i % 64) & 1); }
+    void marcar(size_t i) {
+        if (i / 64 >= bits.size()) bits.resize(i / 64 + 1);
+        bits[i / 64] |= uint64_t(1) << (i % 64);
+        n++;
+    }
+    void desmarcar(size_t i) {
+        bits[i / 64] &= ~(uint64_t(1) << (i % 64));
+        n--;
+    }
+    size_t size() const { return n; }  // Filas borradas
+    bool empty() const { return n == 0; }
+    void clear() { *this = Lapidas(); }
+    size_t bytes() const { return bits.capacity() * sizeof(uint64_t); }
+
+    // La tabla quedó en sus primeras filas (fin de una compactación): se descarta el resto
+    void recortar(size_t filas) {
+        bits.resize((filas + 63) / 64);
+        if (filas % 64 && !bits.empty()) bits.back() &= (uint64_t(1) << (filas % 64)) - 1;
+        n = 0;
+        for (uint64_t w : bits) n += unos(w);
+    }
+    size_t primeraBorrada() const {
+        size_t w = 0;
+        while (w < bits.size() && !bits[w]) w++;
+        if (w == bits.size()) return SIZE_MAX;
+        size_t i = w * 64;
+        while (!borrada(i)) i++;
+        return i;
+    }
+    // Primera fila viva desde i (filas si no hay)
+    size_t siguienteViva(size_t i, size_t filas) const {
+        while (i < filas && borrada(i)) i = i % 64 == 0 && bits[i / 64] == ~uint64_t(0) ? i + 64 : i + 1;
+        return min(i, filas);
+    }
+    // Posición tras saltar k filas vivas desde i; por palabras enteras donde se puede
+    size_t saltarVivas(size_t i, size_t k, size_t filas) const {
+        if (n == 0) return filas - min(i, filas) > k ? i + k : filas;
+        while (i < filas && k) {
+            size_t w = i / 64;
+            if (i % 64 == 0 && i + 64 <= filas && w < bits.size() && size_t(64 - unos(bits[w])) <= k) {
+                k -= size_t(64 - unos(bits[w]));
+                i += 64;
+            } else if (i % 64 == 0 && i + 64 <= filas && w >= bits.size()) {
+                size_t d = min(k, filas - i);
+                i += d;
+                k -= d;
+            } else {
+                k -= !borrada(i);
+                i++;
+            }
+        }
+        return i;
+    }
+    // f(i) para cada fila viva de [0, filas), en orden
+    template <class F>
+    void recorrerVivas(size_t filas, F f) const {
+        for (size_t i = 0; i < filas; i++) {
+            uint64_t w = i / 64 < bits.size() ? bits[i / 64] : 0;
+            if (w == ~uint64_t(0) && i % 64 == 0) {
+                i += 63;
+                continue;
+            }
+            if (!(w >> (i % 64) & 1)) f(i);
+        }
+    }
+
+private:
+    vector<uint64_t> bits;
+    size_t n = 0;
+
+    static int unos(uint64_t w) {
+#if defined(__GNUC__)
+        return __builtin_popcountll(w);
+#else
+        int c = 0;
+        for (; w; w &= w - 1) c++;
+        return c;
+#endif
+    }
+};
+
+// Posiciones de las filas vivas, en orden, para quien recorre por índice (snapshot). Sin lápidas
+// es la identidad y no arma nada.
+class FilasVivas {
+public:
+    FilasVivas(size_t filas, const Lapidas& l) : todas(l.empty()), n(filas - l.size()) {
+        if (todas) return;
+        pos.reserve(n);
+        l.recorrerVivas(filas, [&](size_t i) { pos.push_back(uint32_t(i)); });
+    }
+    size_t size() const { return n; }
+    size_t operator[](size_t k) const { return todas ? k : pos[k]; }
+    bool sonTodas() const { return todas; }
+
+private:
+    bool todas;
+    size_t n;
+    vector<uint32_t> pos;
+};
+
+// Calendario de préstamos: por día, los que empezaron y los que se devolvieron ese día, con los
+// totales de los devueltos por grado. Un rango de fechas recorre solo sus días; los activos de un
+// día salen de los totales menos lo que pasó después, así los informes recientes no tocan el resto.
+// El grado es el del estudiante al devolver (al reconstruir desde la tabla, el que tenga entonces).
+class CalendarioPrestamos {
+public:
+    struct Devuelto {
+        int id;
+        uint32_t grado;  // id de Diccionario
+    };
+    struct TotalGrado {
+        uint32_t grado;
+        int64_t devueltos, dias;  // dias: suma de la duración de esos préstamos
+    };
+    struct Dia {
+        vector<int> abiertos;      // ids de préstamo (sin orden dentro del día)
+        vector<Devuelto> devueltos;
+        vector<TotalGrado> porGrado;  // Pocos grados: búsqueda lineal
+        int64_t diasDevueltos = 0;
+    };
+
+    // gradoDe(fila) -> grado con que se devolvió el préstamo de esa fila
+    template <class GradoDe>
+    void construir(const TablaPrestamos& t, GradoDe gradoDe, const Lapidas& borradas = Lapidas()) {
+        *this = CalendarioPrestamos();
+        borradas.recorrerVivas(t.size(), [&](size_t i) {
+            abrir(t.id[i], t.fecha_prestamo[i]);
+            if (!t.activo(i)) devolver(t.id[i], t.fecha_prestamo[i], t.fecha_devolucion[i], gradoDe(i));
+        });
+    }
+    void abrir(int id, Fecha fp) {
+        dias[fp].abiertos.push_back(id);
+        totalAbiertos++;
+    }
+    void devolver(int id, Fecha fp, Fecha fd, uint32_t grado) {
+        Dia& d = dias[fd];
+        d.devueltos.push_back({id, grado});
+        sumar(d, grado, fd - fp, +1);
+        totalDevueltos++;
+    }
+    // Borrado de un préstamo (fd SIN_FECHA si seguía activo)
+    void quitar(int id, Fecha fp, Fecha fd) {
+        auto a = dias.find(fp);
+        if (a != dias.end()) {
+            auto& v = a->second.abiertos;
+            auto pos = find(v.begin(), v.end(), id);
+            if (pos != v.end()) {
+                *pos = v.back();
+                v.pop_back();
+                totalAbiertos--;
+            }
+            soltarSiVacio(a);
+        }
+        auto d = fd == SIN_FECHA ? dias.end() : dias.find(fd);
+        if (d == dias.end()) return;
+        auto& v = d->second.devueltos;
+        auto pos = find_if(v.begin(), v.end(), [id](const Devuelto& x) { return x.id == id; });
+        if (pos != v.end()) {
+            sumar(d->second, pos->grado, fd - fp, -1);
+            *pos = v.back();
+            v.pop_back();
+            totalDevueltos--;
+        }
+        soltarSiVacio(d);
+    }
+
+    // id de préstamo devuelto -> grado anotado
+    unordered_map<int, uint32_t> gradosAnotados() const {
+        unordered_map<int, uint32_t> r;
+        for (auto& kv : dias)
+            for (auto& x : kv.second.devueltos) r.emplace(x.id, x.grado);
+        return r;
+    }
+    // f(dia, const Dia&) para cada día con movimientos en [desde, hasta], en orden
+    template <class F>
+    void recorrer(Fecha desde, Fecha hasta, F f) const {
+        for (auto it = dias.lower_bound(desde); it != dias.end() && it->first <= hasta; ++it) f(it->first, it->second);
+    }
+    // Lo mismo desde `desde` hasta el final o hasta que f devuelva false
+    template <class F>
+    void recorrerDesde(Fecha desde, F f) const {
+        for (auto it = dias.lower_bound(desde); it != dias.end(); ++it) if (!f(it->first, it->second)) return;
+    }
+    // Activos al terminar el día anterior a `desde` (devuelto el día d = ya no activo ese día)
+    int64_t activosAntesDe(Fecha desde) const {
+        int64_t n = totalAbiertos - totalDevueltos;
+        for (auto it = dias.lower_bound(desde); it != dias.end(); ++it)
+            n -= int64_t(it->second.abiertos.size()) - int64_t(it->second.devueltos.size());
+        return n;
+    }
+    // Estimación: nodos del mapa de días y sus listas
+    size_t bytes() const {
+        size_t b = dias.size() * (sizeof(pair<const Fecha, Dia>) + 4 * sizeof(void*));
+        for (auto& kv : dias) {
+            const Dia& d = kv.second;
+            b += d.abiertos.capacity() * sizeof(int) + d.devueltos.capacity() * sizeof(Devuelto) + d.porGrado.capacity() * sizeof(TotalGrado);
+        }
+        return b;
+    }
+
+    template <class T, class Clave>
+    static auto ordenados(const vector<T>& v, Clave clave) {
+        vector<decltype(clave(v[0]))> r;
+        for (auto& x : v) r.push_back(clave(x));
+        sort(r.begin(), r.end());
+        return r;
+    }
+    // Mismos préstamos en los mismos días con los mismos totales (el orden dentro de un día no importa)
+    bool operator==(const CalendarioPrestamos& o) const {
+        if (dias.size() != o.dias.size() || totalAbiertos != o.totalAbiertos || totalDevueltos != o.totalDevueltos) return false;
+        for (auto a = dias.begin(), b = o.dias.begin(); a != dias.end(); ++a, ++b) {
+            if (a->first != b->first || a->second.diasDevueltos != b->second.diasDevueltos ||
+                ordenados(a->second.abiertos, [](int x) { return x; }) != ordenados(b->second.abiertos, [](int x) { return x; }) ||
+                ordenados(a->second.devueltos, [](const Devuelto& x) { return make_pair(x.id, x.grado); }) !=
+                    ordenados(b->second.devueltos, [](const Devuelto& x) { return make_pair(x.id, x.grado); }) ||
+                ordenados(a->second.porGrado, [](const TotalGrado& x) { return make_tuple(x.grado, x.devueltos, x.dias); }) !=
+                    ordenados(b->second.porGrado, [](const TotalGrado& x) { return make_tuple(x.grado, x.devueltos, x.dias); }))
+                return false;
+        }
+        return true;
+    }
+    bool operator!=(const CalendarioPrestamos& o) const { return !(*this == o); }
+
+private:
+    map<Fecha, Dia> dias;  // Solo días con movimientos
+    int64_t totalAbiertos = 0, totalDevueltos = 0;
+
+    static void sumar(Dia& d, uint32_t grado, int64_t dias, int signo) {
+        d.diasDevueltos += signo * dias;
+        auto g = find_if(d.porGrado.begin(), d.porGrado.end(), [grado](const TotalGrado& x) { return x.grado == grado; });
+        if (g == d.porGrado.end()) g = d.porGrado.insert(d.porGrado.end(), TotalGrado{grado, 0, 0});
+        g->devueltos += signo;
+        g->dias += signo * dias;
+        if (g->devueltos == 0) d.porGrado.erase(g);
+    }
+    void soltarSiVacio(map<Fecha, Dia>::iterator it) {
+        if (it->second.abiertos.empty() && it->second.devueltos.empty()) dias.erase(it);
+    }
+};
+
+// Estimación de una tabla hash de nodos: cada nodo lleva el par y dos punteros (siguiente y
+// hash guardado, según la implementación), más un puntero por cubeta
+template <class M>
+size_t bytesTablaHash(const M& m) {
+    return m.size() * (sizeof(typename M::value_type) + 2 * sizeof(void*)) + m.bucket_count() * sizeof(void*);
+}
+
+// Arena de texto: copia las cadenas seguidas en bloques grandes que nunca se mueven, así las vistas
+// de las filas siguen valiendo mientras viva el pool (también si se mueve). Lo que un update o un
+// borrado deja de usar queda como texto muerto hasta que DB::rearmarTextos copia lo vivo a otro.
+class PoolCadenas {
+public:
+    string_view guardar(string_view s) {
+        if (s.empty()) return {};
+        usados += s.size();
+        if (s.size() > BLOQUE / 8) return copiar(nuevoBloque(s.size()), s);  // Grande: bloque propio
+        if (s.size() > libre) {
+            actual = nuevoBloque(BLOQUE);
+            libre = BLOQUE;
+        }
+        string_view r = copiar(actual, s);
+        actual += s.size();
+        libre -= s.size();
+        return r;
+    }
+
+    // Se queda con los bloques de otro pool sin copiarlos: sus vistas siguen siendo válidas
+    void absorber(PoolCadenas&& otro) {
+        for (auto& b : otro.bloques) bloques.push_back(move(b));
+        reservados += otro.reservados;
+        usados += otro.usados;
+        otro = PoolCadenas();
+    }
+
+    size_t bytesReservados() const { return reservados; }
+    size_t bytesUsados() const { return usados; }
+
+private:
+    static constexpr size_t BLOQUE = 64 << 10;
+    vector<unique_ptr<char[]>> bloques;
+    char* actual = nullptr;
+    size_t libre = 0;
+    size_t reservados = 0, usados = 0;
+
+    char* nuevoBloque(size_t n) {
+        bloques.emplace_back(new char[n]);
+        reservados += n;
+        return bloques.back().get();
+    }
+    static string_view copiar(char* destino, string_view s) {
+        memcpy(destino, s.data(), s.size());
+        return string_view(destino, s.size());
+    }
+};
+
+// Diccionario de textos repetidos: cada valor distinto se guarda una vez y las filas llevan su id
+class Diccionario {
+public:
+    Diccionario() {
+        valores.push_back({});
+        ids.emplace(string_view(), TEXTO_VACIO);
+    }
+
+    uint32_t id(string_view s) {
+        auto it = ids.find(s);
+        if (it != ids.end()) return it->second;
+        uint32_t n = static_cast<uint32_t>(valores.size());
+        string_view g = pool.guardar(s);
+        valores.push_back(g);
+        ids.emplace(g, n);
+        return n;
+    }
+    string_view texto(uint32_t id) const { return valores[id]; }
+    size_t size() const { return valores.size(); }
+
+    // Añade los valores de otro diccionario; devuelve la traducción id de allí -> id de aquí
+    vector<uint32_t> unir(const Diccionario& otro) {
+        vector<uint32_t> mapa(otro.valores.size());
+        for (size_t i = 0; i < mapa.size(); i++) mapa[i] = id(otro.valores[i]);
+        return mapa;
+    }
+
+    // Estimación: texto + vector + nodos y cubetas de la tabla hash
+    size_t bytes() const {
+        return pool.bytesReservados() + valores.capacity() * sizeof(string_view) +
+               ids.size() * (sizeof(pair<const string_view, uint32_t>) + 2 * sizeof(void*)) +
+               ids.bucket_count() * sizeof(void*);
+    }
+
+private:
+    PoolCadenas pool;
+    vector<string_view> valores;
+    unordered_map<string_view, uint32_t> ids;
+};
+
+
+// Texto de búsqueda: minúsculas, sin tildes (UTF-8 latino) y todo lo que no es letra ni dígito
+// como un solo espacio: "El Señor de los  Anillos!" -> "el senor de los anillos"
+inline string normalizarTexto(string_view s) {
+    // Segundo byte de las letras latinas con tilde (0xC3 0x80..0xBF) -> letra base
+    static const char BASE[] = "aaaaaaaceeeeiiiidnooooo ouuuuyts"
+                               "aaaaaaaceeeeiiiidnooooo ouuuuyty";
+    string r;
+    r.reserve(s.size());
+    auto espacio = [&r] { if (!r.empty() && r.back() != ' ') r += ' '; };
+    for (size_t i = 0; i < s.size(); i++) {
+        unsigned char c = static_cast<unsigned char>(s[i]);
+        if (c == 0xC3 && i + 1 < s.size() && (static_cast<unsigned char>(s[i + 1]) & 0xC0) == 0x80) {
+            char b = BASE[static_cast<unsigned char>(s[++i]) - 0x80];
+            if (b == ' ') espacio();
+            else r += b;
+        } else if (c >= 0x80) {
+            r += char(c);  // Otras letras UTF-8 se comparan tal cual
+        } else if (isalnum(c)) {
+            r += char(tolower(c));
+        } else {
+            espacio();
+        }
+    }
+    if (!r.empty() && r.back() == ' ') r.pop_back();
+    return r;
+}
+
+// Índice de búsqueda sobre un texto por id (título de libro, nombre de autor), ya normalizado:
+// hash para la coincidencia exacta, orden para los prefijos y trigramas -> documentos para
+// subcadenas y textos parecidos (errores de tipeo). Cada búsqueda revisa a lo más PRESUPUESTO
+// entradas de las listas de trigramas, así que una consulta muy común sobre millones de textos
+// devuelve los mejores de un subconjunto en vez de recorrerlos todos.
+// Quitar solo marca el slot como muerto (las listas y el orden lo siguen teniendo y la búsqueda
+// lo salta); cuando los muertos pasan a los vivos se rearma el índice con lo vivo.
+class IndiceTexto {
+public:
+    struct Resultado {
+        int id;
+        int puntaje;  // EXACTA > PREFIJO > SUBCADENA (+50 al inicio de palabra) > PARECIDA
+    };
+    static constexpr int EXACTA = 1000, PREFIJO = 800, SUBCADENA = 600, PARECIDA = 400;
+
+    // Desde cero con el campo de texto de cada fila (ids repetidos: queda el primero); el orden
+    // de prefijos se arma con un solo sort al final
+    template <class T>
+    void construir(const vector<T>& filas, string_view T::*campo, const Lapidas& borradas = Lapidas()) {
+        *this = IndiceTexto();
+        slotDe.reserve(filas.size());
+        exactos.reserve(filas.size());
+        borradas.recorrerVivas(filas.size(), [&](size_t i) {
+            if (!slotDe.count(filas[i].id)) alta(filas[i].id, filas[i].*campo);
+        });
+        vector<uint32_t> g;
+        for (uint32_t s = 0; s < texto.size(); s++) {
+            trigramas(texto[s], g);
+            for (uint32_t x : g) gramas[x].push_back(s);
+        }
+        orden.resize(texto.size());
+        for (uint32_t s = 0; s < orden.size(); s++) orden[s] = s;
+        sort(orden.begin(), orden.end(), [this](uint32_t a, uint32_t b) { return antes(a, b); });
+    }
+
+    // Agregar un id que ya está reemplaza su texto
+    void agregar(int id, string_view t) {
+        quitar(id);
+        uint32_t s = alta(id, t);
+        vector<uint32_t> g;
+        trigramas(texto[s], g);
+        for (uint32_t x : g) gramas[x].push_back(s);
+        recientes.push_back(s);
+        if (recientes.size() >= MAX_RECIENTES) ordenarRecientes();
+    }
+
+    void quitar(int id) {
+        auto it = slotDe.find(id);
+        if (it == slotDe.end()) return;
+        uint32_t s = it->second;
+        for (auto e = exactos.equal_range(texto[s]); e.first != e.second; ++e.first) {
+            if (e.first->second == s) {
+                exactos.erase(e.first);
+                break;
+            }
+        }
+        slotDe.erase(it);
+        vivo[s] = 0;
+        if (texto.size() - slotDe.size() > max<size_t>(MIN_MUERTOS, slotDe.size())) compactar();
+    }
+
+    size_t size() const { return slotDe.size(); }
+    size_t bytes() const {
+        size_t b = pool.bytesReservados() + texto.capacity() * sizeof(string_view) + idDe.capacity() * sizeof(int) + vivo.capacity() +
+                   bytesTablaHash(slotDe) + bytesTablaHash(exactos) + (orden.capacity() + recientes.capacity()) * sizeof(uint32_t) +
+                   bytesTablaHash(gramas);
+        for (auto& kv : gramas) b += kv.second.capacity() * sizeof(uint32_t);
+        return b;
+    }
+
+    // Los max mejores: puntaje, luego texto más corto (más parecido a la consulta), luego id
+    vector<Resultado> buscar(string_view consulta, size_t max) const {
+        vector<Resultado> res;
+        string q = normalizarTexto(consulta);
+        if (q.empty() || max == 0) return res;
+        vector<int> puntos(texto.size(), 0);  // Por slot; 0 = no encontrado
+        vector<uint32_t> hallados;
+        size_t buenos = 0;  // Subcadenas o mejores: las parecidas no pueden superarlas
+        auto anotar = [&](uint32_t s, int p) {
+            if (puntos[s] == 0) hallados.push_back(s);
+            if (puntos[s] < SUBCADENA && p >= SUBCADENA) buenos++;
+            puntos[s] = std::max(puntos[s], p);
+        };
+        for (auto e = exactos.equal_range(q); e.first != e.second; ++e.first) anotar(e.first->second, EXACTA);
+
+        // Los textos que empiezan por q están seguidos en el orden; los recientes, uno por uno
+        auto empieza = [&](uint32_t s) { return vivo[s] && texto[s].substr(0, q.size()) == q; };
+        auto o = lower_bound(orden.begin(), orden.end(), string_view(q),
+                             [this](uint32_t s, string_view v) { return texto[s] < v; });
+        for (size_t vistos = 0; o != orden.end() && vistos < MAX_PREFIJOS && texto[*o].substr(0, q.size()) == q; ++o)
+            if (vivo[*o]) anotar(*o, PREFIJO), vistos++;
+        for (uint32_t s : recientes) if (empieza(s)) anotar(s, PREFIJO);
+
+        // Si tiene al menos m de los k trigramas de la consulta, un texto está en alguna de las
+        // k - m + 1 listas más cortas (las que no existen cuentan como vacías). La primera basta
+        // para las subcadenas; las demás solo hacen falta si todavía faltan resultados.
+        vector<uint32_t> gq;
+        trigramas(q, gq);
+        if (gq.size() > 64) gq.resize(64);  // Consultas largas: con 64 trigramas basta para puntuar
+        size_t k = gq.size(), m = size_t(ceil(double(k) * MIN_PARECIDO));
+        vector<const vector<uint32_t>*> listas;
+        for (uint32_t x : gq) {
+            auto it = gramas.find(x);
+            if (it != gramas.end()) listas.push_back(&it->second);
+        }
+        sort(listas.begin(), listas.end(), [](auto* a, auto* b) { return a->size() < b->size(); });
+        size_t revisar = k - m + 1, faltan = k - listas.size();
+        revisar = revisar > faltan ? revisar - faltan : 0;
+        vector<uint8_t> visto(texto.size(), 0);
+        size_t gastado = 0;
+        for (size_t j = 0; j < listas.size() && j < revisar && gastado < PRESUPUESTO; j++) {
+            if (j > 0 && buenos >= max) break;
+            const vector<uint32_t>& l = *listas[j];
+            size_t n = min(l.size(), PRESUPUESTO - gastado);
+            gastado += n;
+            for (size_t i = 0; i < n; i++) {
+                uint32_t s = l[i];
+                if (visto[s] || !vivo[s]) continue;
+                visto[s] = 1;
+                string_view t = texto[s];
+                size_t pos = t.find(q);
+                if (pos != string_view::npos) {
+                    // Pasado el tope de MAX_PREFIJOS, un prefijo también aparece aquí
+                    anotar(s, pos == 0 ? PREFIJO : SUBCADENA + (t[pos - 1] == ' ' ? 50 : 0));
+                } else {
+                    double parecido = double(comunes(t, gq)) / double(k);
+                    if (parecido >= MIN_PARECIDO) anotar(s, int(PARECIDA * parecido));
+                }
+            }
+        }
+
+        res.reserve(hallados.size());
+        for (uint32_t s : hallados) res.push_back({int(s), puntos[s]});
+        auto mejor = [this](const Resultado& a, const Resultado& b) {
+            if (a.puntaje != b.puntaje) return a.puntaje > b.puntaje;
+            size_t la = texto[size_t(a.id)].size(), lb = texto[size_t(b.id)].size();
+            return la != lb ? la < lb : idDe[size_t(a.id)] < idDe[size_t(b.id)];
+        };
+        size_t n = min(max, res.size());
+        partial_sort(res.begin(), res.begin() + static_cast<ptrdiff_t>(n), res.end(), mejor);
+        res.resize(n);
+        for (auto& r : res) r.id = idDe[size_t(r.id)];  // slot -> id
+        return res;
+    }
+
+private:
+    static constexpr size_t MAX_PREFIJOS = 1000;     // Textos revisados por prefijo
+    static constexpr size_t MAX_RECIENTES = 1024;    // Altas sin ordenar antes de mezclarlas en orden
+    static constexpr size_t PRESUPUESTO = 20000;     // Entradas de listas de trigramas por búsqueda
+    static constexpr size_t MIN_MUERTOS = 4096;      // Con menos no vale la pena rearmar
+    static constexpr double MIN_PARECIDO = 0.6;  // Fracción de trigramas de la consulta presentes
+
+    // Cada texto ocupa un slot (posición densa; un reemplazo usa uno nuevo): las listas guardan
+    // slots y la búsqueda marca candidatos en vectores por slot en vez de tablas hash
+    PoolCadenas pool;                                  // Textos normalizados
+    vector<string_view> texto;                         // slot -> texto normalizado
+    vector<int> idDe;                                  // slot -> id
+    vector<uint8_t> vivo;                              // slot -> 0 si se quitó
+    unordered_map<int, uint32_t> slotDe;               // id -> slot
+    unordered_multimap<string_view, uint32_t> exactos; // texto normalizado -> slots
+    vector<uint32_t> orden;                            // slots por (texto, slot)
+    vector<uint32_t> recientes;                        // Altas que aún no están en orden
+    unordered_map<uint32_t, vector<uint32_t>> gramas;  // trigrama -> slots (sin orden)
+
+    uint32_t alta(int id, string_view t) {
+        uint32_t s = uint32_t(texto.size());
+        texto.push_back(pool.guardar(normalizarTexto(t)));
+        idDe.push_back(id);
+        vivo.push_back(1);
+        slotDe.emplace(id, s);
+        exactos.emplace(texto[s], s);
+        return s;
+    }
+
+    // Rearma con los slots vivos (el texto ya normalizado no cambia al normalizarlo otra vez)
+    void compactar() {
+        struct Vivo {
+            int id;
+            string_view texto;
+        };
+        vector<Vivo> vivos;
+        vivos.reserve(slotDe.size());
+        for (uint32_t s = 0; s < texto.size(); s++) if (vivo[s]) vivos.push_back({idDe[s], texto[s]});
+        IndiceTexto nuevo;
+        nuevo.construir(vivos, &Vivo::texto);  // Copia los textos a su pool antes de soltar este
+        *this = move(nuevo);
+    }
+
+    bool antes(uint32_t a, uint32_t b) const {
+        int c = texto[a].compare(texto[b]);
+        return c != 0 ? c < 0 : a < b;
+    }
+    void ordenarRecientes() {
+        auto cmp = [this](uint32_t a, uint32_t b) { return antes(a, b); };
+        sort(recientes.begin(), recientes.end(), cmp);
+        size_t medio = orden.size();
+        orden.insert(orden.end(), recientes.begin(), recientes.end());
+        inplace_merge(orden.begin(), orden.begin() + static_cast<ptrdiff_t>(medio), orden.end(), cmp);
+        recientes.clear();
+    }
+
+    // Trigramas distintos del texto, tres bytes por entero
+    static uint32_t trigrama(string_view t, size_t i) {
+        return uint32_t(uint8_t(t[i])) << 16 | uint32_t(uint8_t(t[i + 1])) << 8 | uint8_t(t[i + 2]);
+    }
+    static void trigramas(string_view t, vector<uint32_t>& g) {
+        g.clear();
+        for (size_t i = 0; i + 3 <= t.size(); i++) g.push_back(trigrama(t, i));
+        sort(g.begin(), g.end());
+        g.erase(unique(g.begin(), g.end()), g.end());
+    }
+    // Cuántos de los trigramas gq (ordenados, distintos; a lo más 64) aparecen en t
+    static size_t comunes(string_view t, const vector<uint32_t>& gq) {
+        uint64_t esta = 0;
+        for (size_t i = 0; i + 3 <= t.size(); i++) {
+            uint32_t g = trigrama(t, i);
+            auto it = lower_bound(gq.begin(), gq.end(), g);
+            if (it != gq.end() && *it == g) esta |= uint64_t(1) << (it - gq.begin());
+        }
+        return bitset<64>(esta).count();
+    }
+};
+
+// Archivo de solo lectura completo en memoria: mmap en POSIX, lectura en bloques grandes en el resto.
+class ArchivoMapeado {
+public:
+    explicit ArchivoMapeado(const string& path) {
+#ifdef BIBLIOTECADB_POSIX
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) == 0) {
+            abierto = true;
+            tam = static_cast<size_t>(st.st_size);
+            if (tam > 0) {
+                void* m = mmap(nullptr, tam, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (m != MAP_FAILED) {
+                    madvise(m, tam, MADV_SEQUENTIAL);
+                    datos = static_cast<const char*>(m);
+                    mapeado = true;
+                } else {
+                    abierto = false;
+                }
+            }
+        }
+        close(fd);
+        if (abierto || mapeado) return;
+#endif
+        FILE* f = fopen(path.c_str(), "rb");
+        if (!f) return;
+        const size_t BLOQUE = 1 << 20;
+        size_t n;
+        do {
+            size_t usado = buffer.size();
+            buffer.resize(usado + BLOQUE);
+            n = fread(buffer.data() + usado, 1, BLOQUE, f);
+            buffer.resize(usado + n);
+        } while (n == BLOQUE);
+        fclose(f);
+        abierto = true;
+        datos = buffer.data();
+        tam = buffer.size();
+    }
+    ~ArchivoMapeado() {
+#ifdef BIBLIOTECADB_POSIX
+        if (mapeado) munmap(const_cast<char*>(datos), tam);
+#endif
+    }
+    ArchivoMapeado(const ArchivoMapeado&) = delete;
+    ArchivoMapeado& operator=(const ArchivoMapeado&) = delete;
+
+    bool ok() const { return abierto; }
+    string_view texto() const { return string_view(datos, tam); }
+
+private:
+    const char* datos = nullptr;
+    size_t tam = 0;
+    bool abierto = false;
+    bool mapeado = false;
+    vector<char> buffer;
+};
+
+// Añade s a out escapado para CSV: entre comillas y con " -> "" si lleva comas o comillas
+inline void escCSV(string_view s, string& out) {
+    if (s.find_first_of(",\"") == string_view::npos) {
+        out += s;
+        return;
+    }
+    out.push_back('"');
+    for (char c : s) {
+        if (c == '"') out.push_back('"');
+        out.push_back(c);
+    }
+    out.push_back('"');
+}
+
+// Escribe un CSV en path.tmp formateando en un buffer grande (sin operator<< por campo) y
+// lo renombra sobre path solo si todo fue bien: un fallo a medias deja intacto el archivo anterior.
+class EscritorCSV {
+public:
+    EscritorCSV(const string& ruta, string_view header) : path(ruta), tmp(ruta + ".tmp"), f(fopen(tmp.c_str(), "wb")) {
+        buf.reserve(BLOQUE + 4096);
+        buf += header;
+    }
+    ~EscritorCSV() {
+        if (f) {  // Sin cerrar(): se descarta
+            fclose(f);
+            remove(tmp.c_str());
+        }
+    }
+    EscritorCSV(const EscritorCSV&) = delete;
+    EscritorCSV& operator=(const EscritorCSV&) = delete;
+
+    void entero(int v) {
+        char num[16];
+        auto r = to_chars(num, num + sizeof num, v);
+        buf.append(num, r.ptr);
+    }
+    void texto(string_view s) { escCSV(s, buf); }
+    void fecha(Fecha f) {
+        char t[10];
+        buf.append(t, escribirFecha(f, t));
+    }
+    void coma() { buf.push_back(','); }
+    void finFila() {
+        buf.push_back('\n');
+        if (buf.size() >= BLOQUE) volcar();
+    }
+
+    // Vuelca, hace durable y renombra; false (y path sin tocar) ante cualquier error
+    bool cerrar() {
+        if (!f) return false;
+        volcar();
+        if (fflush(f) != 0) error = true;
+#ifdef BIBLIOTECADB_POSIX
+        if (fsync(fileno(f)) != 0) error = true;
+#endif
+        if (fclose(f) != 0) error = true;
+        f = nullptr;
+        if (error || rename(tmp.c_str(), path.c_str()) != 0) {
+            remove(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static constexpr size_t BLOQUE = 1 << 20;
+    string path, tmp;
+    FILE* f;
+    string buf;  // Se reutiliza entre volcados: una sola reserva por archivo
+    bool error = false;
+
+    void volcar() {
+        if (f && !buf.empty() && fwrite(buf.data(), 1, buf.size(), f) != buf.size()) error = true;
+        buf.clear();
+    }
+};
+
+// Salida de los listados a un FILE* (stdout, un archivo o un pipe): formatea en un buffer grande y
+// lo escribe por bloques, sin operator<< de iostream ni flush por fila. Con stdout vacía antes cout
+// para no desordenar lo que ya estaba escrito, y al terminar hace fflush.
+class SalidaListado {
+public:
+    explicit SalidaListado(FILE* f) : f(f) {
+        if (f == stdout) cout.flush();
+        buf.reserve(BLOQUE + 4096);
+    }
+    ~SalidaListado() { cerrar(); }
+    SalidaListado(const SalidaListado&) = delete;
+    SalidaListado& operator=(const SalidaListado&) = delete;
+
+    SalidaListado& operator<<(string_view s) {
+        buf.append(s);
+        return *this;
+    }
+    SalidaListado& operator<<(const char* s) { return *this << string_view(s); }
+    SalidaListado& operator<<(char c) {
+        buf.push_back(c);
+        return *this;
+    }
+    SalidaListado& operator<<(int64_t v) {
+        char num[24];
+        auto r = to_chars(num, num + sizeof num, v);
+        buf.append(num, r.ptr);
+        return *this;
+    }
+    SalidaListado& operator<<(int v) { return *this << int64_t(v); }
+    SalidaListado& operator<<(size_t v) { return *this << int64_t(v); }
+    SalidaListado& fecha(Fecha d) {
+        char t[16];
+        buf.append(t, escribirFecha(d, t));
+        return *this;
+    }
+    // Fin de fila: si el bloque se llenó, va a la salida
+    void finFila() {
+        buf.push_back('\n');
+        if (buf.size() >= BLOQUE) volcar();
+    }
+    bool cerrar() {
+        volcar();
+        if (f && fflush(f) != 0) error = true;
+        return !error;
+    }
+
+private:
+    static constexpr size_t BLOQUE = 1 << 20;
+    FILE* f;
+    string buf;
+    bool error = false;
+
+    void volcar() {
+        if (f && !buf.empty() && fwrite(buf.data(), 1, buf.size(), f) != buf.size()) error = true;
+        buf.clear();
+    }
+};
+
+/*
+ * Snapshot binario columnar (data/biblioteca.snap), alternativa rápida a los CSV.
+ * Cabecera (magia, versión, filas por tabla, LSN del WAL incluido, checksum de cabecera y
+ * directorio) + directorio de secciones {offset, bytes, checksum}.
+ * Cada columna es una sección alineada a 8 bytes: enteros int32 de ancho fijo, o texto como
+ * offsets uint64 (filas+1) seguidos del heap de bytes. Orden de tablas y columnas fijo en código.
+ */
+struct CabeceraSnapshot {
+    char magia[8];
+    uint32_t version;
+    uint32_t nSecciones;
+    uint64_t filas[4];  // autores, libros, estudiantes, préstamos
+    uint64_t lsn;       // v2: último registro del WAL ya aplicado (v1 no lo tiene: 0)
+    uint64_t checksum;  // v4: de la cabecera (con este campo en 0) y el directorio
+};
+// v3: las fechas de préstamo son columnas enteras (nº de día); v1/v2 las traen como texto
+
+inline size_t tamCabeceraSnapshot(uint32_t version) {
+    return version == 1 ? offsetof(CabeceraSnapshot, lsn)
+           : version < 4 ? offsetof(CabeceraSnapshot, checksum)
+                         : sizeof(CabeceraSnapshot);
+}
+
+struct SeccionSnapshot {
+    uint64_t offset;
+    uint64_t bytes;
+    uint64_t checksum;
+};
+
+const char MAGIA_SNAPSHOT[8] = {'B', 'I', 'B', 'L', 'I', 'O', 'D', 'B'};
+const uint32_t VERSION_SNAPSHOT = 4;
+const uint32_t SECCIONES_SNAPSHOT = 22;  // 5 + 7 + 5 + 5 (cada texto = offsets + heap)
+const uint32_t PRIMERA_SECCION_SNAPSHOT[4] = {0, 5, 12, 17};  // La columna id de cada tabla (todas las versiones)
+
+inline uint32_t seccionesSnapshot(uint32_t version) {
+    return version < 3 ? 24 : SECCIONES_SNAPSHOT;  // Antes: 7 en préstamos (dos fechas de texto)
+}
+
+// FNV-1a sobre palabras de 8 bytes (más la cola), suficiente para detectar archivos dañados
+inline uint64_t checksum64(const char* p, size_t n) {
+    uint64_t h = 1469598103934665603ull;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        h = (h ^ w) * 1099511628211ull;
+    }
+    for (; i < n; i++) h = (h ^ static_cast<unsigned char>(p[i])) * 1099511628211ull;
+    return h;
+}
+
+// Cabecera (con su checksum en 0) seguida del directorio, como quedan en el archivo
+inline uint64_t checksumCabeceraSnapshot(CabeceraSnapshot cab, const vector<SeccionSnapshot>& dir) {
+    cab.checksum = 0;
+    string bytes(reinterpret_cast<const char*>(&cab), sizeof cab);
+    bytes.append(reinterpret_cast<const char*>(dir.data()), dir.size() * sizeof(SeccionSnapshot));
+    return checksum64(bytes.data(), bytes.size());
+}
+
+class EscritorSnapshot {
+public:
+    explicit EscritorSnapshot(const string& path) : f(fopen(path.c_str(), "wb")) {
+        if (!f) return;
+        setvbuf(f, nullptr, _IOFBF, 1 << 20);
+        CabeceraSnapshot vacia{};
+        vector<SeccionSnapshot> dir(SECCIONES_SNAPSHOT);
+        escribir(&vacia, sizeof vacia);  // Se reescriben al cerrar, ya con los checksums
+        escribir(dir.data(), dir.size() * sizeof(SeccionSnapshot));
+    }
+    ~EscritorSnapshot() { if (f) fclose(f); }
+
+    bool ok() const { return f && !error; }
+
+    void seccion(const void* datos, size_t bytes) {
+        static const char ceros[8] = {};
+        if (pos % 8) escribir(ceros, 8 - pos % 8);
+        secciones.push_back({pos, bytes, checksum64(static_cast<const char*>(datos), bytes)});
+        escribir(datos, bytes);
+    }
+
+    // Solo las filas vivas: una columna sin lápidas se escribe tal cual
+    void columnaEntera(const vector<int32_t>& col, const FilasVivas& vivas) {
+        if (vivas.sonTodas()) return seccion(col.data(), col.size() * sizeof(int32_t));
+        vector<int32_t> sel(vivas.size());
+        for (size_t k = 0; k < sel.size(); k++) sel[k] = col[vivas[k]];
+        seccion(sel.data(), sel.size() * sizeof(int32_t));
+    }
+    template <class T, class C>
+    void columnaEntera(const vector<T>& filas, C T::*campo, const FilasVivas& vivas) {
+        vector<int32_t> col(vivas.size());
+        for (size_t k = 0; k < col.size(); k++) col[k] = filas[vivas[k]].*campo;
+        seccion(col.data(), col.size() * sizeof(int32_t));
+    }
+
+    // Texto de la fila i dado por texto(i): secciones de offsets y heap
+    template <class F>
+    void columnaTexto(size_t n, F texto) {
+        vector<uint64_t> offs(n + 1);
+        string heap;
+        for (size_t i = 0; i < n; i++) {
+            offs[i] = heap.size();
+            heap += texto(i);
+        }
+        offs[n] = heap.size();
+        seccion(offs.data(), offs.size() * sizeof(uint64_t));
+        seccion(heap.data(), heap.size());
+    }
+    template <class T>
+    void columnaTexto(const vector<T>& filas, string_view T::*campo, const FilasVivas& vivas) {
+        columnaTexto(vivas.size(), [&](size_t k) { return filas[vivas[k]].*campo; });
+    }
+    // Columna de ids de diccionario: se guarda el texto, el archivo no depende de los ids
+    template <class T>
+    void columnaTexto(const vector<T>& filas, uint32_t T::*campo, const Diccionario& dicc, const FilasVivas& vivas) {
+        columnaTexto(vivas.size(), [&](size_t k) { return dicc.texto(filas[vivas[k]].*campo); });
+    }
+
+    // Escribe cabecera y directorio definitivos; false si hubo cualquier error de escritura
+    bool cerrar(const uint64_t filas[4], uint64_t lsn) {
+        if (!f) return false;
+        CabeceraSnapshot cab{};
+        memcpy(cab.magia, MAGIA_SNAPSHOT, sizeof cab.magia);
+        cab.version = VERSION_SNAPSHOT;
+        cab.nSecciones = static_cast<uint32_t>(secciones.size());
+        for (int t = 0; t < 4; t++) cab.filas[t] = filas[t];
+        cab.lsn = lsn;
+        cab.checksum = checksumCabeceraSnapshot(cab, secciones);
+        if (secciones.size() != SECCIONES_SNAPSHOT || fseek(f, 0, SEEK_SET) != 0) error = true;
+        escribir(&cab, sizeof cab);
+        escribir(secciones.data(), secciones.size() * sizeof(SeccionSnapshot));
+        if (fflush(f) != 0) error = true;
+#ifdef BIBLIOTECADB_POSIX
+        if (fsync(fileno(f)) != 0) error = true;  // Durable antes del rename
+#endif
+        bool res = !error && fclose(f) == 0;
+        f = nullptr;
+        return res;
+    }
+
+private:
+    FILE* f;
+    uint64_t pos = 0;
+    bool error = false;
+    vector<SeccionSnapshot> secciones;
+
+    void escribir(const void* p, size_t n) {
+        if (n && fwrite(p, 1, n, f) != n) error = true;
+        pos += n;
+    }
+};
+
+// Lee un snapshot mapeado: valida cabecera y checksums y entrega las secciones en orden
+class LectorSnapshot {
+public:
+    explicit LectorSnapshot(string_view datos) : txt(datos) {}
+
+    // false si el archivo no es un snapshot válido de esta versión (mensaje en error)
+    bool abrir(string& error) {
+        size_t tamMin = tamCabeceraSnapshot(1);
+        if (txt.size() < tamMin) { error = "archivo truncado"; return false; }
+        memcpy(&cab, txt.data(), tamMin);
+        if (memcmp(cab.magia, MAGIA_SNAPSHOT, sizeof cab.magia) != 0) { error = "no es un snapshot"; return false; }
+        if (cab.version < 1 || cab.version > VERSION_SNAPSHOT) { error = "version " + to_string(cab.version) + " no soportada"; return false; }
+        size_t tamCab = tamCabeceraSnapshot(cab.version);
+        if (txt.size() < tamCab) { error = "archivo truncado"; return false; }
+        memcpy(&cab, txt.data(), tamCab);
+        if (cab.nSecciones != seccionesSnapshot(cab.version) ||
+            txt.size() < tamCab + cab.nSecciones * sizeof(SeccionSnapshot)) { error = "directorio invalido"; return false; }
+        dir.resize(cab.nSecciones);
+        memcpy(dir.data(), txt.data() + tamCab, dir.size() * sizeof(SeccionSnapshot));
+        if (cab.version >= 4 && checksumCabeceraSnapshot(cab, dir) != cab.checksum) { error = "checksum incorrecto en la cabecera"; return false; }
+        // Las filas de la cabecera dimensionan la carga: tienen que cuadrar con la columna id
+        for (int t = 0; t < 4; t++) {
+            if (dir[PRIMERA_SECCION_SNAPSHOT[t]].bytes != cab.filas[t] * sizeof(int32_t) || cab.filas[t] > txt.size()) {
+                error = "filas de la cabecera no cuadran con las columnas";
+                return false;
+            }
         }
-        out.push_back(cur);
-        // Quitar comillas externas
-        for (auto& x : out) {
-            if (x.size() >= 2 && x.front() == '"' && x.back() == '"') {
-                x = x.substr(1, x.size() - 2);
+        for (size_t i = 0; i < dir.size(); i++) {
+            auto& s = dir[i];
+            if (s.offset > txt.size() || s.bytes > txt.size() - s.offset) { error = "seccion fuera del archivo"; return false; }
+            if (checksum64(txt.data() + s.offset, s.bytes) != s.checksum) {
+                error = "checksum incorrecto en seccion " + to_string(i);
+                return false;
             }
         }
-        return out;
+        return true;
+    }
+
+    uint64_t filas(int tabla) const { return cab.filas[tabla]; }
+    uint32_t version() const { return cab.version; }
+    uint64_t lsn() const { return cab.lsn; }
+
+    // Siguiente columna entera: n valores int32
+    const int32_t* columnaEntera(size_t n, bool& ok) {
+        string_view s = siguiente();
+        if (s.size() != n * sizeof(int32_t)) { ok = false; return nullptr; }
+        return reinterpret_cast<const int32_t*>(s.data());  // Alineada a 8 en el archivo y mmap
+    }
+
+    // Siguiente columna de texto: devuelve la fila i como string_view sobre el heap
+    struct ColumnaTexto {
+        const uint64_t* offs = nullptr;
+        string_view heap;
+        string_view operator[](size_t i) const { return heap.substr(offs[i], offs[i + 1] - offs[i]); }
+    };
+    ColumnaTexto columnaTexto(size_t n, bool& ok) {
+        ColumnaTexto c;
+        string_view o = siguiente();
+        c.heap = siguiente();
+        if (o.size() != (n + 1) * sizeof(uint64_t)) { ok = false; return c; }
+        c.offs = reinterpret_cast<const uint64_t*>(o.data());
+        for (size_t i = 0; i < n; i++) if (c.offs[i] > c.offs[i + 1]) ok = false;
+        if (c.offs[n] > c.heap.size()) ok = false;
+        return c;
+    }
+
+private:
+    string_view txt;
+    CabeceraSnapshot cab{};
+    vector<SeccionSnapshot> dir;
+    size_t sig = 0;
+
+    string_view siguiente() {
+        if (sig >= dir.size()) return {};
+        auto& s = dir[sig++];
+        return txt.substr(s.offset, s.bytes);
+    }
+};
+
+/*
+ * Write-ahead log (data/biblioteca.wal): cada add/update/delete/devolver con éxito se anota
+ * como un registro {largo u32, checksum u32, lsn u64, op u8, argumentos}. Los enteros van como
+ * int32 y los textos como largo u32 + bytes. Al arrancar se reaplican sobre el snapshot los
+ * registros con lsn mayor que el suyo; la cola dañada por un corte se descarta.
+ */
+enum class OpWAL : uint8_t {
+    AddAutor = 1, UpdAutor, DelAutor,
+    AddLibro, UpdLibro, DelLibro,
+    AddEstudiante, UpdEstudiante, DelEstudiante,
+    AddPrestamo, DevPrestamo, DelPrestamo,
+    AddPrestamoDia, DevPrestamoDia,  // Fechas como nº de día; AddPrestamo/DevPrestamo (logs viejos) las traen en texto
+    Lote,  // Importación en bloque: nº de filas + filas (AddAutor/AddLibro/AddEstudiante/AddPrestamoDia)
+};
+
+const size_t CABECERA_REGISTRO_WAL = 16;  // largo + checksum + lsn
+
+// Lee los argumentos de un registro en el mismo orden en que se anotaron
+class LectorRegistroWAL {
+public:
+    explicit LectorRegistroWAL(string_view datos) : resto(datos) {}
+    bool ok() const { return bien; }
+    int entero() {
+        int32_t v = 0;
+        if (resto.size() < 4) { bien = false; return 0; }
+        memcpy(&v, resto.data(), 4);
+        resto.remove_prefix(4);
+        return v;
+    }
+    string_view texto() {  // Vista sobre el registro: vale mientras se aplica
+        uint32_t n = static_cast<uint32_t>(entero());
+        if (!bien || resto.size() < n) { bien = false; return {}; }
+        string_view r = resto.substr(0, n);
+        resto.remove_prefix(n);
+        return r;
+    }
+
+private:
+    string_view resto;
+    bool bien = true;
+};
+
+// Mensaje con el mismo formato que los argumentos de un registro (protocolo del modo servidor):
+// largo (uint32, sin contarse) + cuerpo de bytes, enteros int32 y textos con su largo delante
+class EscritorMensaje {
+public:
+    EscritorMensaje() : datos(4, '\0') {}
+    EscritorMensaje& byte(uint8_t b) {
+        datos.push_back(static_cast<char>(b));
+        return *this;
+    }
+    EscritorMensaje& entero(int v) {
+        int32_t x = v;
+        datos.append(reinterpret_cast<const char*>(&x), 4);
+        return *this;
+    }
+    EscritorMensaje& texto(string_view t) {
+        entero(static_cast<int>(t.size()));
+        datos += t;
+        return *this;
+    }
+    // Para completar después un entero ya escrito (p. ej. un conteo que se conoce al final)
+    size_t posicion() const { return datos.size(); }
+    void fijarEntero(size_t pos, int v) {
+        int32_t x = v;
+        memcpy(&datos[pos], &x, 4);
+    }
+    string cerrar() {
+        uint32_t n = static_cast<uint32_t>(datos.size() - 4);
+        memcpy(&datos[0], &n, 4);
+        return move(datos);
+    }
+
+private:
+    string datos;
+};
+
+// Group commit: anotar() solo copia al buffer; un hilo lo escribe entero cada grupoMs
+// (una escritura por grupo) y hace fsync según fsyncMs. sincronizar() fuerza ambas cosas.
+// Si un write, flush o fsync falla, al WAL le falta algo: desde ahí sincronizar() da false
+// hasta que se vuelve a abrir, para que guardar no informe como durable lo que no lo es.
+struct ConfigWAL {
+    int grupoMs = 5;                      // Ventana de agrupación de registros
+    int fsyncMs = 0;                      // 0: fsync por grupo; >0: como mucho cada fsyncMs; <0: nunca
+    uint64_t compactarBytes = 64u << 20;  // Tamaño del WAL que dispara un snapshot nuevo
+};
+
+class RegistroWAL {
+public:
+    ~RegistroWAL() { cerrar(); }
+
+    bool abrir(const string& ruta, uint64_t ultimoLsn, const ConfigWAL& c) {
+        cerrar();
+        path = ruta;
+        cfg = c;
+        f = fopen(path.c_str(), "ab");
+        if (!f) return false;
+        lsn = ultimoLsn;
+        bytesArchivo = static_cast<uint64_t>(ftell(f));
+        parar = false;
+        fallo = false;
+        ultimoFsync = chrono::steady_clock::now();
+        hilo = thread([this] { bucleGrupos(); });
+        return true;
+    }
+
+    void cerrar() {
+        if (hilo.joinable()) {
+            {
+                lock_guard<mutex> l(m);
+                parar = true;
+            }
+            cv.notify_all();
+            hilo.join();
+        }
+        if (!f) return;
+        sincronizar();
+        fclose(f);
+        f = nullptr;
+    }
+
+    bool activo() const { return f != nullptr; }
+    uint64_t ultimoLsn() {
+        lock_guard<mutex> l(m);
+        return lsn;
+    }
+    uint64_t bytes() {
+        lock_guard<mutex> l(m);
+        return bytesArchivo + pendiente.size();
+    }
+
+    template <class... Args>
+    void anotar(OpWAL op, const Args&... args) {
+        if (!f) return;
+        lock_guard<mutex> l(m);
+        size_t ini = pendiente.size();
+        pendiente.append(CABECERA_REGISTRO_WAL, '\0');
+        pendiente.push_back(static_cast<char>(op));
+        (poner(args), ...);
+        uint32_t largo = static_cast<uint32_t>(pendiente.size() - ini - CABECERA_REGISTRO_WAL);
+        uint64_t n = ++lsn;
+        memcpy(&pendiente[ini], &largo, 4);
+        memcpy(&pendiente[ini + 8], &n, 8);
+        uint32_t suma = static_cast<uint32_t>(checksum64(&pendiente[ini + 8], largo + 8));
+        memcpy(&pendiente[ini + 4], &suma, 4);
+        if (pendiente.size() > (1u << 20)) cv.notify_one();  // No esperar a la ventana con ráfagas grandes
+    }
+
+    // Escribe todo lo anotado y lo hace durable (salida, rotación, antes de compactar).
+    // false si esto o una escritura anterior no llegó al disco.
+    bool sincronizar() {
+        if (!f) return true;
+        lock_guard<mutex> io(mio);
+        return volcar(true);
+    }
+
+    // Cierra el archivo actual renombrándolo a destino y sigue en uno vacío (mismo lsn).
+    // El vacío se abre antes de tocar el actual: si algo falla se deshace y se sigue escribiendo
+    // en el de siempre. false (sin rotar) también si lo pendiente no llegó al disco.
+    bool rotar(const string& destino) {
+        if (!f) return false;
+        lock_guard<mutex> io(mio);
+        if (!volcar(true)) return false;
+        string tmp = path + ".nuevo";
+        FILE* nuevo = fopen(tmp.c_str(), "wb");
+        if (!nuevo) return false;
+        bool ok = rename(path.c_str(), destino.c_str()) == 0;
+        if (ok && rename(tmp.c_str(), path.c_str()) != 0) {
+            ok = false;
+            // Sin archivo en path los registros siguientes no se encontrarían al arrancar
+            if (rename(destino.c_str(), path.c_str()) != 0) {
+                cerr << "Error: no se pudo devolver el WAL a " << path << "\n";
+                fallo = true;
+            }
+        }
+        if (!ok) {
+            fclose(nuevo);
+            remove(tmp.c_str());
+            return false;
+        }
+        fclose(f);  // Ya volcado y con fsync
+        f = nuevo;
+        lock_guard<mutex> l(m);
+        bytesArchivo = 0;
+        return true;
+    }
+
+    // Reaplica en db los registros de ruta con lsn > desde; devuelve el último lsn visto.
+    // Si cortarCola, trunca el archivo en el primer registro incompleto o dañado.
+    template <class Aplicar>
+    static uint64_t reproducir(const string& ruta, uint64_t desde, bool cortarCola, Aplicar aplicar, size_t& aplicados) {
+        uint64_t ultimo = desde;
+        size_t valido = 0;
+        {
+            ArchivoMapeado a(ruta);
+            if (!a.ok()) return ultimo;
+            string_view txt = a.texto();
+            while (txt.size() - valido >= CABECERA_REGISTRO_WAL) {
+                const char* r = txt.data() + valido;
+                uint32_t largo, suma;
+                uint64_t n;
+                memcpy(&largo, r, 4);
+                memcpy(&suma, r + 4, 4);
+                memcpy(&n, r + 8, 8);
+                if (largo == 0 || largo > txt.size() - valido - CABECERA_REGISTRO_WAL) break;
+                if (static_cast<uint32_t>(checksum64(r + 8, largo + 8)) != suma) break;
+                if (n > ultimo) {
+                    aplicar(static_cast<OpWAL>(r[CABECERA_REGISTRO_WAL]),
+                            LectorRegistroWAL(string_view(r + CABECERA_REGISTRO_WAL + 1, largo - 1)));
+                    aplicados++;
+                    ultimo = n;
+                }
+                valido += CABECERA_REGISTRO_WAL + largo;
+            }
+            if (!cortarCola || valido == txt.size()) return ultimo;
+        }
+        cerr << "Aviso: WAL " << ruta << " con cola incompleta; se descarta desde el byte " << valido << "\n";
+        error_code ec;
+        filesystem::resize_file(ruta, valido, ec);
+        return ultimo;
+    }
+
+private:
+    FILE* f = nullptr;
+    string path;
+    ConfigWAL cfg;
+    mutex m;    // pendiente, lsn, bytesArchivo, parar
+    mutex mio;  // escrituras al archivo (hilo de grupos, sincronizar, rotar)
+    condition_variable cv;
+    string pendiente;
+    uint64_t lsn = 0;
+    uint64_t bytesArchivo = 0;
+    bool parar = false;
+    bool sucio = false;  // Escrito pero sin fsync
+    bool fallo = false;  // Algún grupo no llegó al disco (ver sincronizar)
+    thread hilo;
+    chrono::steady_clock::time_point ultimoFsync;
+
+    void poner(int v) {
+        int32_t x = v;
+        pendiente.append(reinterpret_cast<const char*>(&x), 4);
+    }
+    void poner(string_view t) {
+        poner(static_cast<int>(t.size()));
+        pendiente += t;
+    }
+
+    // Con mio tomado: escribe el buffer en una sola llamada y aplica la política de fsync.
+    // false si falló esta escritura o alguna anterior.
+    bool volcar(bool forzarFsync) {
+        string grupo;
+        {
+            lock_guard<mutex> l(m);
+            grupo.swap(pendiente);
+            bytesArchivo += grupo.size();
+        }
+        if (!grupo.empty()) {
+            if (fwrite(grupo.data(), 1, grupo.size(), f) != grupo.size() || fflush(f) != 0) {
+                if (!fallo) cerr << "Error: no se pudo escribir el WAL " << path << "\n";
+                fallo = true;
+            }
+            sucio = true;
+        }
+        auto ahora = chrono::steady_clock::now();
+        bool toca = forzarFsync || cfg.fsyncMs == 0 ||
+                    (cfg.fsyncMs > 0 && ahora - ultimoFsync >= chrono::milliseconds(cfg.fsyncMs));
+        if (sucio && toca) {
+#ifdef BIBLIOTECADB_POSIX
+            if (fsync(fileno(f)) != 0) {
+                if (!fallo) cerr << "Error: fsync del WAL " << path << " falló\n";
+                fallo = true;
+            }
+#endif
+            sucio = false;
+            ultimoFsync = ahora;
+        }
+        return !fallo;
+    }
+
+    void bucleGrupos() {
+        unique_lock<mutex> l(m);
+        while (!parar) {
+            cv.wait_for(l, chrono::milliseconds(cfg.grupoMs));
+            if (pendiente.empty() && cfg.fsyncMs <= 0) continue;
+            l.unlock();
+            {
+                lock_guard<mutex> io(mio);
+                volcar(false);
+            }
+            l.lock();
+        }
+    }
+};
+
+/*
+ * Instrumentación de DB: por cada operación medida, llamadas, fallidas (las que devolvieron false)
+ * y un histograma de latencia en cubetas de potencias de 2 tics. Cada hilo escribe solo en sus
+ * contadores (atómicos relajados: un store sin lock ni líneas de caché compartidas) y leer() suma
+ * todos los hilos vivos más lo que dejaron los que ya terminaron.
+ * Los tics son del contador de ciclos (TSC) en x86, que se lee en unos pocos ns frente a los ~25
+ * de steady_clock; leer() los pasa a ns con la relación entre los dos medida desde el arranque.
+ * Sin TSC, los tics son ns de steady_clock.
+ * Con -DBIBLIOTECADB_SIN_ESTADISTICAS, MedirOp queda vacío y las operaciones no miden nada.
+ */
+enum class OpMedida : uint8_t {
+    AddAutor, UpdateAutor, DeleteAutor, AddLibro, UpdateLibro, DeleteLibro,
+    AddEstudiante, UpdateEstudiante, DeleteEstudiante, AddPrestamo, DevolverPrestamo, DeletePrestamo,
+    LibroDisponible, LibrosPrestadosEstudiante, LibrosPrestadosEstudiantes, TopAutores,
+    CargarCSV, GuardarCSV, CargarSnapshot, GuardarSnapshot, ImportarLote,
+    Total
+};
+const char* const NOMBRES_OP_MEDIDA[] = {
+    "addAutor", "updateAutor", "deleteAutor", "addLibro", "updateLibro", "deleteLibro",
+    "addEstudiante", "updateEstudiante", "deleteEstudiante", "addPrestamo", "devolverPrestamo", "deletePrestamo",
+    "libroDisponible", "librosPrestadosPorEstudiante", "librosPrestadosPorEstudiantes", "topAutores",
+    "cargarCSV", "guardarCSV", "cargarSnapshot", "guardarSnapshot", "importarLote"};
+static_assert(sizeof(NOMBRES_OP_MEDIDA) / sizeof(NOMBRES_OP_MEDIDA[0]) == size_t(OpMedida::Total), "un nombre por operación");
+
+#ifdef BIBLIOTECADB_SIN_ESTADISTICAS
+const bool ESTADISTICAS_ACTIVAS = false;
+#else
+const bool ESTADISTICAS_ACTIVAS = true;
+#endif
+
+class Estadisticas {
+public:
+    static constexpr int CUBETAS = 48;  // Cubeta b: [2^(b-1), 2^b) tics; la última junta todo lo más lento
+    static constexpr size_t OPS = size_t(OpMedida::Total);
+
+    struct Op {
+        uint64_t llamadas = 0, fallidas = 0, tics = 0, maxTics = 0;
+        uint64_t cubetas[CUBETAS] = {};
+        double nsPorTic = 1;
+
+        double totalMs() const { return double(tics) * nsPorTic / 1e6; }
+        double mediaUs() const { return llamadas ? double(tics) * nsPorTic / double(llamadas) / 1000 : 0; }
+        double maxUs() const { return double(maxTics) * nsPorTic / 1000; }
+        // Estimado del histograma: interpolación lineal dentro de la cubeta, nunca más que el máximo
+        double percentilUs(double p) const {
+            if (!llamadas) return 0;
+            double objetivo = p * double(llamadas), visto = 0;
+            for (int b = 0; b < CUBETAS; b++) {
+                if (!cubetas[b] || visto + double(cubetas[b]) < objetivo) {
+                    visto += double(cubetas[b]);
+                    continue;
+                }
+                double desde = b ? double(uint64_t(1) << (b - 1)) : 0, hasta = double(uint64_t(1) << b);
+                double t = desde + (hasta - desde) * (objetivo - visto) / double(cubetas[b]);
+                return min(t, double(maxTics)) * nsPorTic / 1000;
+            }
+            return maxUs();
+        }
+    };
+    struct Resumen {
+        Op op[OPS];
+    };
+
+    static uint64_t tic() {
+#ifdef BIBLIOTECADB_TSC
+        return __rdtsc();
+#else
+        return uint64_t(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    static void anotar(OpMedida op, uint64_t tics, bool ok) {
+        Hilo* h = hilo ? hilo : registrarHilo();
+        Contador& c = h->op[size_t(op)];
+        sumar(c.llamadas, 1);
+        if (!ok) sumar(c.fallidas, 1);
+        sumar(c.tics, tics);
+        if (tics > c.maxTics.load(memory_order_relaxed)) c.maxTics.store(tics, memory_order_relaxed);
+        sumar(c.cubetas[cubeta(tics)], 1);
+    }
+
+    static Resumen leer() {
+        double escala = nsPorTic();
+        Registro& r = registro();
+        lock_guard<mutex> l(r.m);
+        Resumen res = r.terminados;
+        for (Hilo* h : r.vivos) juntar(res, *h);
+        for (Op& o : res.op) o.nsPorTic = escala;
+        return res;
+    }
+
+private:
+    struct Contador {
+        atomic<uint64_t> llamadas{0}, fallidas{0}, tics{0}, maxTics{0};
+        atomic<uint64_t> cubetas[CUBETAS] = {};
+    };
+    struct Hilo {
+        Contador op[OPS];
+    };
+    struct Registro {
+        mutex m;
+        vector<Hilo*> vivos;
+        Resumen terminados;  // Lo que anotaron los hilos que ya salieron
+    };
+    // Al salir el hilo, sus cuentas pasan a terminados
+    struct Dueno {
+        Hilo* h = nullptr;
+        ~Dueno() {
+            if (!h) return;
+            Registro& r = registro();
+            lock_guard<mutex> l(r.m);
+            juntar(r.terminados, *h);
+            r.vivos.erase(find(r.vivos.begin(), r.vivos.end(), h));
+            delete h;
+            hilo = nullptr;
+        }
+    };
+    static inline thread_local Hilo* hilo = nullptr;
+
+    // Sin destructor: sigue válido para los hilos que terminan durante la salida del proceso.
+    // Guarda también el par (tic, steady_clock) del arranque para calibrar los tics.
+    static Registro& registro() {
+        static Registro* r = new Registro();
+        return *r;
+    }
+    struct Origen {
+        uint64_t tic;
+        chrono::steady_clock::time_point t;
+    };
+    static inline const Origen ORIGEN{tic(), chrono::steady_clock::now()};
+    static double nsPorTic() {
+#ifdef BIBLIOTECADB_TSC
+        auto ns = [] { return double(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - ORIGEN.t).count()); };
+        while (ns() < 1e7) {}  // Al menos 10 ms desde el arranque para que la relación sea estable
+        uint64_t t = tic();
+        double transcurrido = ns();
+        return t > ORIGEN.tic ? transcurrido / double(t - ORIGEN.tic) : 1;
+#else
+        return 1;
+#endif
+    }
+    static Hilo* registrarHilo() {
+        thread_local Dueno dueno;
+        dueno.h = new Hilo();
+        Registro& r = registro();
+        lock_guard<mutex> l(r.m);
+        r.vivos.push_back(dueno.h);
+        return hilo = dueno.h;
+    }
+    // Solo escribe el hilo dueño: load + store, sin la instrucción atómica de un fetch_add
+    static void sumar(atomic<uint64_t>& a, uint64_t v) { a.store(a.load(memory_order_relaxed) + v, memory_order_relaxed); }
+    static int cubeta(uint64_t ns) {
+        int b = 0;
+#if defined(__GNUC__)
+        b = ns ? 64 - __builtin_clzll(ns) : 0;
+#else
+        while (ns) { b++; ns >>= 1; }
+#endif
+        return min(b, CUBETAS - 1);
+    }
+    static void juntar(Resumen& res, const Hilo& h) {
+        for (size_t i = 0; i < OPS; i++) {
+            const Contador& c = h.op[i];
+            Op& o = res.op[i];
+            o.llamadas += c.llamadas.load(memory_order_relaxed);
+            o.fallidas += c.fallidas.load(memory_order_relaxed);
+            o.tics += c.tics.load(memory_order_relaxed);
+            o.maxTics = max(o.maxTics, c.maxTics.load(memory_order_relaxed));
+            for (int b = 0; b < CUBETAS; b++) o.cubetas[b] += c.cubetas[b].load(memory_order_relaxed);
+        }
+    }
+};
+
+// Mide la operación del bloque: MedirOp m(OpMedida::AddLibro); ... return m.ok();
+// Cuenta como fallida salvo que el camino de éxito llame a ok() (o ok(resultado)).
+#ifndef BIBLIOTECADB_SIN_ESTADISTICAS
+class MedirOp {
+public:
+    explicit MedirOp(OpMedida op) : op(op), inicio(Estadisticas::tic()) {}
+    ~MedirOp() {
+        uint64_t fin = Estadisticas::tic();
+        Estadisticas::anotar(op, fin > inicio ? fin - inicio : 0, bien);  // Un hilo que cambió de núcleo puede ver el TSC atrás
+    }
+    MedirOp(const MedirOp&) = delete;
+    MedirOp& operator=(const MedirOp&) = delete;
+    bool ok(bool resultado = true) { return bien = resultado; }
+
+private:
+    OpMedida op;
+    bool bien = false;
+    uint64_t inicio;
+};
+#else
+class MedirOp {
+public:
+    explicit MedirOp(OpMedida) {}
+    bool ok(bool resultado = true) { return resultado; }
+};
+#endif
+
+// Filas nuevas para DB::importar, en cualquier combinación de tablas. Los textos son vistas sobre
+// memoria del llamador (un CSV mapeado, un registro del WAL...) que tiene que durar hasta que
+// importar() vuelva. legible = false: la fila venía con campos que no se pudieron leer.
+struct LoteImportacion {
+    struct FilaAutor { int id; string_view nombre, nacionalidad; bool legible = true; };
+    struct FilaLibro { int id; string_view titulo, isbn; int ano, id_autor; bool legible = true; };
+    struct FilaEstudiante { int id; string_view nombre, grado; bool legible = true; };
+    struct FilaPrestamo { int id, id_libro, id_estudiante; Fecha fecha_prestamo, fecha_devolucion; bool legible = true; };
+    vector<FilaAutor> autores;
+    vector<FilaLibro> libros;
+    vector<FilaEstudiante> estudiantes;
+    vector<FilaPrestamo> prestamos;
+
+    // Lo que respalda las vistas cuando el lote sale de archivos (DB::leerLoteCSV)
+    vector<unique_ptr<ArchivoMapeado>> archivos;
+    PoolCadenas textos;  // Campos con comillas escapadas, ya sin escapar
+
+    size_t size() const { return autores.size() + libros.size() + estudiantes.size() + prestamos.size(); }
+};
+
+struct InformeImportacion {
+    struct Rechazo {
+        const char* tabla;
+        size_t fila;  // 1 = primera fila de esa tabla en el lote (en un CSV, la primera tras el header)
+        int id;
+        const char* motivo;
+    };
+    size_t autores = 0, libros = 0, estudiantes = 0, prestamos = 0;  // Filas aceptadas
+    vector<Rechazo> rechazos;
+    bool confirmado = false;  // Se agregó a la DB (todo el lote, o lo aceptado si era parcial)
+};
+
+// Referencia estable a una fila: guarda el id y lo resuelve por el índice en cada acceso, así
+// sigue valiendo aunque la tabla crezca, se compacte o se recargue (un puntero de buscar* no).
+// Vale false si la fila ya no existe. Solo lectura: los cambios van por el CRUD (y el WAL).
+// Cada acceso es una búsqueda en el hash: para recorrer muchas filas, mejor el vector.
+template <class T>
+class RefFila {
+public:
+    RefFila() = default;
+    RefFila(const vector<T>& tabla, const unordered_map<int, size_t>& idx, int id) : tabla(&tabla), idx(&idx), idFila(id) {}
+
+    int id() const { return idFila; }
+    const T* get() const {
+        if (!idx) return nullptr;
+        auto it = idx->find(idFila);
+        return it == idx->end() ? nullptr : &(*tabla)[it->second];
+    }
+    explicit operator bool() const { return get() != nullptr; }
+    const T& operator*() const { return *get(); }
+    const T* operator->() const { return get(); }
+
+private:
+    const vector<T>* tabla = nullptr;
+    const unordered_map<int, size_t>* idx = nullptr;
+    int idFila = 0;
+};
+
+struct DB {
+    vector<Autor> autores;
+    vector<Libro> libros;
+    vector<Estudiante> estudiantes;
+    TablaPrestamos prestamos;
+
+    // Texto de las filas: nombres/títulos/ISBN en el pool, valores repetidos en el diccionario.
+    // mTextos solo protege la unión de los trozos de las cargas en paralelo.
+    PoolCadenas pool;
+    Diccionario dicc;
+    mutex mTextos;
+
+    RegistroWAL* wal = nullptr;  // Si está, cada cambio con éxito se anota en el WAL
+
+    // Índices de clave primaria: id -> posición en el vector (solo filas vivas).
+    // Los mantiene cada add/update/delete y se reconstruyen al cargar.
+    unordered_map<int, size_t> idxAutores;
+    unordered_map<int, size_t> idxLibros;
+    unordered_map<int, size_t> idxEstudiantes;
+    unordered_map<int, size_t> idxPrestamos;
+
+    // Filas borradas de cada tabla, hasta que la compactación las saca (ver Lapidas)
+    Lapidas borradosAutores, borradosLibros, borradosEstudiantes, borradosPrestamos;
+
+    // Reconstruye el índice completo (tras cargar). Con IDs duplicados en CSV gana la primera fila.
+    template <class Tabla>
+    static void reindexar(const Tabla& v, unordered_map<int, size_t>& idx, const Lapidas& borradas) {
+        idx.clear();
+        idx.reserve(v.size() - borradas.size());
+        borradas.recorrerVivas(v.size(), [&](size_t i) { idx.emplace(v[i].id, i); });
+    }
+
+    // Borrar es O(1): la fila sale del índice y queda marcada; compactarBorradas la saca después
+    template <class Tabla>
+    static void borrarFila(Tabla& v, unordered_map<int, size_t>& idx, Lapidas& borradas, size_t pos) {
+        idx.erase(v[pos].id);
+        borradas.marcar(pos);
+    }
+
+    template <class T>
+    static void moverFila(vector<T>& v, size_t desde, size_t hacia) { v[hacia] = v[desde]; }
+    static void moverFila(TablaPrestamos& t, size_t desde, size_t hacia) { t.mover(desde, hacia); }
+    template <class T>
+    static void recortarTabla(vector<T>& v, size_t filas) {
+        v.erase(v.begin() + static_cast<ptrdiff_t>(filas), v.end());
+        if (v.capacity() > 2 * v.size() + 1024) v.shrink_to_fit();
+    }
+    static void recortarTabla(TablaPrestamos& t, size_t filas) {
+        t.resize(filas);
+        if (t.id.capacity() > 2 * t.size() + 1024) t.shrink_to_fit();
+    }
+
+    // Un tramo de compactación de la tabla: revisa hasta presupuesto filas desde donde quedó,
+    // corre las vivas sobre el hueco de las borradas (el orden se conserva) y corrige su posición
+    // en idx. Arranca sola cuando las borradas llegan a 1/8 de la tabla. Devuelve las filas
+    // revisadas (0: no había nada que hacer).
+    template <class Tabla>
+    static size_t compactarTramo(Tabla& v, unordered_map<int, size_t>& idx, Lapidas& l, size_t presupuesto) {
+        if (!l.compactando) {
+            if (l.empty() || l.size() * 8 < v.size()) return 0;
+            l.compactando = true;
+            l.lectura = l.escritura = l.primeraBorrada();  // Lo anterior ya está en su lugar
+        }
+        size_t revisadas = 0;
+        for (; l.lectura < v.size() && revisadas < presupuesto; l.lectura++, revisadas++) {
+            size_t r = l.lectura;
+            if (l.borrada(r)) continue;
+            size_t w = l.escritura++;
+            moverFila(v, r, w);
+            l.desmarcar(w);
+            l.marcar(r);
+            auto it = idx.find(v[w].id);
+            if (it != idx.end() && it->second == r) it->second = w;  // Un id repetido en el CSV no está en idx
+        }
+        if (l.lectura == v.size()) {
+            recortarTabla(v, l.escritura);
+            l.recortar(l.escritura);
+            l.compactando = false;
+        }
+        return revisadas;
+    }
+    // Compactación incremental, entre comandos (mantenimiento): revisa hasta presupuesto filas en
+    // total, tabla por tabla, así ninguna pausa pasa de un tramo. true si quedó alguna a medias.
+    static constexpr size_t TRAMO_COMPACTACION = 32768;
+    bool compactarBorradas(size_t presupuesto = TRAMO_COMPACTACION) {
+        presupuesto -= compactarTramo(autores, idxAutores, borradosAutores, presupuesto);
+        presupuesto -= compactarTramo(libros, idxLibros, borradosLibros, presupuesto);
+        presupuesto -= compactarTramo(estudiantes, idxEstudiantes, borradosEstudiantes, presupuesto);
+        compactarTramo(prestamos, idxPrestamos, borradosPrestamos, presupuesto);
+        rearmarTextos();
+        return borradosAutores.compactando || borradosLibros.compactando || borradosEstudiantes.compactando ||
+               borradosPrestamos.compactando;
+    }
+
+    // Bytes del pool que ya no usa ninguna fila viva: textos reemplazados por un update, de filas
+    // borradas o de tablas recargadas. Cuando pasan de lo vivo (y de MIN_TEXTO_MUERTO), el texto
+    // vivo se copia a un pool nuevo y el viejo se libera entero: el pool nunca ocupa más del doble
+    // de lo que usa. La pausa es proporcional al texto vivo.
+    size_t textoMuerto = 0;
+    static constexpr size_t MIN_TEXTO_MUERTO = 1 << 20;
+
+    template <class T, class... Campos>
+    static size_t bytesTexto(const vector<T>& filas, const Lapidas& borradas, Campos... campos) {
+        size_t n = 0;
+        borradas.recorrerVivas(filas.size(), [&](size_t i) { n += (size_t(0) + ... + (filas[i].*campos).size()); });
+        return n;
+    }
+    void soltarTexto(size_t bytes) {
+        lock_guard<mutex> l(mTextos);  // Los load de cada tabla corren a la vez
+        textoMuerto += bytes;
+    }
+    // Las filas borradas aún sin compactar se quedan con vistas vacías: nadie las lee
+    bool rearmarTextos() {
+        if (textoMuerto < MIN_TEXTO_MUERTO || 2 * textoMuerto < pool.bytesUsados()) return false;  // Muerto < vivo
+        PoolCadenas nuevo;
+        auto pasar = [&](auto& filas, const Lapidas& borradas, auto... campos) {
+            for (size_t i = 0; i < filas.size(); i++) {
+                bool viva = !borradas.borrada(i);
+                ((filas[i].*campos = viva ? nuevo.guardar(filas[i].*campos) : string_view()), ...);
+            }
+        };
+        pasar(autores, borradosAutores, &Autor::nombre);
+        pasar(libros, borradosLibros, &Libro::titulo, &Libro::isbn);
+        pasar(estudiantes, borradosEstudiantes, &Estudiante::nombre);
+        pool = move(nuevo);
+        textoMuerto = 0;
+        return true;
+    }
+
+    size_t filasBorradas() const {
+        return borradosAutores.size() + borradosLibros.size() + borradosEstudiantes.size() + borradosPrestamos.size();
+    }
+
+    // Préstamos activos (sin devolver): id_libro / id_estudiante -> ids de préstamo,
+    // en orden de la tabla. Solo crece con los activos, no con el histórico.
+    unordered_map<int, vector<int>> activosPorLibro;
+    unordered_map<int, vector<int>> activosPorEstudiante;
+
+    // Préstamos por día de inicio y de devolución, con totales por día (ver CalendarioPrestamos)
+    CalendarioPrestamos calendario;
+
+    uint32_t gradoActual(int id_est) const {
+        size_t e = posicion(idxEstudiantes, id_est);
+        return e == SIZE_MAX ? TEXTO_VACIO : estudiantes[e].grado;
+    }
+    void reindexarCalendario() {
+        calendario.construir(prestamos, [this](size_t i) { return gradoActual(prestamos.id_estudiante[i]); }, borradosPrestamos);
+    }
+
+    void marcarActivo(const Prestamo& p) {
+        activosPorLibro[p.id_libro].push_back(p.id);
+        activosPorEstudiante[p.id_estudiante].push_back(p.id);
+    }
+    void desmarcarActivo(const Prestamo& p) {
+        auto quitar = [&](unordered_map<int, vector<int>>& m, int clave) {
+            auto it = m.find(clave);
+            if (it == m.end()) return;
+            auto& v = it->second;
+            auto pos = find(v.begin(), v.end(), p.id);
+            if (pos != v.end()) v.erase(pos);  // Conserva el orden
+            if (v.empty()) m.erase(it);
+        };
+        quitar(activosPorLibro, p.id_libro);
+        quitar(activosPorEstudiante, p.id_estudiante);
+    }
+    static void construirActivos(const TablaPrestamos& ps, const Lapidas& borradas, unordered_map<int, vector<int>>& porLibro,
+                                 unordered_map<int, vector<int>>& porEst) {
+        porLibro.clear();
+        porEst.clear();
+        borradas.recorrerVivas(ps.size(), [&](size_t i) {
+            if (!ps.activo(i)) return;
+            porLibro[ps.id_libro[i]].push_back(ps.id[i]);
+            porEst[ps.id_estudiante[i]].push_back(ps.id[i]);
+        });
+    }
+    void reindexarActivos() { construirActivos(prestamos, borradosPrestamos, activosPorLibro, activosPorEstudiante); }
+
+    // Referencias inversas de FK: id referenciado -> nº de filas que lo referencian.
+    // Sin entrada = sin referencias; así deleteAutor/deleteEstudiante validan en O(1).
+    unordered_map<int, int> librosPorAutor;          // autor -> libros
+    unordered_map<int, int> prestamosPorEstudiante;  // estudiante -> préstamos (incl. históricos)
+    unordered_map<int, int> prestamosPorLibro;       // libro -> préstamos (incl. históricos)
+
+    static void sumarRef(unordered_map<int, int>& refs, int id, int delta) {
+        auto it = refs.try_emplace(id, 0).first;  // emplace armaría el nodo aunque la clave ya esté
+        it->second += delta;
+        if (it->second <= 0) refs.erase(it);
+    }
+    template <class T>
+    static unordered_map<int, int> contarReferencias(const vector<T>& v, int T::*fk, const Lapidas& borradas) {
+        unordered_map<int, int> refs;
+        borradas.recorrerVivas(v.size(), [&](size_t i) { refs[v[i].*fk]++; });
+        return refs;
+    }
+    static unordered_map<int, int> contarReferencias(const vector<int>& fk, const Lapidas& borradas) {
+        unordered_map<int, int> refs;
+        borradas.recorrerVivas(fk.size(), [&](size_t i) { refs[fk[i]]++; });
+        return refs;
+    }
+    // Autores ordenados por nº de libros (más libros primero, empate por id): el top N son los N
+    // primeros. Se mueve junto con librosPorAutor en sumarLibrosAutor.
+    set<pair<int, int>> rankingAutores;  // {-libros, id_autor}
+
+    // El autor cambia de lugar en el ranking reusando su nodo (extract/insert), sin reservar otro
+    void sumarLibrosAutor(int id_autor, int delta) {
+        auto it = librosPorAutor.find(id_autor);
+        int antes = it == librosPorAutor.end() ? 0 : it->second;
+        sumarRef(librosPorAutor, id_autor, delta);
+        int despues = antes + delta;
+        if (antes > 0 && despues > 0) {
+            auto nodo = rankingAutores.extract({-antes, id_autor});
+            nodo.value().first = -despues;
+            rankingAutores.insert(move(nodo));
+        } else if (antes > 0) {
+            rankingAutores.erase({-antes, id_autor});
+        } else if (despues > 0) {
+            rankingAutores.emplace(-despues, id_autor);
+        }
+    }
+    static set<pair<int, int>> construirRanking(const unordered_map<int, int>& refs) {
+        set<pair<int, int>> r;
+        for (auto& kv : refs) r.emplace(-kv.second, kv.first);
+        return r;
+    }
+    void reindexarRefsLibros() {
+        librosPorAutor = contarReferencias(libros, &Libro::id_autor, borradosLibros);
+        rankingAutores = construirRanking(librosPorAutor);
+    }
+    // Búsqueda de libros por texto (título o nombre del autor). Se arma en la primera búsqueda y
+    // desde ahí la mantienen los CRUD; cargar la tabla la descarta. Autores y libros por separado,
+    // porque sus loads corren a la vez.
+    IndiceTexto textoAutores, textoTitulos;
+    unordered_map<int, vector<int>> librosDeAutor;  // autor -> ids de libros, para las coincidencias por autor
+    bool autoresEnTexto = false, librosEnTexto = false;
+
+    void descartarTextoAutores() {
+        textoAutores = IndiceTexto();
+        autoresEnTexto = false;
+    }
+    void descartarTextoLibros() {
+        textoTitulos = IndiceTexto();
+        librosDeAutor.clear();
+        librosEnTexto = false;
+    }
+    void prepararTexto() {
+        if (!autoresEnTexto) {
+            textoAutores.construir(autores, &Autor::nombre, borradosAutores);
+            autoresEnTexto = true;
+        }
+        if (!librosEnTexto) {
+            textoTitulos.construir(libros, &Libro::titulo, borradosLibros);
+            borradosLibros.recorrerVivas(libros.size(), [&](size_t i) { librosDeAutor[libros[i].id_autor].push_back(libros[i].id); });
+            librosEnTexto = true;
+        }
+    }
+    void quitarLibroDeAutor(int id_autor, int id_libro) {
+        auto it = librosDeAutor.find(id_autor);
+        if (it == librosDeAutor.end()) return;
+        auto& v = it->second;
+        v.erase(remove(v.begin(), v.end(), id_libro), v.end());
+        if (v.empty()) librosDeAutor.erase(it);
+    }
+
+    void reindexarRefsPrestamos() {
+        prestamosPorEstudiante = contarReferencias(prestamos.id_estudiante, borradosPrestamos);
+        prestamosPorLibro = contarReferencias(prestamos.id_libro, borradosPrestamos);
+    }
+
+    // Reconstruye desde cero todos los índices y los compara con los mantenidos.
+    // Devuelve cuántos difieren (detalle en err); si hay diferencias quedan reparados.
+    int verificarIndices(ostream& err = cerr) {
+        int malos = 0;
+        auto revisar = [&](bool ok, const char* nombre) {
+            if (!ok) { err << "Indice inconsistente: " << nombre << "\n"; malos++; }
+        };
+        unordered_map<int, size_t> idx;
+        reindexar(autores, idx, borradosAutores);         revisar(idx == idxAutores, "idxAutores");
+        reindexar(libros, idx, borradosLibros);           revisar(idx == idxLibros, "idxLibros");
+        reindexar(estudiantes, idx, borradosEstudiantes); revisar(idx == idxEstudiantes, "idxEstudiantes");
+        reindexar(prestamos, idx, borradosPrestamos);     revisar(idx == idxPrestamos, "idxPrestamos");
+        unordered_map<int, vector<int>> porLibro, porEst;
+        construirActivos(prestamos, borradosPrestamos, porLibro, porEst);
+        revisar(porLibro == activosPorLibro, "activosPorLibro");
+        revisar(porEst == activosPorEstudiante, "activosPorEstudiante");
+        auto porAutor = contarReferencias(libros, &Libro::id_autor, borradosLibros);
+        revisar(porAutor == librosPorAutor, "librosPorAutor");
+        revisar(construirRanking(porAutor) == rankingAutores, "rankingAutores");
+        revisar(contarReferencias(prestamos.id_estudiante, borradosPrestamos) == prestamosPorEstudiante, "prestamosPorEstudiante");
+        revisar(contarReferencias(prestamos.id_libro, borradosPrestamos) == prestamosPorLibro, "prestamosPorLibro");
+        // El grado anotado al devolver no se puede deducir de la tabla: se toma del calendario y
+        // se revisa que días, préstamos y totales cuadren con él
+        CalendarioPrestamos cal;
+        auto anotados = calendario.gradosAnotados();
+        cal.construir(prestamos, [&](size_t i) {
+            auto it = anotados.find(prestamos.id[i]);
+            return it != anotados.end() ? it->second : gradoActual(prestamos.id_estudiante[i]);
+        }, borradosPrestamos);
+        revisar(cal == calendario, "calendario");
+        if (malos) reconstruirIndices();
+        return malos;
+    }
+    // Una tarea por tabla: cada una escribe solo sus propios índices
+    void reconstruirIndices() {
+        descartarTextoAutores();
+        descartarTextoLibros();
+        auto aut = async(launch::async, [&] { reindexar(autores, idxAutores, borradosAutores); });
+        auto lib = async(launch::async, [&] { reindexar(libros, idxLibros, borradosLibros); reindexarRefsLibros(); });
+        auto est = async(launch::async, [&] { reindexar(estudiantes, idxEstudiantes, borradosEstudiantes); });
+        reindexar(prestamos, idxPrestamos, borradosPrestamos);
+        reindexarActivos();
+        reindexarRefsPrestamos();
+        reindexarCalendario();
+        aut.get();
+        lib.get();
+        est.get();
+    }
+
+    static size_t posicion(const unordered_map<int, size_t>& idx, int id) {
+        auto it = idx.find(id);
+        return it == idx.end() ? SIZE_MAX : it->second;
+    }
+
+    // Utilidades CSV: tokenizado sin copias sobre el texto del archivo y escape para comas/comillas.
+    // Un campo se parte en las comas fuera de comillas; conserva sus comillas externas hasta texto().
+    static constexpr int MAX_CAMPOS = 8;
+
+    // Parte una línea en campos; devuelve cuántos hay (solo guarda los MAX_CAMPOS primeros)
+    static int camposCSV(string_view linea, string_view* campos) {
+        int n = 0;
+        size_t ini = 0;
+        bool inq = false;
+        for (size_t i = 0; i < linea.size(); i++) {
+            char c = linea[i];
+            if (c == '"') inq = !inq;
+            else if (c == ',' && !inq) {
+                if (n < MAX_CAMPOS) campos[n] = linea.substr(ini, i - ini);
+                n++;
+                ini = i + 1;
+            }
+        }
+        if (n < MAX_CAMPOS) campos[n] = linea.substr(ini);
+        return n + 1;
+    }
+
+    // Texto de un campo: quita comillas externas y deshace el escape "" -> " de esc().
+    // Sin escapes es una vista sobre el archivo; con escapes se arma en tmp.
+    static string_view texto(string_view c, string& tmp) {
+        if (c.size() < 2 || c.front() != '"' || c.back() != '"') return c;
+        c = c.substr(1, c.size() - 2);
+        if (c.find('"') == string_view::npos) return c;
+        tmp.clear();
+        tmp.reserve(c.size());
+        for (size_t i = 0; i < c.size(); i++) {
+            tmp.push_back(c[i]);
+            if (c[i] == '"' && i + 1 < c.size() && c[i + 1] == '"') i++;
+        }
+        return tmp;
+    }
+
+    // Entero como stoi (salta espacios iniciales, ignora lo que siga) pero sin excepciones
+    static bool entero(string_view c, int& v) {
+        size_t i = 0;
+        while (i < c.size() && (c[i] == ' ' || c[i] == '\t')) i++;
+        if (i < c.size() && c[i] == '+') i++;
+        return from_chars(c.data() + i, c.data() + c.size(), v).ec == errc();
+    }
+
+    // Recorre las filas de datos (sin header; salta líneas vacías); fila(campos) por cada una
+    template <class Fila>
+    static void recorrerCSV(string_view txt, int minCampos, Fila fila) {
+        string_view campos[MAX_CAMPOS];
+        while (!txt.empty()) {
+            const char* fin = static_cast<const char*>(memchr(txt.data(), '\n', txt.size()));
+            size_t largo = fin ? static_cast<size_t>(fin - txt.data()) : txt.size();
+            string_view linea = txt.substr(0, largo);
+            txt.remove_prefix(fin ? largo + 1 : largo);
+            if (!linea.empty() && linea.back() == '\r') linea.remove_suffix(1);  // CSV editado en Windows
+            if (linea.empty()) continue;
+            if (camposCSV(linea, campos) < minCampos) continue;
+            fila(campos);
+        }
+    }
+
+    // Como recorrerCSV pero sin saltar las filas con menos campos: fila(campos, completa)
+    template <class Fila>
+    static void recorrerCSVConCortas(string_view txt, int minCampos, Fila fila) {
+        string_view campos[MAX_CAMPOS];
+        while (!txt.empty()) {
+            const char* fin = static_cast<const char*>(memchr(txt.data(), '\n', txt.size()));
+            size_t largo = fin ? static_cast<size_t>(fin - txt.data()) : txt.size();
+            string_view linea = txt.substr(0, largo);
+            txt.remove_prefix(fin ? largo + 1 : largo);
+            if (!linea.empty() && linea.back() == '\r') linea.remove_suffix(1);
+            if (linea.empty()) continue;
+            fila(campos, camposCSV(linea, campos) >= minCampos);
+        }
+    }
+
+    static string_view sinHeader(string_view txt) {
+        size_t fin = txt.find('\n');
+        return fin == string_view::npos ? string_view() : txt.substr(fin + 1);
+    }
+
+    // Filas estimadas para reservar de una vez: nº de saltos de línea
+    static size_t contarLineas(string_view txt) {
+        return static_cast<size_t>(count(txt.begin(), txt.end(), '\n'));
+    }
+
+    static size_t hilos() { return max(1u, thread::hardware_concurrency()); }
+
+    // Parte txt en hasta n trozos contiguos que terminan en salto de línea
+    static vector<string_view> partirEnLineas(string_view txt, size_t n) {
+        vector<string_view> partes;
+        size_t objetivo = txt.size() / n + 1;
+        while (!txt.empty()) {
+            size_t corte = min(objetivo, txt.size());
+            size_t nl = txt.find('\n', corte - 1);
+            corte = nl == string_view::npos ? txt.size() : nl + 1;
+            partes.push_back(txt.substr(0, corte));
+            txt.remove_prefix(corte);
+        }
+        return partes;
+    }
+
+    // Cada trozo guarda sus textos en su propio pool y diccionario; al unirlo se pasan a los de la DB
+    struct TrozoCarga {
+        PoolCadenas pool;
+        Diccionario dicc;
+        string tmp;  // Para texto()
+        string_view texto(string_view c) { return pool.guardar(DB::texto(c, tmp)); }
+        uint32_t id(string_view c) { return dicc.id(DB::texto(c, tmp)); }
+        bool fecha(string_view c, Fecha& f) { return leerFecha(DB::texto(c, tmp), f); }
+    };
+
+    // Parsea las filas de txt (sin header). Por encima de TROZO_MIN bytes lo reparte en
+    // trozos alineados a líneas, uno por hilo, y los une en el orden del archivo.
+    // traducir(fila, mapa) pasa los ids de diccionario de la fila del trozo a los de la DB.
+    static constexpr size_t TROZO_MIN = 4 << 20;
+    template <class T, class Fila, class Traducir>
+    vector<T> parsearCSV(string_view txt, int minCampos, Fila fila, Traducir traducir) {
+        size_t n = min(hilos(), max<size_t>(1, txt.size() / TROZO_MIN));
+        vector<string_view> partes = partirEnLineas(txt, n);
+        vector<vector<T>> res(partes.size());
+        vector<TrozoCarga> trozos(partes.size());
+        auto parsear = [&](size_t k) {
+            res[k].reserve(contarLineas(partes[k]) + 1);
+            recorrerCSV(partes[k], minCampos, [&](const string_view* v) { fila(v, res[k], trozos[k]); });
+        };
+        if (res.empty()) return {};
+        vector<thread> ths;
+        for (size_t k = 1; k < partes.size(); k++) ths.emplace_back(parsear, k);
+        parsear(0);
+        for (auto& t : ths) t.join();
+
+        {
+            lock_guard<mutex> l(mTextos);  // Las otras tablas pueden estar uniendo a la vez
+            for (size_t k = 0; k < res.size(); k++) {
+                pool.absorber(move(trozos[k].pool));
+                vector<uint32_t> mapa = dicc.unir(trozos[k].dicc);
+                for (auto& x : res[k]) traducir(x, mapa);
+            }
+        }
+        vector<T> out = move(res[0]);
+        size_t total = out.size();
+        for (size_t k = 1; k < res.size(); k++) total += res[k].size();
+        out.reserve(total);
+        for (size_t k = 1; k < res.size(); k++) {
+            out.insert(out.end(), make_move_iterator(res[k].begin()), make_move_iterator(res[k].end()));
+            vector<T>().swap(res[k]);  // Libera cada trozo en cuanto se une
+        }
+        return out;
+    }
+
+    static string esc(string_view s) {
+        string r;
+        escCSV(s, r);
+        return r;
+    }
+
+    // Carga desde CSV (salta header). Filas con IDs, números o fechas ilegibles se descartan.
+    // Cada load toca solo su tabla y sus índices (y une sus textos con mTextos): cargarTodo los
+    // lanza a la vez. Los textos de una tabla recargada quedan en el pool como texto muerto.
+    void loadAutores(const string& path) {
+        MedirOp m(OpMedida::CargarCSV);
+        soltarTexto(bytesTexto(autores, borradosAutores, &Autor::nombre));
+        autores.clear();
+        idxAutores.clear();
+        borradosAutores.clear();
+        descartarTextoAutores();
+        ArchivoMapeado f(path);
+        if (!f.ok()) return;
+        autores = parsearCSV<Autor>(sinHeader(f.texto()), 3,
+            [](const string_view* v, vector<Autor>& out, TrozoCarga& t) {
+                int id;
+                if (!entero(v[0], id)) return;
+                string_view nombre = t.texto(v[1]);
+                out.push_back(Autor{id, nombre, t.id(v[2])});
+            },
+            [](Autor& a, const vector<uint32_t>& m) { a.nacionalidad = m[a.nacionalidad]; });
+        reindexar(autores, idxAutores, borradosAutores);
+        m.ok();
+    }
+
+    void loadLibros(const string& path) {
+        MedirOp m(OpMedida::CargarCSV);
+        soltarTexto(bytesTexto(libros, borradosLibros, &Libro::titulo, &Libro::isbn));
+        libros.clear();
+        idxLibros.clear();
+        borradosLibros.clear();
+        librosPorAutor.clear();
+        rankingAutores.clear();
+        descartarTextoLibros();
+        ArchivoMapeado f(path);
+        if (!f.ok()) return;
+        libros = parsearCSV<Libro>(sinHeader(f.texto()), 5,
+            [](const string_view* v, vector<Libro>& out, TrozoCarga& t) {
+                int id, ano, id_autor;
+                if (!entero(v[0], id) || !entero(v[3], ano) || !entero(v[4], id_autor)) return;
+                string_view titulo = t.texto(v[1]);
+                out.push_back(Libro{id, titulo, t.texto(v[2]), ano, id_autor});
+            },
+            [](Libro&, const vector<uint32_t>&) {});
+        reindexar(libros, idxLibros, borradosLibros);
+        reindexarRefsLibros();
+        m.ok();
+    }
+
+    void loadEstudiantes(const string& path) {
+        MedirOp m(OpMedida::CargarCSV);
+        soltarTexto(bytesTexto(estudiantes, borradosEstudiantes, &Estudiante::nombre));
+        estudiantes.clear();
+        idxEstudiantes.clear();
+        borradosEstudiantes.clear();
+        ArchivoMapeado f(path);
+        if (!f.ok()) return;
+        estudiantes = parsearCSV<Estudiante>(sinHeader(f.texto()), 3,
+            [](const string_view* v, vector<Estudiante>& out, TrozoCarga& t) {
+                int id;
+                if (!entero(v[0], id)) return;
+                string_view nombre = t.texto(v[1]);
+                out.push_back(Estudiante{id, nombre, t.id(v[2])});
+            },
+            [](Estudiante& e, const vector<uint32_t>& m) { e.grado = m[e.grado]; });
+        reindexar(estudiantes, idxEstudiantes, borradosEstudiantes);
+        m.ok();
+    }
+
+    void loadPrestamos(const string& path) {
+        MedirOp m(OpMedida::CargarCSV);
+        prestamos.clear();
+        idxPrestamos.clear();
+        borradosPrestamos.clear();
+        activosPorLibro.clear();
+        activosPorEstudiante.clear();
+        prestamosPorEstudiante.clear();
+        prestamosPorLibro.clear();
+        calendario = CalendarioPrestamos();
+        ArchivoMapeado f(path);
+        if (!f.ok()) return;
+        // Cada trozo se parsea a filas y la tabla se arma por columnas al final
+        prestamos = TablaPrestamos(parsearCSV<Prestamo>(sinHeader(f.texto()), 5,
+            [](const string_view* v, vector<Prestamo>& out, TrozoCarga& t) {
+                int id, id_libro, id_est;
+                Fecha fp, fd;
+                if (!entero(v[0], id) || !entero(v[1], id_libro) || !entero(v[2], id_est)) return;
+                if (!t.fecha(v[3], fp) || fp == SIN_FECHA || !t.fecha(v[4], fd)) return;
+                out.push_back(Prestamo{id, id_libro, id_est, fp, fd});
+            },
+            [](Prestamo&, const vector<uint32_t>&) {}));
+        reindexar(prestamos, idxPrestamos, borradosPrestamos);
+        reindexarActivos();
+        reindexarRefsPrestamos();
+        reindexarCalendario();
+        m.ok();
+    }
+
+    // Validación posterior a la carga (solo lectura, en paralelo por tabla y por trozos).
+    // La carga acepta lo que haya en los CSV; esto solo informa de lo que viola las reglas del CRUD.
+    struct InformeCarga {
+        size_t autoresDuplicados = 0, librosDuplicados = 0, estudiantesDuplicados = 0, prestamosDuplicados = 0;
+        size_t librosSinAutor = 0, prestamosSinLibro = 0, prestamosSinEstudiante = 0;
+        size_t librosConVariosActivos = 0;
+        size_t problemas() const {
+            return autoresDuplicados + librosDuplicados + estudiantesDuplicados + prestamosDuplicados +
+                   librosSinAutor + prestamosSinLibro + prestamosSinEstudiante + librosConVariosActivos;
+        }
+    };
+
+    // Cuenta en paralelo las filas [0, n) que cumplen pred
+    template <class Pred>
+    static size_t contarParalelo(size_t n, Pred pred) {
+        size_t k = min(hilos(), max<size_t>(1, n / 100000));
+        vector<future<size_t>> fs;
+        for (size_t t = 0; t < k; t++) {
+            fs.push_back(async(launch::async, [=] {
+                size_t c = 0;
+                for (size_t i = n * t / k; i < n * (t + 1) / k; i++) c += pred(i);
+                return c;
+            }));
+        }
+        size_t total = 0;
+        for (auto& f : fs) total += f.get();
+        return total;
+    }
+
+    InformeCarga validarCarga() const {
+        InformeCarga inf;
+        inf.autoresDuplicados = autores.size() - borradosAutores.size() - idxAutores.size();
+        inf.librosDuplicados = libros.size() - borradosLibros.size() - idxLibros.size();
+        inf.estudiantesDuplicados = estudiantes.size() - borradosEstudiantes.size() - idxEstudiantes.size();
+        inf.prestamosDuplicados = prestamos.size() - borradosPrestamos.size() - idxPrestamos.size();
+        auto sinAutor = async(launch::async, [&] {
+            return contarParalelo(libros.size(), [&](size_t i) { return !borradosLibros.borrada(i) && !idxAutores.count(libros[i].id_autor); });
+        });
+        auto sinLibro = async(launch::async, [&] {
+            return contarParalelo(prestamos.size(), [&](size_t i) {
+                return !borradosPrestamos.borrada(i) && !idxLibros.count(prestamos.id_libro[i]);
+            });
+        });
+        inf.prestamosSinEstudiante = contarParalelo(prestamos.size(), [&](size_t i) {
+            return !borradosPrestamos.borrada(i) && !idxEstudiantes.count(prestamos.id_estudiante[i]);
+        });
+        for (auto& kv : activosPorLibro) inf.librosConVariosActivos += kv.second.size() > 1;
+        inf.librosSinAutor = sinAutor.get();
+        inf.prestamosSinLibro = sinLibro.get();
+        return inf;
+    }
+
+    // Guarda en CSV (con header) a través de EscritorCSV: escritura atómica con rename
+    bool saveAutores(const string& path) const {
+        MedirOp m(OpMedida::GuardarCSV);
+        EscritorCSV f(path, "id,nombre,nacionalidad\n");
+        borradosAutores.recorrerVivas(autores.size(), [&](size_t i) {
+            const Autor& a = autores[i];
+            f.entero(a.id); f.coma(); f.texto(a.nombre); f.coma(); f.texto(dicc.texto(a.nacionalidad)); f.finFila();
+        });
+        return m.ok(f.cerrar());
+    }
+
+    bool saveLibros(const string& path) const {
+        MedirOp m(OpMedida::GuardarCSV);
+        EscritorCSV f(path, "id,titulo,isbn,ano_publicacion,id_autor\n");
+        borradosLibros.recorrerVivas(libros.size(), [&](size_t i) {
+            const Libro& l = libros[i];
+            f.entero(l.id); f.coma(); f.texto(l.titulo); f.coma(); f.texto(l.isbn); f.coma();
+            f.entero(l.ano); f.coma(); f.entero(l.id_autor); f.finFila();
+        });
+        return m.ok(f.cerrar());
+    }
+
+    bool saveEstudiantes(const string& path) const {
+        MedirOp m(OpMedida::GuardarCSV);
+        EscritorCSV f(path, "id,nombre,grado\n");
+        borradosEstudiantes.recorrerVivas(estudiantes.size(), [&](size_t i) {
+            const Estudiante& e = estudiantes[i];
+            f.entero(e.id); f.coma(); f.texto(e.nombre); f.coma(); f.texto(dicc.texto(e.grado)); f.finFila();
+        });
+        return m.ok(f.cerrar());
+    }
+
+    bool savePrestamos(const string& path) const {
+        MedirOp m(OpMedida::GuardarCSV);
+        EscritorCSV f(path, "id,id_libro,id_estudiante,fecha_prestamo,fecha_devolucion\n");
+        borradosPrestamos.recorrerVivas(prestamos.size(), [&](size_t i) {
+            Prestamo p = prestamos[i];
+            f.entero(p.id); f.coma(); f.entero(p.id_libro); f.coma(); f.entero(p.id_estudiante); f.coma();
+            f.fecha(p.fecha_prestamo); f.coma(); f.fecha(p.fecha_devolucion); f.finFila();
+        });
+        return m.ok(f.cerrar());
+    }
+
+    // Snapshot binario: todas las tablas en un solo archivo columnar. Se escribe en path.tmp y
+    // se renombra al terminar, así un fallo a medias nunca deja un snapshot corrupto.
+    bool guardarSnapshot(const string& path, uint64_t lsn = 0) const {
+        MedirOp m(OpMedida::GuardarSnapshot);
+        string tmp = path + ".tmp";
+        EscritorSnapshot w(tmp);
+        if (!w.ok()) return false;
+        FilasVivas va(autores.size(), borradosAutores), vl(libros.size(), borradosLibros);
+        FilasVivas ve(estudiantes.size(), borradosEstudiantes), vp(prestamos.size(), borradosPrestamos);
+        w.columnaEntera(autores, &Autor::id, va);
+        w.columnaTexto(autores, &Autor::nombre, va);
+        w.columnaTexto(autores, &Autor::nacionalidad, dicc, va);
+        w.columnaEntera(libros, &Libro::id, vl);
+        w.columnaTexto(libros, &Libro::titulo, vl);
+        w.columnaTexto(libros, &Libro::isbn, vl);
+        w.columnaEntera(libros, &Libro::ano, vl);
+        w.columnaEntera(libros, &Libro::id_autor, vl);
+        w.columnaEntera(estudiantes, &Estudiante::id, ve);
+        w.columnaTexto(estudiantes, &Estudiante::nombre, ve);
+        w.columnaTexto(estudiantes, &Estudiante::grado, dicc, ve);
+        w.columnaEntera(prestamos.id, vp);  // Ya son columnas: sin lápidas se escriben tal cual
+        w.columnaEntera(prestamos.id_libro, vp);
+        w.columnaEntera(prestamos.id_estudiante, vp);
+        w.columnaEntera(prestamos.fecha_prestamo, vp);
+        w.columnaEntera(prestamos.fecha_devolucion, vp);
+        uint64_t filas[4] = {va.size(), vl.size(), ve.size(), vp.size()};
+        if (!w.cerrar(filas, lsn)) {
+            remove(tmp.c_str());
+            return false;
+        }
+        return m.ok(rename(tmp.c_str(), path.c_str()) == 0);
+    }
+
+    // Copia de lo que lee guardarSnapshot, con los textos en un pool propio: sirve para escribir
+    // el snapshot en otro hilo mientras esta DB sigue cambiando. Sin índices (no los usa).
+    unique_ptr<DB> copiaParaSnapshot() const {
+        auto c = make_unique<DB>();
+        vector<uint32_t> ids = c->dicc.unir(dicc);
+        c->autores = autores;
+        for (Autor& a : c->autores) {
+            a.nombre = c->pool.guardar(a.nombre);
+            a.nacionalidad = ids[a.nacionalidad];
+        }
+        c->libros = libros;
+        for (Libro& l : c->libros) {
+            l.titulo = c->pool.guardar(l.titulo);
+            l.isbn = c->pool.guardar(l.isbn);
+        }
+        c->estudiantes = estudiantes;
+        for (Estudiante& e : c->estudiantes) {
+            e.nombre = c->pool.guardar(e.nombre);
+            e.grado = ids[e.grado];
+        }
+        c->prestamos = prestamos;
+        c->borradosAutores = borradosAutores;
+        c->borradosLibros = borradosLibros;
+        c->borradosEstudiantes = borradosEstudiantes;
+        c->borradosPrestamos = borradosPrestamos;
+        return c;
+    }
+
+    // Carga un snapshot (mmap + copia de columnas + índices). Si no es válido no toca la DB.
+    // Cada heap de texto se copia de una vez al pool nuevo; el anterior se libera entero.
+    // lsn: último registro del WAL que ya incluye.
+    bool cargarSnapshot(const string& path, string& error, uint64_t* lsn = nullptr) {
+        MedirOp m(OpMedida::CargarSnapshot);
+        ArchivoMapeado f(path);
+        if (!f.ok()) { error = "no existe"; return false; }
+        LectorSnapshot r(f.texto());
+        if (!r.abrir(error)) return false;
+        bool ok = true;
+        vector<Autor> a(r.filas(0));
+        vector<Libro> l(r.filas(1));
+        vector<Estudiante> e(r.filas(2));
+        TablaPrestamos p;
+        p.resize(r.filas(3));
+        PoolCadenas pl;
+        Diccionario dc;
+        auto leerEnteros = [&](auto& filas, auto campo) {
+            const int32_t* c = r.columnaEntera(filas.size(), ok);
+            for (size_t i = 0; ok && i < filas.size(); i++) filas[i].*campo = c[i];
+        };
+        auto leerTexto = [&](auto& filas, auto campo) {
+            auto c = r.columnaTexto(filas.size(), ok);
+            if (!ok) return;
+            c.heap = pl.guardar(c.heap.substr(0, c.offs[filas.size()]));
+            for (size_t i = 0; i < filas.size(); i++) filas[i].*campo = c[i];
+        };
+        auto leerDicc = [&](auto& filas, auto campo) {
+            auto c = r.columnaTexto(filas.size(), ok);
+            for (size_t i = 0; ok && i < filas.size(); i++) filas[i].*campo = dc.id(c[i]);
+        };
+        auto leerColumna = [&](vector<int32_t>& col) {
+            const int32_t* c = r.columnaEntera(col.size(), ok);
+            if (ok && !col.empty()) memcpy(col.data(), c, col.size() * sizeof(int32_t));
+        };
+        auto leerFechas = [&](vector<Fecha>& col) {
+            if (r.version() >= 3) return leerColumna(col);
+            auto c = r.columnaTexto(col.size(), ok);
+            for (size_t i = 0; ok && i < col.size(); i++) ok = leerFecha(c[i], col[i]);
+        };
+        leerEnteros(a, &Autor::id);
+        leerTexto(a, &Autor::nombre);
+        leerDicc(a, &Autor::nacionalidad);
+        leerEnteros(l, &Libro::id);
+        leerTexto(l, &Libro::titulo);
+        leerTexto(l, &Libro::isbn);
+        leerEnteros(l, &Libro::ano);
+        leerEnteros(l, &Libro::id_autor);
+        leerEnteros(e, &Estudiante::id);
+        leerTexto(e, &Estudiante::nombre);
+        leerDicc(e, &Estudiante::grado);
+        leerColumna(p.id);
+        leerColumna(p.id_libro);
+        leerColumna(p.id_estudiante);
+        leerFechas(p.fecha_prestamo);
+        leerFechas(p.fecha_devolucion);
+        if (!ok) { error = "columna con tamaño inconsistente o fecha ilegible"; return false; }
+        autores = move(a);
+        libros = move(l);
+        estudiantes = move(e);
+        prestamos = move(p);
+        borradosAutores.clear();
+        borradosLibros.clear();
+        borradosEstudiantes.clear();
+        borradosPrestamos.clear();
+        pool = move(pl);
+        textoMuerto = 0;
+        dicc = move(dc);
+        reconstruirIndices();
+        if (lsn) *lsn = r.lsn();
+        return m.ok();
+    }
+
+    // Helpers: Existencia (O(1) por índice) y disponible
+    bool idAutorExiste(int id) const { return idxAutores.count(id) > 0; }
+    bool idLibroExiste(int id) const { return idxLibros.count(id) > 0; }
+    bool idEstudianteExiste(int id) const { return idxEstudiantes.count(id) > 0; }
+    bool idPrestamoExiste(int id) const { return idxPrestamos.count(id) > 0; }
+
+    // Búsqueda puntual por id; nullptr si no existe. Se invalida si el vector crece o se compacta:
+    // para guardarla más allá del próximo cambio, refAutor/refLibro/refEstudiante.
+    Autor* buscarAutor(int id) {
+        size_t pos = posicion(idxAutores, id);
+        return pos == SIZE_MAX ? nullptr : &autores[pos];
+    }
+    Libro* buscarLibro(int id) {
+        size_t pos = posicion(idxLibros, id);
+        return pos == SIZE_MAX ? nullptr : &libros[pos];
+    }
+    Estudiante* buscarEstudiante(int id) {
+        size_t pos = posicion(idxEstudiantes, id);
+        return pos == SIZE_MAX ? nullptr : &estudiantes[pos];
+    }
+    const Autor* buscarAutor(int id) const { return const_cast<DB*>(this)->buscarAutor(id); }
+    const Libro* buscarLibro(int id) const { return const_cast<DB*>(this)->buscarLibro(id); }
+    const Estudiante* buscarEstudiante(int id) const { return const_cast<DB*>(this)->buscarEstudiante(id); }
+    RefFila<Autor> refAutor(int id) const { return {autores, idxAutores, id}; }
+    RefFila<Libro> refLibro(int id) const { return {libros, idxLibros, id}; }
+    RefFila<Estudiante> refEstudiante(int id) const { return {estudiantes, idxEstudiantes, id}; }
+
+    bool libroDisponible(int id_libro) const {
+        MedirOp m(OpMedida::LibroDisponible);
+        m.ok();  // Prestado no es un fallo
+        return libroLibre(id_libro);
+    }
+    // Lo mismo sin medir, para los chequeos dentro de otras operaciones
+    bool libroLibre(int id_libro) const { return activosPorLibro.find(id_libro) == activosPorLibro.end(); }
+
+    // Texto de un update: si no cambió se queda la vista que ya tenía, sin copiarlo otra vez al pool
+    string_view textoNuevo(string_view actual, string_view nuevo) {
+        if (actual == nuevo) return actual;
+        textoMuerto += actual.size();
+        return pool.guardar(nuevo);
+    }
+
+    // CRUD Autor
+    bool addAutor(int id, string_view nombre, string_view nacionalidad) {
+        MedirOp m(OpMedida::AddAutor);
+        if (idAutorExiste(id)) return false;
+        idxAutores.emplace(id, autores.size());
+        autores.push_back(Autor{id, pool.guardar(nombre), dicc.id(nacionalidad)});
+        if (autoresEnTexto) textoAutores.agregar(id, nombre);
+        if (wal) wal->anotar(OpWAL::AddAutor, id, nombre, nacionalidad);
+        return m.ok();
+    }
+    bool updateAutor(int id, string_view nombre, string_view nac) {
+        MedirOp m(OpMedida::UpdateAutor);
+        Autor* a = buscarAutor(id);
+        if (!a) return false;
+        if (autoresEnTexto && a->nombre != nombre) textoAutores.agregar(id, nombre);
+        a->nombre = textoNuevo(a->nombre, nombre);
+        a->nacionalidad = dicc.id(nac);
+        if (wal) wal->anotar(OpWAL::UpdAutor, id, nombre, nac);
+        return m.ok();
+    }
+    bool deleteAutor(int id) {
+        MedirOp m(OpMedida::DeleteAutor);
+        // No borrar si referenciado por libros
+        if (librosPorAutor.count(id)) return false;
+        size_t pos = posicion(idxAutores, id);
+        if (pos == SIZE_MAX) return false;
+        textoMuerto += autores[pos].nombre.size();
+        borrarFila(autores, idxAutores, borradosAutores, pos);
+        if (autoresEnTexto) textoAutores.quitar(id);
+        if (wal) wal->anotar(OpWAL::DelAutor, id);
+        return m.ok();
+    }
+
+    // CRUD Libro
+    bool addLibro(int id, string_view titulo, string_view isbn, int ano, int id_autor) {
+        MedirOp m(OpMedida::AddLibro);
+        if (idLibroExiste(id)) return false;
+        if (!idAutorExiste(id_autor)) return false;
+        idxLibros.emplace(id, libros.size());
+        libros.push_back(Libro{id, pool.guardar(titulo), pool.guardar(isbn), ano, id_autor});
+        sumarLibrosAutor(id_autor, +1);
+        if (librosEnTexto) {
+            textoTitulos.agregar(id, titulo);
+            librosDeAutor[id_autor].push_back(id);
+        }
+        if (wal) wal->anotar(OpWAL::AddLibro, id, titulo, isbn, ano, id_autor);
+        return m.ok();
+    }
+    bool updateLibro(int id, string_view titulo, string_view isbn, int ano, int id_autor) {
+        MedirOp m(OpMedida::UpdateLibro);
+        Libro* l = buscarLibro(id);
+        if (!l) return false;
+        if (!idAutorExiste(id_autor)) return false;
+        if (librosEnTexto && l->titulo != titulo) textoTitulos.agregar(id, titulo);
+        l->titulo = textoNuevo(l->titulo, titulo);
+        l->isbn = textoNuevo(l->isbn, isbn);
+        l->ano = ano;
+        if (l->id_autor != id_autor) {
+            sumarLibrosAutor(l->id_autor, -1);
+            sumarLibrosAutor(id_autor, +1);
+            if (librosEnTexto) {
+                quitarLibroDeAutor(l->id_autor, id);
+                librosDeAutor[id_autor].push_back(id);
+            }
+        }
+        l->id_autor = id_autor;
+        if (wal) wal->anotar(OpWAL::UpdLibro, id, titulo, isbn, ano, id_autor);
+        return m.ok();
+    }
+    bool deleteLibro(int id) {
+        MedirOp m(OpMedida::DeleteLibro);
+        // No borrar si tiene préstamos, activos o históricos: dejarían huérfano su id_libro
+        if (prestamosPorLibro.count(id)) return false;
+        size_t pos = posicion(idxLibros, id);
+        if (pos == SIZE_MAX) return false;
+        sumarLibrosAutor(libros[pos].id_autor, -1);
+        if (librosEnTexto) {
+            textoTitulos.quitar(id);
+            quitarLibroDeAutor(libros[pos].id_autor, id);
+        }
+        textoMuerto += libros[pos].titulo.size() + libros[pos].isbn.size();
+        borrarFila(libros, idxLibros, borradosLibros, pos);
+        if (wal) wal->anotar(OpWAL::DelLibro, id);
+        return m.ok();
+    }
+
+    // CRUD Estudiante
+    bool addEstudiante(int id, string_view nombre, string_view grado) {
+        MedirOp m(OpMedida::AddEstudiante);
+        if (idEstudianteExiste(id)) return false;
+        idxEstudiantes.emplace(id, estudiantes.size());
+        estudiantes.push_back(Estudiante{id, pool.guardar(nombre), dicc.id(grado)});
+        if (wal) wal->anotar(OpWAL::AddEstudiante, id, nombre, grado);
+        return m.ok();
+    }
+    bool updateEstudiante(int id, string_view nombre, string_view grado) {
+        MedirOp m(OpMedida::UpdateEstudiante);
+        Estudiante* e = buscarEstudiante(id);
+        if (!e) return false;
+        e->nombre = textoNuevo(e->nombre, nombre);
+        e->grado = dicc.id(grado);
+        if (wal) wal->anotar(OpWAL::UpdEstudiante, id, nombre, grado);
+        return m.ok();
+    }
+    bool deleteEstudiante(int id) {
+        MedirOp m(OpMedida::DeleteEstudiante);
+        // No borrar si tiene préstamos
+        if (prestamosPorEstudiante.count(id)) return false;
+        size_t pos = posicion(idxEstudiantes, id);
+        if (pos == SIZE_MAX) return false;
+        textoMuerto += estudiantes[pos].nombre.size();
+        borrarFila(estudiantes, idxEstudiantes, borradosEstudiantes, pos);
+        if (wal) wal->anotar(OpWAL::DelEstudiante, id);
+        return m.ok();
+    }
+
+    // CRUD Préstamo (fecha_devolucion SIN_FECHA = activo)
+    bool addPrestamo(int id, int id_libro, int id_estudiante, Fecha fecha_prestamo, Fecha fecha_devolucion = SIN_FECHA) {
+        MedirOp m(OpMedida::AddPrestamo);
+        if (fecha_prestamo == SIN_FECHA) return false;
+        if (fecha_devolucion != SIN_FECHA && fecha_devolucion < fecha_prestamo) return false;  // Como en importar
+        if (idPrestamoExiste(id)) return false;
+        if (!idLibroExiste(id_libro) || !idEstudianteExiste(id_estudiante)) return false;
+        if (!libroLibre(id_libro)) return false;
+        Prestamo p{id, id_libro, id_estudiante, fecha_prestamo, fecha_devolucion};
+        idxPrestamos.emplace(id, prestamos.size());
+        prestamos.push_back(p);
+        if (p.activo()) marcarActivo(p);
+        calendario.abrir(id, fecha_prestamo);
+        if (!p.activo()) calendario.devolver(id, fecha_prestamo, fecha_devolucion, gradoActual(id_estudiante));
+        sumarRef(prestamosPorEstudiante, id_estudiante, +1);
+        sumarRef(prestamosPorLibro, id_libro, +1);
+        if (wal) wal->anotar(OpWAL::AddPrestamoDia, id, id_libro, id_estudiante, fecha_prestamo, fecha_devolucion);
+        return m.ok();
+    }
+    bool devolverPrestamo(int id_prestamo, Fecha fecha_devolucion) {
+        MedirOp m(OpMedida::DevolverPrestamo);
+        size_t pos = posicion(idxPrestamos, id_prestamo);
+        if (pos == SIZE_MAX) return false;
+        if (!prestamos.activo(pos)) return false;
+        if (fecha_devolucion == SIN_FECHA) return false;  // Significaría seguir activo
+        if (fecha_devolucion < prestamos.fecha_prestamo[pos]) return false;
+        prestamos.fecha_devolucion[pos] = fecha_devolucion;
+        desmarcarActivo(prestamos[pos]);
+        calendario.devolver(id_prestamo, prestamos.fecha_prestamo[pos], fecha_devolucion, gradoActual(prestamos.id_estudiante[pos]));
+        if (wal) wal->anotar(OpWAL::DevPrestamoDia, id_prestamo, fecha_devolucion);
+        return m.ok();
+    }
+    // Con fechas AAAA-MM-DD (menú, WAL antiguo): false también si alguna es ilegible
+    bool addPrestamo(int id, int id_libro, int id_estudiante, string_view fecha_prestamo,
+                     string_view fecha_devolucion = "") {
+        Fecha fp, fd;
+        if (!leerFecha(fecha_prestamo, fp) || !leerFecha(fecha_devolucion, fd)) return false;
+        return addPrestamo(id, id_libro, id_estudiante, fp, fd);
+    }
+    bool devolverPrestamo(int id_prestamo, string_view fecha_devolucion) {
+        Fecha f;
+        return leerFecha(fecha_devolucion, f) && devolverPrestamo(id_prestamo, f);
+    }
+    bool deletePrestamo(int id) {
+        MedirOp m(OpMedida::DeletePrestamo);
+        // Solo históricos (no activos)
+        size_t pos = posicion(idxPrestamos, id);
+        if (pos == SIZE_MAX) return false;
+        if (prestamos.activo(pos)) return false;  // Por eso nunca toca los activos
+        sumarRef(prestamosPorEstudiante, prestamos.id_estudiante[pos], -1);
+        sumarRef(prestamosPorLibro, prestamos.id_libro[pos], -1);
+        calendario.quitar(id, prestamos.fecha_prestamo[pos], prestamos.fecha_devolucion[pos]);
+        borrarFila(prestamos, idxPrestamos, borradosPrestamos, pos);
+        if (wal) wal->anotar(OpWAL::DelPrestamo, id);
+        return m.ok();
+    }
+    // Purga del histórico (fin de año): borra los préstamos devueltos antes de la fecha, cada uno
+    // como deletePrestamo y con su registro en el WAL. Los ids salen del calendario, sin barrer
+    // la tabla. Devuelve cuántos se borraron.
+    size_t purgarDevueltos(Fecha antesDe) {
+        if (antesDe == SIN_FECHA) return 0;
+        size_t n = 0;
+        for (int id : prestamosDevueltosEntre(SIN_FECHA, antesDe - 1)) n += deletePrestamo(id);
+        return n;
+    }
+
+    /*
+     * Importación en bloque: valida todo el lote en una pasada con tablas hash (ids repetidos en
+     * la DB o en el propio lote, FKs contra la DB o contra filas aceptadas del lote, un solo
+     * préstamo activo por libro) y anota todos los rechazos. Sin parcial, un rechazo deja la DB
+     * intacta; con parcial se agregan las filas aceptadas. Una fila que apunta a otra rechazada
+     * del lote también se rechaza. Lo agregado va de una vez: reservas y un solo registro en el
+     * WAL, que al reaplicarse entra entero o no entra.
+     * Las filas aceptadas entran a los índices de clave y a activosPor* ya al validarlas (con su
+     * posición final), así esas mismas búsquedas detectan repetidos y libros prestados dentro del
+     * lote; si el lote se rechaza, se sacan.
+     * Los préstamos ya devueltos no exigen que el libro esté libre (historial de un libro prestado).
+     * true si no hubo rechazos; inf.confirmado dice si se agregó algo.
+     */
+    bool importar(const LoteImportacion& lote, InformeImportacion& inf, bool parcial = false) {
+        MedirOp m(OpMedida::ImportarLote);
+        inf = InformeImportacion();
+        const size_t baseA = autores.size(), baseL = libros.size(), baseE = estudiantes.size(), baseP = prestamos.size();
+        idxAutores.reserve(baseA + lote.autores.size());
+        idxLibros.reserve(baseL + lote.libros.size());
+        idxEstudiantes.reserve(baseE + lote.estudiantes.size());
+        idxPrestamos.reserve(baseP + lote.prestamos.size());
+        unordered_set<int> rechazadosA, rechazadosL, rechazadosE;  // Solo para explicar las FK que apuntan a ellos
+        auto rechazar = [&](const char* tabla, size_t i, int id, const char* motivo) {
+            inf.rechazos.push_back({tabla, i + 1, id, motivo});
+            return false;
+        };
+        // Clave nueva: entra al índice con la posición que tendrá (la siguiente libre de la tabla)
+        auto alta = [&](const char* tabla, size_t i, int id, unordered_map<int, size_t>& idx, size_t base, size_t& aceptadas, bool legible) {
+            if (!legible) return rechazar(tabla, i, id, "campos ilegibles");
+            auto r = idx.emplace(id, base + aceptadas);
+            if (!r.second) return rechazar(tabla, i, id, r.first->second >= base ? "id repetido en el lote" : "id ya existe");
+            aceptadas++;
+            return true;
+        };
+        auto baja = [](unordered_map<int, size_t>& idx, int id) { idx.erase(id); };
+        auto referencia = [&](const char* tabla, size_t i, int id, int fk, const unordered_map<int, size_t>& idx,
+                              const unordered_set<int>& rechazados, const char* inexistente, const char* rechazada) {
+            if (idx.count(fk)) return true;
+            return rechazar(tabla, i, id, rechazados.count(fk) ? rechazada : inexistente);
+        };
+
+        vector<char> okA(lote.autores.size()), okL(lote.libros.size()), okE(lote.estudiantes.size()), okP(lote.prestamos.size());
+        for (size_t i = 0; i < lote.autores.size(); i++) {
+            auto& a = lote.autores[i];
+            okA[i] = alta("autores", i, a.id, idxAutores, baseA, inf.autores, a.legible);
+            if (!okA[i]) rechazadosA.insert(a.id);
+        }
+        for (size_t i = 0; i < lote.libros.size(); i++) {
+            auto& l = lote.libros[i];
+            okL[i] = referencia("libros", i, l.id, l.id_autor, idxAutores, rechazadosA, "autor inexistente", "autor rechazado en el lote") &&
+                     alta("libros", i, l.id, idxLibros, baseL, inf.libros, l.legible);
+            if (!okL[i]) rechazadosL.insert(l.id);
+        }
+        for (size_t i = 0; i < lote.estudiantes.size(); i++) {
+            auto& e = lote.estudiantes[i];
+            okE[i] = alta("estudiantes", i, e.id, idxEstudiantes, baseE, inf.estudiantes, e.legible);
+            if (!okE[i]) rechazadosE.insert(e.id);
+        }
+        for (size_t i = 0; i < lote.prestamos.size(); i++) {
+            auto& p = lote.prestamos[i];
+            const char* motivo = nullptr;
+            if (!p.legible) motivo = "campos ilegibles";
+            else if (p.fecha_prestamo == SIN_FECHA) motivo = "sin fecha de préstamo";
+            else if (p.fecha_devolucion != SIN_FECHA && p.fecha_devolucion < p.fecha_prestamo) motivo = "devuelto antes de prestarse";
+            else if (p.fecha_devolucion == SIN_FECHA && !libroLibre(p.id_libro)) motivo = "libro ya prestado";
+            bool ok = motivo ? rechazar("prestamos", i, p.id, motivo)
+                             : referencia("prestamos", i, p.id, p.id_libro, idxLibros, rechazadosL, "libro inexistente", "libro rechazado en el lote") &&
+                               referencia("prestamos", i, p.id, p.id_estudiante, idxEstudiantes, rechazadosE, "estudiante inexistente",
+                                          "estudiante rechazado en el lote") &&
+                               alta("prestamos", i, p.id, idxPrestamos, baseP, inf.prestamos, true);
+            okP[i] = ok;
+            if (ok && p.fecha_devolucion == SIN_FECHA) marcarActivo(Prestamo{p.id, p.id_libro, p.id_estudiante, p.fecha_prestamo, SIN_FECHA});
+        }
+        if (!inf.rechazos.empty() && !parcial) {  // Deshace las altas en los índices
+            for (size_t i = 0; i < lote.autores.size(); i++) if (okA[i]) baja(idxAutores, lote.autores[i].id);
+            for (size_t i = 0; i < lote.libros.size(); i++) if (okL[i]) baja(idxLibros, lote.libros[i].id);
+            for (size_t i = 0; i < lote.estudiantes.size(); i++) if (okE[i]) baja(idxEstudiantes, lote.estudiantes[i].id);
+            for (size_t i = 0; i < lote.prestamos.size(); i++) {
+                if (!okP[i]) continue;
+                auto& p = lote.prestamos[i];
+                baja(idxPrestamos, p.id);
+                if (p.fecha_devolucion == SIN_FECHA) desmarcarActivo(Prestamo{p.id, p.id_libro, p.id_estudiante, p.fecha_prestamo, SIN_FECHA});
+            }
+            inf.autores = inf.libros = inf.estudiantes = inf.prestamos = 0;
+            return false;
+        }
+
+        // Confirmación: nada de lo que sigue puede fallar por los datos
+        size_t total = inf.autores + inf.libros + inf.estudiantes + inf.prestamos;
+        if (total == 0) return m.ok(inf.rechazos.empty());
+        // Los índices de texto se mantienen fila a fila si el lote es chico frente a la tabla;
+        // si no, se descartan y se rearman en la próxima búsqueda
+        if (autoresEnTexto && inf.autores * 8 > baseA) descartarTextoAutores();
+        if (librosEnTexto && inf.libros * 8 > baseL) descartarTextoLibros();
+        autores.reserve(baseA + inf.autores);
+        libros.reserve(baseL + inf.libros);
+        estudiantes.reserve(baseE + inf.estudiantes);
+        prestamos.reserve(baseP + inf.prestamos);
+
+        // Cuerpo del registro Lote: cada fila con el formato de su registro Add*, con el largo delante
+        EscritorMensaje registro;
+        size_t inicioFila = 0;
+        auto fila = [&](OpWAL op) -> EscritorMensaje& {
+            inicioFila = registro.posicion();
+            return registro.entero(0).byte(uint8_t(op));
+        };
+        auto cerrarFila = [&] { registro.fijarEntero(inicioFila, int(registro.posicion() - inicioFila - 4)); };
+
+        for (size_t i = 0; i < lote.autores.size(); i++) {
+            if (!okA[i]) continue;
+            auto& a = lote.autores[i];
+            autores.push_back(Autor{a.id, pool.guardar(a.nombre), dicc.id(a.nacionalidad)});
+            if (autoresEnTexto) textoAutores.agregar(a.id, a.nombre);
+            if (wal) { fila(OpWAL::AddAutor).entero(a.id).texto(a.nombre).texto(a.nacionalidad); cerrarFila(); }
+        }
+        for (size_t i = 0; i < lote.libros.size(); i++) {
+            if (!okL[i]) continue;
+            auto& l = lote.libros[i];
+            libros.push_back(Libro{l.id, pool.guardar(l.titulo), pool.guardar(l.isbn), l.ano, l.id_autor});
+            sumarLibrosAutor(l.id_autor, +1);
+            if (librosEnTexto) {
+                textoTitulos.agregar(l.id, l.titulo);
+                librosDeAutor[l.id_autor].push_back(l.id);
+            }
+            if (wal) { fila(OpWAL::AddLibro).entero(l.id).texto(l.titulo).texto(l.isbn).entero(l.ano).entero(l.id_autor); cerrarFila(); }
+        }
+        for (size_t i = 0; i < lote.estudiantes.size(); i++) {
+            if (!okE[i]) continue;
+            auto& e = lote.estudiantes[i];
+            estudiantes.push_back(Estudiante{e.id, pool.guardar(e.nombre), dicc.id(e.grado)});
+            if (wal) { fila(OpWAL::AddEstudiante).entero(e.id).texto(e.nombre).texto(e.grado); cerrarFila(); }
+        }
+        for (size_t i = 0; i < lote.prestamos.size(); i++) {
+            if (!okP[i]) continue;
+            auto& f = lote.prestamos[i];
+            Prestamo p{f.id, f.id_libro, f.id_estudiante, f.fecha_prestamo, f.fecha_devolucion};
+            prestamos.push_back(p);
+            calendario.abrir(p.id, p.fecha_prestamo);
+            if (!p.activo()) calendario.devolver(p.id, p.fecha_prestamo, p.fecha_devolucion, gradoActual(p.id_estudiante));
+            sumarRef(prestamosPorEstudiante, p.id_estudiante, +1);
+            sumarRef(prestamosPorLibro, p.id_libro, +1);
+            if (wal) {
+                fila(OpWAL::AddPrestamoDia).entero(p.id).entero(p.id_libro).entero(p.id_estudiante).entero(p.fecha_prestamo).entero(p.fecha_devolucion);
+                cerrarFila();
+            }
+        }
+        if (wal) {
+            string filas = registro.cerrar();
+            wal->anotar(OpWAL::Lote, static_cast<int>(total), string_view(filas).substr(4));
+        }
+        inf.confirmado = true;
+        return m.ok(inf.rechazos.empty());
+    }
+
+    // Lote desde los CSV de dir que existan (autores/libros/estudiantes/prestamos.csv, con header
+    // y el formato de exportación). Las filas ilegibles quedan en el lote para que se informen.
+    static bool leerLoteCSV(const string& dir, LoteImportacion& lote, string& error) {
+        string tmp;
+        auto txt = [&](string_view c) {
+            string_view t = texto(c, tmp);
+            return t.data() == tmp.data() ? lote.textos.guardar(t) : t;  // Sin escapes: vista sobre el archivo
+        };
+        auto leer = [&](const char* nombre, int minCampos, auto fila) {
+            auto f = make_unique<ArchivoMapeado>(dir + "/" + nombre);
+            if (!f->ok()) return;
+            string_view cuerpo = sinHeader(f->texto());
+            recorrerCSVConCortas(cuerpo, minCampos, fila);
+            lote.archivos.push_back(move(f));
+        };
+        leer("autores.csv", 3, [&](const string_view* v, bool completa) {
+            LoteImportacion::FilaAutor a{0, {}, {}};
+            a.legible = completa && entero(v[0], a.id);
+            if (a.legible) a.nombre = txt(v[1]), a.nacionalidad = txt(v[2]);
+            lote.autores.push_back(a);
+        });
+        leer("libros.csv", 5, [&](const string_view* v, bool completa) {
+            LoteImportacion::FilaLibro l{0, {}, {}, 0, 0};
+            l.legible = completa && entero(v[0], l.id) && entero(v[3], l.ano) && entero(v[4], l.id_autor);
+            if (l.legible) l.titulo = txt(v[1]), l.isbn = txt(v[2]);
+            lote.libros.push_back(l);
+        });
+        leer("estudiantes.csv", 3, [&](const string_view* v, bool completa) {
+            LoteImportacion::FilaEstudiante e{0, {}, {}};
+            e.legible = completa && entero(v[0], e.id);
+            if (e.legible) e.nombre = txt(v[1]), e.grado = txt(v[2]);
+            lote.estudiantes.push_back(e);
+        });
+        leer("prestamos.csv", 5, [&](const string_view* v, bool completa) {
+            LoteImportacion::FilaPrestamo p{0, 0, 0, SIN_FECHA, SIN_FECHA};
+            p.legible = completa && entero(v[0], p.id) && entero(v[1], p.id_libro) && entero(v[2], p.id_estudiante) &&
+                        leerFecha(texto(v[3], tmp), p.fecha_prestamo) && leerFecha(texto(v[4], tmp), p.fecha_devolucion);
+            lote.prestamos.push_back(p);
+        });
+        if (lote.archivos.empty()) {
+            error = "no hay CSV en " + dir;
+            return false;
+        }
+        return true;
+    }
+
+    // Filas de un registro Lote (vistas sobre el registro)
+    static bool leerLote(LectorRegistroWAL& r, LoteImportacion& lote) {
+        int n = r.entero();
+        LectorRegistroWAL filas(r.texto());
+        for (int i = 0; r.ok() && filas.ok() && i < n; i++) {
+            string_view f = filas.texto();
+            if (f.empty()) return false;
+            LectorRegistroWAL a(f.substr(1));
+            switch (OpWAL(f[0])) {  // Llaves: los argumentos se leen en orden
+                case OpWAL::AddAutor: lote.autores.push_back({a.entero(), a.texto(), a.texto()}); break;
+                case OpWAL::AddLibro: lote.libros.push_back({a.entero(), a.texto(), a.texto(), a.entero(), a.entero()}); break;
+                case OpWAL::AddEstudiante: lote.estudiantes.push_back({a.entero(), a.texto(), a.texto()}); break;
+                case OpWAL::AddPrestamoDia: lote.prestamos.push_back({a.entero(), a.entero(), a.entero(), a.entero(), a.entero()}); break;
+                default: return false;
+            }
+            if (!a.ok()) return false;
+        }
+        return r.ok() && filas.ok();
+    }
+
+    // Reaplica un registro del WAL (con wal desactivado para no volver a anotarlo)
+    bool aplicarWAL(OpWAL op, LectorRegistroWAL r) {
+        RegistroWAL* w = wal;
+        wal = nullptr;
+        bool ok = aplicar(op, r);
+        wal = w;
+        return ok;
+    }
+    // Un cambio codificado como en el WAL (también las escrituras del modo servidor, que sí se anotan).
+    // Los argumentos se leen antes de llamar: el orden de evaluación de una llamada no está fijado.
+    bool aplicar(OpWAL op, LectorRegistroWAL& r) {
+        bool ok = false;
+        switch (op) {
+            case OpWAL::AddAutor: {
+                int id = r.entero(); string_view nombre = r.texto(), nac = r.texto();
+                ok = r.ok() && addAutor(id, nombre, nac);
+                break;
+            }
+            case OpWAL::UpdAutor: {
+                int id = r.entero(); string_view nombre = r.texto(), nac = r.texto();
+                ok = r.ok() && updateAutor(id, nombre, nac);
+                break;
+            }
+            case OpWAL::DelAutor: { int id = r.entero(); ok = r.ok() && deleteAutor(id); break; }
+            case OpWAL::AddLibro: {
+                int id = r.entero(); string_view titulo = r.texto(), isbn = r.texto();
+                int ano = r.entero(), id_autor = r.entero();
+                ok = r.ok() && addLibro(id, titulo, isbn, ano, id_autor);
+                break;
+            }
+            case OpWAL::UpdLibro: {
+                int id = r.entero(); string_view titulo = r.texto(), isbn = r.texto();
+                int ano = r.entero(), id_autor = r.entero();
+                ok = r.ok() && updateLibro(id, titulo, isbn, ano, id_autor);
+                break;
+            }
+            case OpWAL::DelLibro: { int id = r.entero(); ok = r.ok() && deleteLibro(id); break; }
+            case OpWAL::AddEstudiante: {
+                int id = r.entero(); string_view nombre = r.texto(), grado = r.texto();
+                ok = r.ok() && addEstudiante(id, nombre, grado);
+                break;
+            }
+            case OpWAL::UpdEstudiante: {
+                int id = r.entero(); string_view nombre = r.texto(), grado = r.texto();
+                ok = r.ok() && updateEstudiante(id, nombre, grado);
+                break;
+            }
+            case OpWAL::DelEstudiante: { int id = r.entero(); ok = r.ok() && deleteEstudiante(id); break; }
+            case OpWAL::AddPrestamo: {
+                int id = r.entero(), id_libro = r.entero(), id_est = r.entero();
+                string_view fp = r.texto(), fd = r.texto();
+                ok = r.ok() && addPrestamo(id, id_libro, id_est, fp, fd);
+                break;
+            }
+            case OpWAL::DevPrestamo: {
+                int id = r.entero(); string_view fecha = r.texto();
+                ok = r.ok() && devolverPrestamo(id, fecha);
+                break;
+            }
+            case OpWAL::DelPrestamo: { int id = r.entero(); ok = r.ok() && deletePrestamo(id); break; }
+            case OpWAL::AddPrestamoDia: {
+                int id = r.entero(), id_libro = r.entero(), id_est = r.entero();
+                Fecha fp = r.entero(), fd = r.entero();
+                ok = r.ok() && addPrestamo(id, id_libro, id_est, fp, fd);
+                break;
+            }
+            case OpWAL::DevPrestamoDia: {
+                int id = r.entero(); Fecha fecha = r.entero();
+                ok = r.ok() && devolverPrestamo(id, fecha);
+                break;
+            }
+            case OpWAL::Lote: {
+                LoteImportacion lote;
+                ok = leerLote(r, lote);
+                InformeImportacion inf;
+                ok = ok && importar(lote, inf);
+                break;
+            }
+        }
+        return ok;
+    }
+
+    // Consultas
+    // Libro de un préstamo activo (vistas sobre el pool: siguen valiendo tras más altas)
+    struct LibroPrestado {
+        int id_prestamo;
+        int id_libro;
+        string_view titulo;
+        string_view isbn;
+        Fecha fecha_prestamo;
+    };
+
+    // Junta préstamo (posición en la tabla) y libro por idxLibros; false si el libro no existe
+    bool libroPrestado(size_t pos, LibroPrestado& out) const {
+        size_t l = posicion(idxLibros, prestamos.id_libro[pos]);
+        if (l == SIZE_MAX) return false;
+        out = LibroPrestado{prestamos.id[pos], libros[l].id, libros[l].titulo, libros[l].isbn, prestamos.fecha_prestamo[pos]};
+        return true;
+    }
+
+    // Un estudiante: sus activos salen del índice, cada libro de idxLibros (O(préstamos del estudiante))
+    vector<LibroPrestado> librosPrestadosPorEstudiante(int id_est) const {
+        MedirOp m(OpMedida::LibrosPrestadosEstudiante);
+        m.ok();
+        return prestadosDe(id_est);
+    }
+    vector<LibroPrestado> prestadosDe(int id_est) const {
+        vector<LibroPrestado> res;
+        auto act = activosPorEstudiante.find(id_est);
+        if (act == activosPorEstudiante.end()) return res;
+        res.reserve(act->second.size());
+        LibroPrestado lp;
+        for (int id_p : act->second) if (libroPrestado(idxPrestamos.at(id_p), lp)) res.push_back(lp);
+        return res;
+    }
+
+    // Muchos estudiantes a la vez (avisos nocturnos): res[k] son los de ids[k]. Cada id distinto se
+    // resuelve una vez por activosPorEstudiante, que ya separa los activos: sale más barato que
+    // una pasada por toda la tabla de préstamos, históricos incluidos.
+    vector<vector<LibroPrestado>> librosPrestadosPorEstudiantes(const vector<int>& ids) const {
+        MedirOp m(OpMedida::LibrosPrestadosEstudiantes);
+        m.ok();
+        vector<vector<LibroPrestado>> res(ids.size());
+        unordered_map<int, size_t> primero;  // id_estudiante -> primera k con ese id
+        primero.reserve(ids.size());
+        for (size_t k = 0; k < ids.size(); k++) {
+            auto r = primero.emplace(ids[k], k);
+            if (r.second) res[k] = prestadosDe(ids[k]);
+            else res[k] = res[r.first->second];
+        }
+        return res;
+    }
+
+    static void imprimir(const LibroPrestado& lp) {
+        cout << " - [" << lp.id_libro << "] " << lp.titulo << " (ISBN " << lp.isbn << ") prestado el " << textoFecha(lp.fecha_prestamo) << "\n";
+    }
+    void listarLibrosPrestadosPorEstudiante(int id_est) const {
+        cout << "Libros prestados (activos) por estudiante " << id_est << ":\n";
+        for (auto& lp : librosPrestadosPorEstudiante(id_est)) imprimir(lp);
+    }
+    void listarLibrosPrestadosPorEstudiantes(const vector<int>& ids) const {
+        auto res = librosPrestadosPorEstudiantes(ids);
+        for (size_t k = 0; k < ids.size(); k++) {
+            cout << "Libros prestados (activos) por estudiante " << ids[k] << ":\n";
+            for (auto& lp : res[k]) imprimir(lp);
+        }
+    }
+
+    // Libros por título o por nombre de autor (exacto, prefijo, subcadena o parecido, sin
+    // mayúsculas ni tildes), los max mejores primero. Un libro que coincide por las dos vías
+    // queda con el mejor puntaje.
+    struct LibroEncontrado {
+        int id_libro;
+        int puntaje;
+        bool porAutor;  // El puntaje vino del nombre del autor
+    };
+    vector<LibroEncontrado> buscarLibrosPorTexto(string_view consulta, size_t max = 20) {
+        prepararTexto();
+        return buscarEnTexto(consulta, max);
+    }
+    // Lo mismo sin armar los índices de texto (lectores concurrentes): requiere textoPreparado()
+    bool textoPreparado() const { return autoresEnTexto && librosEnTexto; }
+    vector<LibroEncontrado> buscarEnTexto(string_view consulta, size_t max = 20) const {
+        unordered_map<int, LibroEncontrado> mejor;
+        for (auto& r : textoTitulos.buscar(consulta, max)) mejor.emplace(r.id, LibroEncontrado{r.id, r.puntaje, false});
+        for (auto& r : textoAutores.buscar(consulta, max)) {
+            auto libs = librosDeAutor.find(r.id);
+            if (libs == librosDeAutor.end()) continue;
+            for (int id_libro : libs->second) {
+                auto it = mejor.emplace(id_libro, LibroEncontrado{id_libro, r.puntaje, true}).first;
+                if (it->second.puntaje < r.puntaje) it->second = LibroEncontrado{id_libro, r.puntaje, true};
+            }
+        }
+        vector<LibroEncontrado> res;
+        res.reserve(mejor.size());
+        for (auto& m : mejor) res.push_back(m.second);
+        auto antes = [](const LibroEncontrado& a, const LibroEncontrado& b) {
+            if (a.puntaje != b.puntaje) return a.puntaje > b.puntaje;
+            if (a.porAutor != b.porAutor) return !a.porAutor;
+            return a.id_libro < b.id_libro;
+        };
+        size_t k = min(max, res.size());
+        partial_sort(res.begin(), res.begin() + static_cast<ptrdiff_t>(k), res.end(), antes);
+        res.resize(k);
+        return res;
+    }
+    void listarBusquedaLibros(string_view consulta, size_t max = 20) {
+        prepararTexto();
+        listarEncontrados(consulta, buscarEnTexto(consulta, max));
+    }
+    void listarEncontrados(string_view consulta, const vector<LibroEncontrado>& res) const {
+        cout << "Resultados para \"" << consulta << "\":\n";
+        if (res.empty()) cout << " (ninguno)\n";
+        for (auto& r : res) {
+            const Libro& l = libros[idxLibros.at(r.id_libro)];
+            size_t pa = posicion(idxAutores, l.id_autor);
+            cout << " - [" << l.id << "] " << l.titulo << " | ";
+            if (pa != SIZE_MAX) cout << autores[pa].nombre;
+            else cout << "Autor#" << l.id_autor;
+            cout << " | " << l.ano << (r.porAutor ? " (por autor)" : "") << "\n";
+        }
+    }
+
+    // Análisis por fechas sobre el calendario: cada consulta recorre solo los días del rango.
+    // Ids de los préstamos iniciados / devueltos entre desde y hasta (inclusive), por día
+    vector<int> prestamosIniciadosEntre(Fecha desde, Fecha hasta) const {
+        vector<int> res;
+        calendario.recorrer(desde, hasta, [&](Fecha, const CalendarioPrestamos::Dia& d) {
+            res.insert(res.end(), d.abiertos.begin(), d.abiertos.end());
+        });
+        return res;
+    }
+    vector<int> prestamosDevueltosEntre(Fecha desde, Fecha hasta) const {
+        vector<int> res;
+        calendario.recorrer(desde, hasta, [&](Fecha, const CalendarioPrestamos::Dia& d) {
+            for (auto& x : d.devueltos) res.push_back(x.id);
+        });
+        return res;
+    }
+
+    struct ResumenPeriodo {
+        Fecha desde, hasta;
+        int64_t iniciados = 0, devueltos = 0;
+        int64_t diasDevueltos = 0;  // Suma de la duración de los devueltos en el periodo
+        int64_t activosAlCierre = 0, maxActivos = 0;
+        double duracionMedia() const { return devueltos ? double(diasDevueltos) / double(devueltos) : 0; }
+    };
+    // Un resumen por día de [desde, hasta], también los días sin movimientos
+    vector<ResumenPeriodo> serieDiaria(Fecha desde, Fecha hasta) const {
+        vector<ResumenPeriodo> res;
+        if (desde == SIN_FECHA || hasta < desde) return res;
+        res.reserve(size_t(hasta - desde) + 1);
+        int64_t activos = calendario.activosAntesDe(desde);
+        for (Fecha f = desde; f <= hasta && f >= desde; f++) res.push_back({f, f, 0, 0, 0, activos, activos});
+        calendario.recorrer(desde, hasta, [&](Fecha f, const CalendarioPrestamos::Dia& d) {
+            ResumenPeriodo& r = res[size_t(f - desde)];
+            r.iniciados = int64_t(d.abiertos.size());
+            r.devueltos = int64_t(d.devueltos.size());
+            r.diasDevueltos = d.diasDevueltos;
+        });
+        for (auto& r : res) {
+            activos += r.iniciados - r.devueltos;
+            r.activosAlCierre = r.maxActivos = activos;
+        }
+        return res;
+    }
+    // Lo mismo juntado por mes calendario (el primero y el último pueden quedar cortados)
+    vector<ResumenPeriodo> serieMensual(Fecha desde, Fecha hasta) const {
+        vector<ResumenPeriodo> res;
+        int mesActual = -1;
+        for (auto& d : serieDiaria(desde, hasta)) {
+            int a, m, dd;
+            fechaDeDia(d.desde, a, m, dd);
+            if (a * 12 + m != mesActual) {
+                mesActual = a * 12 + m;
+                res.push_back({d.desde, d.desde, 0, 0, 0, 0, 0});
+            }
+            ResumenPeriodo& r = res.back();
+            r.hasta = d.hasta;
+            r.iniciados += d.iniciados;
+            r.devueltos += d.devueltos;
+            r.diasDevueltos += d.diasDevueltos;
+            r.activosAlCierre = d.activosAlCierre;
+            r.maxActivos = max(r.maxActivos, d.activosAlCierre);
+        }
+        return res;
+    }
+
+    // Duración media de los préstamos devueltos en [desde, hasta], por grado del estudiante al devolver
+    struct DuracionGrado {
+        string_view grado;
+        int64_t devueltos = 0, dias = 0;
+        double media() const { return devueltos ? double(dias) / double(devueltos) : 0; }
+    };
+    vector<DuracionGrado> duracionPorGrado(Fecha desde, Fecha hasta) const {
+        unordered_map<uint32_t, DuracionGrado> porGrado;
+        calendario.recorrer(desde, hasta, [&](Fecha, const CalendarioPrestamos::Dia& d) {
+            for (auto& g : d.porGrado) {
+                DuracionGrado& r = porGrado.emplace(g.grado, DuracionGrado{dicc.texto(g.grado)}).first->second;
+                r.devueltos += g.devueltos;
+                r.dias += g.dias;
+            }
+        });
+        vector<DuracionGrado> res;
+        for (auto& kv : porGrado) res.push_back(kv.second);
+        sort(res.begin(), res.end(), [](auto& a, auto& b) { return a.grado < b.grado; });
+        return res;
+    }
+
+    void informePrestamos(Fecha desde, Fecha hasta) const {
+        cout << "Préstamos del " << textoFecha(desde) << " al " << textoFecha(hasta) << " (por mes):\n";
+        for (auto& r : serieMensual(desde, hasta)) {
+            cout << " - " << textoFecha(r.desde) << " a " << textoFecha(r.hasta) << ": " << r.iniciados << " iniciados, "
+                 << r.devueltos << " devueltos (media " << r.duracionMedia() << " días), " << r.activosAlCierre
+                 << " activos al cierre, máximo " << r.maxActivos << "\n";
+        }
+        cout << "Duración media por grado (devueltos en el periodo):\n";
+        for (auto& g : duracionPorGrado(desde, hasta))
+            cout << " - " << (g.grado.empty() ? "(sin grado)" : g.grado) << ": " << g.media() << " días (" << g.devueltos << " préstamos)\n";
+    }
+
+    // Top N {id_autor, libros}: lectura de los N primeros de rankingAutores, sin recontar
+    vector<pair<int, int>> topAutores(int topN) const {
+        MedirOp m(OpMedida::TopAutores);
+        m.ok();
+        vector<pair<int, int>> res;
+        for (auto it = rankingAutores.begin(); it != rankingAutores.end() && int(res.size()) < topN; ++it)
+            res.emplace_back(it->second, -it->first);
+        return res;
+    }
+
+    // Lo mismo recontando desde libros (para consultas ad hoc o para comprobar el ranking):
+    // selección parcial de los N primeros en vez de ordenar todos los autores
+    vector<pair<int, int>> topAutoresRecalculado(int topN) const {
+        unordered_map<int, int> cnt = contarReferencias(libros, &Libro::id_autor, borradosLibros);
+        vector<pair<int, int>> v;
+        v.reserve(cnt.size());
+        for (auto& kv : cnt) v.emplace_back(-kv.second, kv.first);
+        size_t n = min(v.size(), size_t(max(0, topN)));
+        partial_sort(v.begin(), v.begin() + static_cast<ptrdiff_t>(n), v.end());
+        vector<pair<int, int>> res;
+        for (size_t i = 0; i < n; i++) res.emplace_back(v[i].second, -v[i].first);
+        return res;
+    }
+
+    void rankingAutoresPorCantidadLibros(int topN = 10) const {
+        cout << "Autores con mas libros:\n";
+        for (auto& pr : topAutores(topN)) {
+            size_t pos = posicion(idxAutores, pr.first);
+            if (pos != SIZE_MAX) cout << " - " << autores[pos].nombre;
+            else cout << " - Autor#" << pr.first;
+            cout << " : " << pr.second << "\n";
+        }
+    }
+
+    /*
+     * Listados para Read, por páginas: desde filas saltadas y limite filas, o un cursor (keyset)
+     * despuesDe = id de la última fila de la página anterior, que no se corre si se agregan o
+     * borran filas entre páginas. Órdenes:
+     *  - Tabla: el de inserción. El cursor se ubica por el índice de clave: O(limite) por página.
+     *  - Id: por id. Sin índice ordenado, cada página es una pasada con los desde+limite menores
+     *    en un heap (O(filas · log(desde+limite))); el cursor no necesita que ese id exista.
+     *  - Fecha: solo préstamos, por fecha de préstamo y luego id, día a día por el calendario.
+     */
+    enum class OrdenListado { Tabla, Id, Fecha };
+    struct Pagina {
+        OrdenListado orden = OrdenListado::Tabla;
+        size_t desde = 0;          // Filas a saltar (después del cursor, si hay)
+        size_t limite = SIZE_MAX;
+        bool conCursor = false;
+        int despuesDe = 0;
+    };
+    // Filas de una página: un tramo [inicio, fin) de la tabla (orden Tabla) o posiciones sueltas
+    struct FilasPagina {
+        size_t inicio = 0, fin = 0;
+        vector<uint32_t> posiciones;
+        const Lapidas* borradas = nullptr;  // El tramo salta las borradas
+        bool hayMas = false;
+        template <class F>
+        void recorrer(F f) const {
+            if (posiciones.empty()) {
+                for (size_t i = inicio; i < fin; i++)
+                    if (!borradas || !borradas->borrada(i)) f(i);
+            } else {
+                for (uint32_t i : posiciones) f(size_t(i));
+            }
+        }
+        bool vacia() const { return posiciones.empty() && inicio == fin; }
+    };
+
+    template <class T>
+    static int idEnFila(const vector<T>& t, size_t i) { return t[i].id; }
+    static int idEnFila(const TablaPrestamos& t, size_t i) { return t.id[i]; }
+
+    template <class Tabla>
+    bool paginar(const Tabla& t, const unordered_map<int, size_t>& idx, const Lapidas& borradas, const Pagina& p, FilasPagina& res,
+                 string& error) const {
+        size_t n = t.size();
+        res.borradas = &borradas;
+        if (p.orden == OrdenListado::Tabla) {
+            size_t inicio = 0;
+            if (p.conCursor) {
+                size_t pos = posicion(idx, p.despuesDe);
+                if (pos == SIZE_MAX) {
+                    error = "no hay fila con id " + to_string(p.despuesDe) + " para seguir desde ella";
+                    return false;
+                }
+                inicio = pos + 1;
+            }
+            res.inicio = borradas.siguienteViva(borradas.saltarVivas(inicio, p.desde, n), n);
+            res.fin = borradas.saltarVivas(res.inicio, p.limite, n);
+            res.hayMas = borradas.siguienteViva(res.fin, n) < n;
+            return true;
+        }
+        if (p.orden != OrdenListado::Id) {
+            error = "esta tabla solo se ordena por id o por inserción";
+            return false;
+        }
+        // Los desde + limite + 1 menores pasado el cursor (el de más dice si hay otra página)
+        size_t k = p.limite >= n || p.desde >= n - min(n, p.limite) ? n + 1 : p.desde + p.limite + 1;
+        vector<pair<int, uint32_t>> sel;
+        sel.reserve(min(k, n));
+        for (size_t i = 0; i < n; i++) {
+            int id = idEnFila(t, i);
+            if ((p.conCursor && id <= p.despuesDe) || borradas.borrada(i)) continue;
+            if (sel.size() < k) {
+                sel.emplace_back(id, uint32_t(i));
+                if (sel.size() == k) make_heap(sel.begin(), sel.end());
+            } else if (id < sel.front().first) {
+                pop_heap(sel.begin(), sel.end());
+                sel.back() = {id, uint32_t(i)};
+                push_heap(sel.begin(), sel.end());
+            }
+        }
+        sort(sel.begin(), sel.end());
+        size_t desde = min(p.desde, sel.size()), hasta = sel.size() - desde > p.limite ? desde + p.limite : sel.size();
+        for (size_t i = desde; i < hasta; i++) res.posiciones.push_back(sel[i].second);
+        res.hayMas = hasta < sel.size();
+        return true;
+    }
+
+    bool paginarPrestamosPorFecha(const Pagina& p, FilasPagina& res, string& error) const {
+        Fecha desdeDia = SIN_FECHA;
+        if (p.conCursor) {
+            size_t pos = posicion(idxPrestamos, p.despuesDe);
+            if (pos == SIZE_MAX) {
+                error = "no hay préstamo con id " + to_string(p.despuesDe) + " para seguir desde él";
+                return false;
+            }
+            desdeDia = prestamos.fecha_prestamo[pos];
+        }
+        size_t saltar = p.desde;
+        vector<int> ids;
+        calendario.recorrerDesde(desdeDia, [&](Fecha f, const CalendarioPrestamos::Dia& d) {
+            ids.assign(d.abiertos.begin(), d.abiertos.end());
+            sort(ids.begin(), ids.end());
+            for (int id : ids) {
+                if (p.conCursor && f == desdeDia && id <= p.despuesDe) continue;
+                if (saltar) {
+                    saltar--;
+                    continue;
+                }
+                if (res.posiciones.size() == p.limite) {
+                    res.hayMas = true;
+                    return false;
+                }
+                res.posiciones.push_back(uint32_t(idxPrestamos.at(id)));
+            }
+            return true;
+        });
+        return true;
+    }
+
+    void escribirLibro(SalidaListado& out, size_t i) const {
+        const Libro& l = libros[i];
+        out << '[' << l.id << "] " << l.titulo << " | ISBN " << l.isbn << " | " << l.ano << " | autor " << l.id_autor;
+        out.finFila();
+    }
+    void escribirAutor(SalidaListado& out, size_t i) const {
+        const Autor& a = autores[i];
+        out << '[' << a.id << "] " << a.nombre << " (" << dicc.texto(a.nacionalidad) << ')';
+        out.finFila();
+    }
+    void escribirEstudiante(SalidaListado& out, size_t i) const {
+        const Estudiante& e = estudiantes[i];
+        out << '[' << e.id << "] " << e.nombre << " - " << dicc.texto(e.grado);
+        out.finFila();
+    }
+    void escribirPrestamo(SalidaListado& out, size_t i) const {
+        out << '[' << prestamos.id[i] << "] Libro " << prestamos.id_libro[i] << " a Est " << prestamos.id_estudiante[i] << " (";
+        out.fecha(prestamos.fecha_prestamo[i]);
+        if (prestamos.activo(i)) out << " - ACTIVO)";
+        else {
+            out << " - Devuelto ";
+            out.fecha(prestamos.fecha_devolucion[i]) << ')';
+        }
+        out.finFila();
+    }
+
+    // Una página de tabla ("libros", "autores", "estudiantes" o "prestamos") con su título; si
+    // quedan filas, al final dice cómo pedir la siguiente. false (y error) si no se pudo armar.
+    bool listar(string_view tabla, const Pagina& p, SalidaListado& out, string& error) const {
+        FilasPagina filas;
+        auto escribir = [&](const char* titulo, auto escribirFila, auto idEn) {
+            out << titulo;
+            out.finFila();
+            filas.recorrer([&](size_t i) { (this->*escribirFila)(out, i); });
+            if (filas.hayMas && !filas.vacia()) {
+                size_t ultima = 0;
+                filas.recorrer([&](size_t i) { ultima = i; });
+                out << "(hay más: siguiente página con despues=" << idEn(ultima) << ')';
+                out.finFila();
+            }
+            return true;
+        };
+        if (tabla == "libros")
+            return paginar(libros, idxLibros, borradosLibros, p, filas, error) &&
+                   escribir("Libros:", &DB::escribirLibro, [&](size_t i) { return libros[i].id; });
+        if (tabla == "autores")
+            return paginar(autores, idxAutores, borradosAutores, p, filas, error) &&
+                   escribir("Autores:", &DB::escribirAutor, [&](size_t i) { return autores[i].id; });
+        if (tabla == "estudiantes")
+            return paginar(estudiantes, idxEstudiantes, borradosEstudiantes, p, filas, error) &&
+                   escribir("Estudiantes:", &DB::escribirEstudiante, [&](size_t i) { return estudiantes[i].id; });
+        if (tabla == "prestamos") {
+            bool ok = p.orden == OrdenListado::Fecha ? paginarPrestamosPorFecha(p, filas, error)
+                                                       : paginar(prestamos, idxPrestamos, borradosPrestamos, p, filas, error);
+            return ok && escribir("Préstamos:", &DB::escribirPrestamo, [&](size_t i) { return prestamos.id[i]; });
+        }
+        error = "tabla desconocida: " + string(tabla);
+        return false;
+    }
+
+    // Las tablas enteras en orden de inserción, como siempre
+    void listarTodo(string_view tabla) const {
+        SalidaListado out(stdout);
+        string error;
+        listar(tabla, Pagina(), out, error);
+    }
+    void listarLibros() const { listarTodo("libros"); }
+    void listarAutores() const { listarTodo("autores"); }
+    void listarEstudiantes() const { listarTodo("estudiantes"); }
+    void listarPrestamos() const { listarTodo("prestamos"); }
+
+    // Filas y memoria estimada por tabla: su vector y los índices que cuelgan de ella. "textos" son
+    // el pool y el diccionario (filas: valores distintos); "busqueda", los índices de texto si están armados.
+    struct UsoTabla {
+        const char* tabla;
+        size_t filas, bytes;
+        size_t borradas = 0;  // Lápidas aún sin compactar (ocupan su lugar en bytes)
+        size_t bytesMuertos = 0;  // Textos: lo que ya no usa ninguna fila (incluido en bytes)
+    };
+    vector<UsoTabla> usoMemoria() const {
+        auto listas = [](const unordered_map<int, vector<int>>& m) {
+            size_t b = bytesTablaHash(m);
+            for (auto& kv : m) b += kv.second.capacity() * sizeof(int);
+            return b;
+        };
+        size_t columnas = (prestamos.id.capacity() + prestamos.id_libro.capacity() + prestamos.id_estudiante.capacity()) * sizeof(int) +
+                          (prestamos.fecha_prestamo.capacity() + prestamos.fecha_devolucion.capacity()) * sizeof(Fecha);
+        size_t ranking = rankingAutores.size() * (sizeof(pair<int, int>) + 4 * sizeof(void*));
+        return {
+            {"autores", autores.size() - borradosAutores.size(),
+             autores.capacity() * sizeof(Autor) + bytesTablaHash(idxAutores) + bytesTablaHash(librosPorAutor) + ranking + borradosAutores.bytes(),
+             borradosAutores.size()},
+            {"libros", libros.size() - borradosLibros.size(),
+             libros.capacity() * sizeof(Libro) + bytesTablaHash(idxLibros) + bytesTablaHash(prestamosPorLibro) + listas(activosPorLibro) +
+                 borradosLibros.bytes(),
+             borradosLibros.size()},
+            {"estudiantes", estudiantes.size() - borradosEstudiantes.size(),
+             estudiantes.capacity() * sizeof(Estudiante) + bytesTablaHash(idxEstudiantes) + bytesTablaHash(prestamosPorEstudiante) +
+                 listas(activosPorEstudiante) + borradosEstudiantes.bytes(),
+             borradosEstudiantes.size()},
+            {"prestamos", prestamos.size() - borradosPrestamos.size(),
+             columnas + bytesTablaHash(idxPrestamos) + calendario.bytes() + borradosPrestamos.bytes(), borradosPrestamos.size()},
+            {"textos", dicc.size(), pool.bytesReservados() + dicc.bytes(), 0, textoMuerto},
+            {"busqueda", textoAutores.size() + textoTitulos.size(), textoAutores.bytes() + textoTitulos.bytes() + listas(librosDeAutor)},
+        };
+    }
+};
+
+
+/*
+ * Consultas ad hoc sobre las cuatro tablas: filtros sobre cualquier columna, joins por las FK
+ * (préstamo -> libro -> autor, préstamo -> estudiante), agrupación con conteo y orden con límite.
+ * Las columnas se nombran tabla.campo ("libro.titulo"); las de otra tabla se alcanzan desde la
+ * tabla base siguiendo las FK (join interno: filas con FK rota no salen).
+ * Plan: filtro por id -> índice de clave; préstamos activos de un libro/estudiante -> activosPor*;
+ * resto de filtros sobre préstamos -> barrido columna a columna; si no, barrido de la tabla.
+ */
+enum class TablaConsulta : uint8_t { Autor, Libro, Estudiante, Prestamo };
+enum class OpFiltro : uint8_t { Igual, Distinto, Menor, MenorIgual, Mayor, MayorIgual, Contiene };
+
+struct FiltroConsulta {
+    string columna;
+    OpFiltro op;
+    string valor;  // Como en el CSV: número, AAAA-MM-DD ("" = sin fecha) o texto
+};
+
+struct Consulta {
+    TablaConsulta desde;
+    vector<FiltroConsulta> donde;  // Se tienen que cumplir todos
+    vector<string> columnas;       // Vacío: las de la tabla base
+    string agruparPor;             // Si está: filas {valor, cantidad}
+    string ordenarPor;             // Columna (o "cantidad" al agrupar); vacío: orden de la tabla
+    bool descendente = false;
+    size_t limite = SIZE_MAX;
+};
+
+struct ResultadoConsulta {
+    vector<string> columnas;
+    vector<vector<string>> filas;
+    string plan;             // Acceso elegido, para ver si se usó un índice
+    size_t examinadas = 0;   // Filas de la tabla base revisadas
+};
+
+class MotorConsultas {
+public:
+    explicit MotorConsultas(const DB& base) : db(base) {}
+
+    // false (y el motivo en error) si la consulta nombra columnas u operaciones que no existen
+    bool ejecutar(const Consulta& q, ResultadoConsulta& res, string& error) const {
+        res = ResultadoConsulta();
+        int base = static_cast<int>(q.desde);
+        unsigned usadas = 1u << base;
+        vector<Filtro> filtros;
+        for (auto& f : q.donde) {
+            Filtro c;
+            if (!compilarFiltro(f, c, error)) return false;
+            usadas |= 1u << TABLA[c.col];
+            filtros.push_back(move(c));
+        }
+        vector<int> proy;
+        if (q.columnas.empty() && q.agruparPor.empty()) {
+            for (int c = 0; c < N_COLUMNAS; c++) if (TABLA[c] == base) proy.push_back(c);
+        }
+        for (auto& nombre : q.columnas) {
+            int c = columna(nombre, error);
+            if (c < 0) return false;
+            proy.push_back(c);
+        }
+        int grupo = -1, orden = -1;
+        bool ordenCantidad = !q.agruparPor.empty() && q.ordenarPor == "cantidad";
+        if (!q.agruparPor.empty() && (grupo = columna(q.agruparPor, error)) < 0) return false;
+        if (!q.ordenarPor.empty() && !ordenCantidad && (orden = columna(q.ordenarPor, error)) < 0) return false;
+        if (grupo >= 0 && orden >= 0 && orden != grupo) {
+            error = "al agrupar solo se ordena por la columna agrupada o por cantidad";
+            return false;
+        }
+        for (int c : proy) usadas |= 1u << TABLA[c];
+        if (grupo >= 0) usadas |= 1u << TABLA[grupo];
+        if (orden >= 0) usadas |= 1u << TABLA[orden];
+        if (usadas & ~ALCANZABLES[base]) {
+            error = string("columna de una tabla que no se alcanza desde ") + NOMBRE_TABLA[base];
+            return false;
+        }
+
+        // Al agrupar se cuenta al vuelo, sin guardar las filas
+        if (grupo >= 0) {
+            Grupos grupos;
+            recorrer(q.desde, filtros, usadas, res, [&](const Fila& f) {
+                grupos.sumar(TIPO[grupo] == TEXTO && !delDiccionario(grupo), valor(grupo, f));
+                return true;
+            });
+            emitirGrupos(grupos, grupo, ordenCantidad, orden >= 0, q.descendente, q.limite, res);
+            return true;
+        }
+        // Sin orden se puede cortar en cuanto se llega al límite
+        vector<Fila> filas;
+        recorrer(q.desde, filtros, usadas, res, [&](const Fila& f) {
+            filas.push_back(f);
+            return orden >= 0 || filas.size() < q.limite;
+        });
+        if (orden >= 0) ordenar(filas, orden, q.descendente, q.limite);
+        if (filas.size() > q.limite) filas.resize(q.limite);
+        for (int c : proy) res.columnas.push_back(NOMBRE[c]);
+        res.filas.reserve(filas.size());
+        for (auto& f : filas) {
+            vector<string> fila;
+            fila.reserve(proy.size());
+            for (int c : proy) fila.push_back(texto(c, valor(c, f)));
+            res.filas.push_back(move(fila));
+        }
+        return true;
+    }
+
+private:
+    const DB& db;
+
+    // Catálogo de columnas: nombre, tabla y tipo (las fechas se comparan como nº de día)
+    enum Col { A_ID, A_NOMBRE, A_NAC, L_ID, L_TITULO, L_ISBN, L_ANO, L_AUTOR, E_ID, E_NOMBRE, E_GRADO,
+               P_ID, P_LIBRO, P_EST, P_FECHA, P_DEV, N_COLUMNAS };
+    enum Tipo { ENTERO, FECHA, TEXTO };
+    static constexpr const char* NOMBRE[N_COLUMNAS] = {
+        "autor.id", "autor.nombre", "autor.nacionalidad",
+        "libro.id", "libro.titulo", "libro.isbn", "libro.ano", "libro.id_autor",
+        "estudiante.id", "estudiante.nombre", "estudiante.grado",
+        "prestamo.id", "prestamo.id_libro", "prestamo.id_estudiante", "prestamo.fecha_prestamo", "prestamo.fecha_devolucion"};
+    static constexpr int TABLA[N_COLUMNAS] = {0, 0, 0, 1, 1, 1, 1, 1, 2, 2, 2, 3, 3, 3, 3, 3};
+    static constexpr Tipo TIPO[N_COLUMNAS] = {ENTERO, TEXTO, TEXTO, ENTERO, TEXTO, TEXTO, ENTERO, ENTERO,
+                                              ENTERO, TEXTO, TEXTO, ENTERO, ENTERO, ENTERO, FECHA, FECHA};
+    static constexpr const char* NOMBRE_TABLA[4] = {"autores", "libros", "estudiantes", "prestamos"};
+    // Tablas que se alcanzan por FK desde cada tabla base (bit = TablaConsulta)
+    static constexpr unsigned ALCANZABLES[4] = {0b0001, 0b0011, 0b0100, 0b1111};
+
+    struct Valor {
+        int64_t n = 0;   // En columnas del diccionario, el id del texto
+        string_view t;
+    };
+    struct Filtro {
+        int col;
+        OpFiltro op;
+        int64_t n = 0;
+        string t;            // Literal de texto
+        bool hecho = false;  // Ya lo resolvió el acceso (índice o barrido por columnas)
+    };
+    // Posición de la fila en cada tabla (SIZE_MAX: no hace falta en esta consulta)
+    struct Fila {
+        size_t pos[4] = {SIZE_MAX, SIZE_MAX, SIZE_MAX, SIZE_MAX};
+    };
+
+    static int columna(const string& nombre, string& error) {
+        for (int c = 0; c < N_COLUMNAS; c++) if (nombre == NOMBRE[c]) return c;
+        error = "columna desconocida: " + nombre;
+        return -1;
+    }
+
+    // Textos repetidos guardados como id de Diccionario: se agrupan por id, sin hashear el texto
+    static bool delDiccionario(int c) { return c == A_NAC || c == E_GRADO; }
+
+    static bool compilarFiltro(const FiltroConsulta& f, Filtro& c, string& error) {
+        if ((c.col = columna(f.columna, error)) < 0) return false;
+        c.op = f.op;
+        if (TIPO[c.col] == TEXTO) {
+            c.t = f.valor;
+            return true;
+        }
+        if (f.op == OpFiltro::Contiene) {
+            error = "'contiene' solo aplica a columnas de texto: " + f.columna;
+            return false;
+        }
+        if (TIPO[c.col] == FECHA) {
+            Fecha d;
+            if (!leerFecha(f.valor, d)) { error = "fecha ilegible: " + f.valor; return false; }
+            c.n = d;
+            return true;
+        }
+        int v;
+        if (!DB::entero(f.valor, v)) { error = "numero ilegible: " + f.valor; return false; }
+        c.n = v;
+        return true;
+    }
+
+    Valor valor(int c, const Fila& f) const {
+        Valor v;
+        const size_t a = f.pos[0], l = f.pos[1], e = f.pos[2], p = f.pos[3];
+        switch (c) {
+            case A_ID: v.n = db.autores[a].id; break;
+            case A_NOMBRE: v.t = db.autores[a].nombre; break;
+            case A_NAC: v.n = db.autores[a].nacionalidad; v.t = db.dicc.texto(uint32_t(v.n)); break;
+            case L_ID: v.n = db.libros[l].id; break;
+            case L_TITULO: v.t = db.libros[l].titulo; break;
+            case L_ISBN: v.t = db.libros[l].isbn; break;
+            case L_ANO: v.n = db.libros[l].ano; break;
+            case L_AUTOR: v.n = db.libros[l].id_autor; break;
+            case E_ID: v.n = db.estudiantes[e].id; break;
+            case E_NOMBRE: v.t = db.estudiantes[e].nombre; break;
+            case E_GRADO: v.n = db.estudiantes[e].grado; v.t = db.dicc.texto(uint32_t(v.n)); break;
+            case P_ID: v.n = db.prestamos.id[p]; break;
+            case P_LIBRO: v.n = db.prestamos.id_libro[p]; break;
+            case P_EST: v.n = db.prestamos.id_estudiante[p]; break;
+            case P_FECHA: v.n = db.prestamos.fecha_prestamo[p]; break;
+            case P_DEV: v.n = db.prestamos.fecha_devolucion[p]; break;
+        }
+        return v;
+    }
+
+    static string texto(int c, const Valor& v) {
+        if (TIPO[c] == TEXTO) return string(v.t);
+        if (TIPO[c] == FECHA) return textoFecha(Fecha(v.n));
+        return to_string(v.n);
+    }
+
+    // Sin fecha (préstamo activo) solo es = o != a otra fecha: nunca es menor ni mayor
+    static bool cumple(OpFiltro op, int cmp) {
+        switch (op) {
+            case OpFiltro::Igual: return cmp == 0;
+            case OpFiltro::Distinto: return cmp != 0;
+            case OpFiltro::Menor: return cmp < 0;
+            case OpFiltro::MenorIgual: return cmp <= 0;
+            case OpFiltro::Mayor: return cmp > 0;
+            case OpFiltro::MayorIgual: return cmp >= 0;
+            case OpFiltro::Contiene: return false;
+        }
+        return false;
+    }
+    bool cumple(const Filtro& f, const Fila& fila) const {
+        Valor v = valor(f.col, fila);
+        if (TIPO[f.col] == TEXTO) {
+            if (f.op == OpFiltro::Contiene) return v.t.find(f.t) != string_view::npos;
+            int cmp = v.t.compare(f.t);
+            return cumple(f.op, cmp < 0 ? -1 : cmp > 0);
+        }
+        bool orden = f.op != OpFiltro::Igual && f.op != OpFiltro::Distinto;
+        if (TIPO[f.col] == FECHA && orden && (v.n == SIN_FECHA || f.n == SIN_FECHA)) return false;
+        return cumple(f.op, v.n < f.n ? -1 : v.n > f.n);
+    }
+
+    // Completa las posiciones de las tablas unidas que hacen falta; false si alguna FK no existe
+    bool unir(Fila& f, unsigned usadas) const {
+        if (f.pos[3] != SIZE_MAX) {
+            if (usadas & 0b0110) {  // libro (y de ahí autor) o estudiante
+                if ((usadas & 0b0011) && (f.pos[1] = DB::posicion(db.idxLibros, db.prestamos.id_libro[f.pos[3]])) == SIZE_MAX) return false;
+                if ((usadas & 0b0100) && (f.pos[2] = DB::posicion(db.idxEstudiantes, db.prestamos.id_estudiante[f.pos[3]])) == SIZE_MAX) return false;
+            }
+            if ((usadas & 0b0001) && f.pos[1] == SIZE_MAX &&
+                (f.pos[1] = DB::posicion(db.idxLibros, db.prestamos.id_libro[f.pos[3]])) == SIZE_MAX) return false;
+        }
+        if ((usadas & 0b0001) && f.pos[0] == SIZE_MAX && f.pos[1] != SIZE_MAX)
+            return (f.pos[0] = DB::posicion(db.idxAutores, db.libros[f.pos[1]].id_autor)) != SIZE_MAX;
+        return true;
+    }
+
+    size_t filasTabla(TablaConsulta t) const {
+        switch (t) {
+            case TablaConsulta::Autor: return db.autores.size();
+            case TablaConsulta::Libro: return db.libros.size();
+            case TablaConsulta::Estudiante: return db.estudiantes.size();
+            case TablaConsulta::Prestamo: return db.prestamos.size();
+        }
+        return 0;
+    }
+    const unordered_map<int, size_t>& indiceClave(TablaConsulta t) const {
+        switch (t) {
+            case TablaConsulta::Autor: return db.idxAutores;
+            case TablaConsulta::Libro: return db.idxLibros;
+            case TablaConsulta::Estudiante: return db.idxEstudiantes;
+            default: return db.idxPrestamos;
+        }
+    }
+    const Lapidas& borradas(TablaConsulta t) const {
+        switch (t) {
+            case TablaConsulta::Autor: return db.borradosAutores;
+            case TablaConsulta::Libro: return db.borradosLibros;
+            case TablaConsulta::Estudiante: return db.borradosEstudiantes;
+            default: return db.borradosPrestamos;
+        }
+    }
+
+    // Busca un filtro "col = valor" aún sin resolver
+    static Filtro* igualdad(vector<Filtro>& fs, int col) {
+        for (auto& f : fs) if (!f.hecho && f.col == col && f.op == OpFiltro::Igual) return &f;
+        return nullptr;
+    }
+
+    // Elige el acceso y pasa cada fila que cumple los filtros a visitar (false: basta de filas)
+    template <class Visitar>
+    void recorrer(TablaConsulta t, vector<Filtro>& fs, unsigned usadas, ResultadoConsulta& res, Visitar visitar) const {
+        int base = static_cast<int>(t);
+        vector<size_t> candidatos;
+        bool todas = false;
+        const int colId[4] = {A_ID, L_ID, E_ID, P_ID};
+        if (Filtro* f = igualdad(fs, colId[base])) {
+            f->hecho = true;
+            size_t pos = f->n >= INT_MIN && f->n <= INT_MAX ? DB::posicion(indiceClave(t), int(f->n)) : SIZE_MAX;
+            if (pos != SIZE_MAX) candidatos.push_back(pos);
+            res.plan = string("indice de clave de ") + NOMBRE_TABLA[base];
+        } else if (t == TablaConsulta::Prestamo && activosPorIndice(fs, candidatos, res)) {
+        } else if (t == TablaConsulta::Prestamo && barridoColumnas(fs, candidatos)) {
+            res.plan = "barrido por columnas de prestamos";
+            res.examinadas = db.prestamos.size();
+        } else {
+            todas = true;
+            res.plan = string("barrido de ") + NOMBRE_TABLA[base];
+        }
+
+        // Los filtros de la tabla base van antes del join: así no se une lo que se descarta
+        vector<const Filtro*> antes, despues;
+        for (auto& f : fs)
+            if (!f.hecho) (TABLA[f.col] == base ? antes : despues).push_back(&f);
+        auto cumplen = [&](const vector<const Filtro*>& lista, const Fila& f) {
+            for (const Filtro* filtro : lista) if (!cumple(*filtro, f)) return false;
+            return true;
+        };
+        // Los barridos pasan por las filas borradas sin compactar; los índices no las tienen
+        const Lapidas& muertas = borradas(t);
+        size_t n = todas ? filasTabla(t) : candidatos.size();
+        if (!todas && res.examinadas == 0) res.examinadas = n;
+        for (size_t k = 0; k < n; k++) {
+            Fila f;
+            f.pos[base] = todas ? k : candidatos[k];
+            if (muertas.borrada(f.pos[base])) continue;
+            if (todas) res.examinadas++;
+            if (!cumplen(antes, f) || !unir(f, usadas) || !cumplen(despues, f)) continue;
+            if (!visitar(f)) break;
+        }
     }
 
-    static string esc(const string& s) {
-        if (s.find(',') != string::npos || s.find('"') != string::npos) {
-            string r = "\"";
-            for (char c : s) { if (c == '"') r += "\"\""; else r.push_back(c); }
-            r += "\"";
-            return r;
+    // prestamo.fecha_devolucion = "" con prestamo.id_estudiante / id_libro = X: listas de activos
+    bool activosPorIndice(vector<Filtro>& fs, vector<size_t>& candidatos, ResultadoConsulta& res) const {
+        Filtro* activo = igualdad(fs, P_DEV);
+        if (!activo || activo->n != SIN_FECHA) return false;
+        const unordered_map<int, vector<int>>* idx = nullptr;
+        Filtro* clave = igualdad(fs, P_EST);
+        if (clave) {
+            idx = &db.activosPorEstudiante;
+            res.plan = "indice activosPorEstudiante";
+        } else if ((clave = igualdad(fs, P_LIBRO))) {
+            idx = &db.activosPorLibro;
+            res.plan = "indice activosPorLibro";
+        } else {
+            return false;
         }
-        return s;
+        activo->hecho = clave->hecho = true;
+        auto it = clave->n >= INT_MIN && clave->n <= INT_MAX ? idx->find(int(clave->n)) : idx->end();
+        if (it == idx->end()) return true;
+        for (int id : it->second) candidatos.push_back(db.idxPrestamos.at(id));
+        return true;
     }
 
-    // Carga desde CSV (salta header)
-    void loadAutores(const string& path) {
-        autores.clear();
-        ifstream f(path);
-        if (!f.good()) return;
-        string line;
-        getline(f, line);  // Header
-        while (getline(f, line)) {
-            if (line.empty()) continue;
-            auto v = splitCSV(line);
-            if (v.size() < 3) continue;
-            Autor a{stoi(v[0]), v[1], v[2]};
-            autores.push_back(a);
+    // Filtros de orden o igualdad sobre columnas de préstamos: se juntan en un rango por columna
+    // y se resuelven todos en una pasada SIMD (TablaPrestamos::filtrarRangos)
+    bool barridoColumnas(vector<Filtro>& fs, vector<size_t>& candidatos) const {
+        vector<int> TablaPrestamos::*cols[N_COLUMNAS] = {};
+        cols[P_ID] = &TablaPrestamos::id;
+        cols[P_LIBRO] = &TablaPrestamos::id_libro;
+        cols[P_EST] = &TablaPrestamos::id_estudiante;
+        cols[P_FECHA] = &TablaPrestamos::fecha_prestamo;
+        cols[P_DEV] = &TablaPrestamos::fecha_devolucion;
+        int64_t lo[N_COLUMNAS], hi[N_COLUMNAS];
+        bool usada[N_COLUMNAS] = {};
+        for (auto& f : fs) {
+            if (f.hecho || !cols[f.col] || f.op == OpFiltro::Distinto || f.op == OpFiltro::Contiene) continue;
+            int c = f.col;
+            if (!usada[c]) {
+                usada[c] = true;
+                lo[c] = INT32_MIN;
+                hi[c] = INT32_MAX;
+            }
+            if (f.op != OpFiltro::Igual && TIPO[c] == FECHA) {
+                // "Sin fecha" no es menor ni mayor que nada
+                lo[c] = max<int64_t>(lo[c], int64_t(SIN_FECHA) + 1);
+                if (f.n == SIN_FECHA) hi[c] = INT32_MIN;
+            }
+            switch (f.op) {
+                case OpFiltro::Igual: lo[c] = max(lo[c], f.n); hi[c] = min(hi[c], f.n); break;
+                case OpFiltro::Menor: hi[c] = min(hi[c], f.n - 1); break;
+                case OpFiltro::MenorIgual: hi[c] = min(hi[c], f.n); break;
+                case OpFiltro::Mayor: lo[c] = max(lo[c], f.n + 1); break;
+                case OpFiltro::MayorIgual: lo[c] = max(lo[c], f.n); break;
+                default: break;
+            }
+            f.hecho = true;
         }
+        vector<TablaPrestamos::Rango> rangos;
+        bool vacio = false;
+        for (int c = 0; c < N_COLUMNAS; c++) {
+            if (!usada[c]) continue;
+            if (lo[c] > hi[c]) vacio = true;
+            else rangos.push_back({cols[c], int32_t(lo[c]), int32_t(hi[c])});
+        }
+        if (rangos.empty() && !vacio) return false;
+        if (!vacio) candidatos = db.prestamos.filtrarRangos(rangos);
+        return true;
     }
 
-    void loadLibros(const string& path) {
-        libros.clear();
-        ifstream f(path);
-        if (!f.good()) return;
-        string line;
-        getline(f, line);
-        while (getline(f, line)) {
-            if (line.empty()) continue;
-            auto v = splitCSV(line);
-            if (v.size() < 5) continue;
-            Libro l{stoi(v[0]), v[1], v[2], stoi(v[3]), stoi(v[4])};
-            libros.push_back(l);
-        }
+    int comparar(int c, const Valor& a, const Valor& b) const {
+        if (TIPO[c] == TEXTO) return a.t.compare(b.t);
+        return a.n < b.n ? -1 : a.n > b.n;
     }
 
-    void loadEstudiantes(const string& path) {
-        estudiantes.clear();
-        ifstream f(path);
-        if (!f.good()) return;
-        string line;
-        getline(f, line);
-        while (getline(f, line)) {
-            if (line.empty()) continue;
-            auto v = splitCSV(line);
-            if (v.size() < 3) continue;
-            Estudiante e{stoi(v[0]), v[1], v[2]};
-            estudiantes.push_back(e);
-        }
+    // Orden estable por la columna c; con límite solo se ordenan los primeros (partial_sort)
+    void ordenar(vector<Fila>& filas, int c, bool desc, size_t limite) const {
+        vector<pair<Valor, size_t>> claves(filas.size());
+        for (size_t i = 0; i < filas.size(); i++) claves[i] = {valor(c, filas[i]), i};
+        auto menor = [&](const pair<Valor, size_t>& a, const pair<Valor, size_t>& b) {
+            int cmp = comparar(c, a.first, b.first);
+            if (desc) cmp = -cmp;
+            return cmp != 0 ? cmp < 0 : a.second < b.second;
+        };
+        size_t k = min(limite, claves.size());
+        partial_sort(claves.begin(), claves.begin() + static_cast<ptrdiff_t>(k), claves.end(), menor);
+        vector<Fila> res(k);
+        for (size_t i = 0; i < k; i++) res[i] = filas[claves[i].second];
+        filas.swap(res);
     }
 
-    void loadPrestamos(const string& path) {
-        prestamos.clear();
-        ifstream f(path);
-        if (!f.good()) return;
-        string line;
-        getline(f, line);
-        while (getline(f, line)) {
-            if (line.empty()) continue;
-            auto v = splitCSV(line);
-            if (v.size() < 5) continue;
-            Prestamo p{stoi(v[0]), stoi(v[1]), stoi(v[2]), v[3], v[4]};
-            prestamos.push_back(p);
+    // Conteo por valor, en orden de primera aparición
+    struct Grupos {
+        vector<pair<Valor, size_t>> cuenta;
+        unordered_map<int64_t, size_t> porNumero;
+        unordered_map<string_view, size_t> porTexto;
+
+        void sumar(bool esTexto, const Valor& v) {
+            size_t g = cuenta.size();
+            g = esTexto ? porTexto.emplace(v.t, g).first->second : porNumero.emplace(v.n, g).first->second;
+            if (g == cuenta.size()) cuenta.emplace_back(v, 0);
+            cuenta[g].second++;
         }
-    }
+    };
 
-    // Guarda en CSV (con header)
-    void saveAutores(const string& path) {
-        ofstream f(path);
-        if (!f) return;
-        f << "id,nombre,nacionalidad\n";
-        for (auto& a : autores) {
-            f << a.id << "," << esc(a.nombre) << "," << esc(a.nacionalidad) << "\n";
+    void emitirGrupos(const Grupos& gs, int c, bool porCantidad, bool porValor, bool desc, size_t limite,
+                      ResultadoConsulta& res) const {
+        auto& grupos = gs.cuenta;
+        vector<size_t> orden(grupos.size());
+        for (size_t i = 0; i < orden.size(); i++) orden[i] = i;
+        if (porCantidad || porValor) {
+            auto menor = [&](size_t a, size_t b) {
+                int cmp = porCantidad ? (grupos[a].second < grupos[b].second ? -1 : grupos[a].second > grupos[b].second)
+                                      : comparar(c, grupos[a].first, grupos[b].first);
+                if (desc) cmp = -cmp;
+                return cmp != 0 ? cmp < 0 : a < b;
+            };
+            size_t k = min(limite, orden.size());
+            partial_sort(orden.begin(), orden.begin() + static_cast<ptrdiff_t>(k), orden.end(), menor);
         }
+        if (orden.size() > limite) orden.resize(limite);
+        res.columnas = {NOMBRE[c], "cantidad"};
+        for (size_t g : orden) res.filas.push_back({texto(c, grupos[g].first), to_string(grupos[g].second)});
     }
+};
 
-    void saveLibros(const string& path) {
-        ofstream f(path);
-        if (!f) return;
-        f << "id,titulo,isbn,ano_publicacion,id_autor\n";
-        for (auto& l : libros) {
-            f << l.id << "," << esc(l.titulo) << "," << esc(l.isbn) << "," << l.ano << "," << l.id_autor << "\n";
+/*
+ * Una DB para varios hilos a la vez (mostradores, un proceso de informes). Las lecturas toman el
+ * lock compartido y corren en paralelo entre sí; cada escritura toma el exclusivo, así los CRUD
+ * siguen siendo atómicos unos respecto de otros: de dos addPrestamo del mismo libro gana uno,
+ * porque comprobar que está disponible y marcarlo activo pasan sin nadie en medio.
+ * Un escritor que espera frena a los lectores nuevos (el rwlock de glibc prefiere lectores y
+ * con informes solapados los mostradores no entrarían nunca).
+ * leer() no debe devolver punteros ni string_view hacia la DB: lo que salga se copia dentro.
+ */
+class DBCompartida {
+public:
+    // Para cargar o preparar antes de que haya otros hilos
+    DB& sinLock() { return db; }
+
+    template <class F>
+    auto leer(F f) const {
+        if (esperando.load(memory_order_acquire)) {
+            // Solo para esperar al escritor en cola: turno se suelta cuando él ya tiene el
+            // exclusivo, y este lector queda detrás en el shared_lock de abajo
+            lock_guard<mutex> t(turno);
         }
+        shared_lock<shared_mutex> l(m);
+        return f(static_cast<const DB&>(db));
+    }
+    template <class F>
+    auto escribir(F f) {
+        esperando.fetch_add(1, memory_order_acq_rel);
+        unique_lock<mutex> t(turno);
+        unique_lock<shared_mutex> l(m);
+        esperando.fetch_sub(1, memory_order_acq_rel);
+        t.unlock();
+        return f(db);
     }
 
-    void saveEstudiantes(const string& path) {
-        ofstream f(path);
-        if (!f) return;
-        f << "id,nombre,grado\n";
-        for (auto& e : estudiantes) {
-            f << e.id << "," << esc(e.nombre) << "," << esc(e.grado) << "\n";
-        }
+    // Mostrador
+    bool addPrestamo(int id, int id_libro, int id_estudiante, Fecha fecha_prestamo) {
+        return escribir([&](DB& d) { return d.addPrestamo(id, id_libro, id_estudiante, fecha_prestamo); });
+    }
+    bool devolverPrestamo(int id_prestamo, Fecha fecha_devolucion) {
+        return escribir([&](DB& d) { return d.devolverPrestamo(id_prestamo, fecha_devolucion); });
+    }
+    bool libroDisponible(int id_libro) const {
+        return leer([&](const DB& d) { return d.libroDisponible(id_libro); });
     }
 
-    void savePrestamos(const string& path) {
-        ofstream f(path);
-        if (!f) return;
-        f << "id,id_libro,id_estudiante,fecha_prestamo,fecha_devolucion\n";
-        for (auto& p : prestamos) {
-            f << p.id << "," << p.id_libro << "," << p.id_estudiante << "," << esc(p.fecha_prestamo) << "," << esc(p.fecha_devolucion) << "\n";
+    // Informes
+    bool consultar(const Consulta& q, ResultadoConsulta& res, string& error) const {
+        return leer([&](const DB& d) { return MotorConsultas(d).ejecutar(q, res, error); });
+    }
+    // Los índices de texto se arman la primera vez con el lock exclusivo; después es una lectura.
+    // Se reintenta porque una carga entre medias puede descartarlos otra vez.
+    vector<DB::LibroEncontrado> buscarLibrosPorTexto(string_view consulta, size_t max = 20) {
+        while (true) {
+            bool listo = false;
+            auto res = leer([&](const DB& d) {
+                listo = d.textoPreparado();
+                return listo ? d.buscarEnTexto(consulta, max) : vector<DB::LibroEncontrado>();
+            });
+            if (listo) return res;
+            escribir([](DB& d) { d.prepararTexto(); });
         }
     }
 
-    // Helpers: Existencia y disponible
-    bool idAutorExiste(int id) {
-        return any_of(autores.begin(), autores.end(), [id](auto& a){ return a.id == id; });
+private:
+    DB db;
+    mutable shared_mutex m;
+    mutable mutex turno;               // Lo tiene el escritor mientras espera el exclusivo
+    atomic<int> esperando{0};          // Escritores esperando: los lectores pasan antes por turno
+};
+
+string DATA_DIR = "./data";
+const string SNAPSHOT = "/biblioteca.snap";
+bool MODO_CSV = false;  // --csv: persistencia en los CSV como antes, sin snapshot
+
+void initDataDir() {
+    error_code ec;
+    filesystem::create_directories(DATA_DIR, ec);  // Crea dir si no existe (sin lanzar un shell)
+}
+
+void avisarProblemasCarga(const DB& db) {
+    DB::InformeCarga inf = db.validarCarga();
+    if (inf.problemas()) {
+        cerr << "Aviso: datos cargados con " << inf.problemas() << " problemas de integridad"
+             << " (IDs duplicados A/L/E/P: " << inf.autoresDuplicados << "/" << inf.librosDuplicados << "/"
+             << inf.estudiantesDuplicados << "/" << inf.prestamosDuplicados
+             << "; libros sin autor: " << inf.librosSinAutor
+             << "; préstamos sin libro: " << inf.prestamosSinLibro
+             << "; préstamos sin estudiante: " << inf.prestamosSinEstudiante
+             << "; libros con varios préstamos activos: " << inf.librosConVariosActivos << ")\n";
+    }
+}
+
+// Las cuatro tablas se cargan a la vez (archivos e índices independientes)
+void importarCSV(DB& db) {
+    auto aut = async(launch::async, [&] { db.loadAutores(DATA_DIR + "/autores.csv"); });
+    auto lib = async(launch::async, [&] { db.loadLibros(DATA_DIR + "/libros.csv"); });
+    auto est = async(launch::async, [&] { db.loadEstudiantes(DATA_DIR + "/estudiantes.csv"); });
+    db.loadPrestamos(DATA_DIR + "/prestamos.csv");
+    aut.get();
+    lib.get();
+    est.get();
+}
+
+// Las cuatro tablas se guardan a la vez; cada archivo se reemplaza solo si se escribió entero
+bool exportarCSV(const DB& db) {
+    auto aut = async(launch::async, [&] { return db.saveAutores(DATA_DIR + "/autores.csv"); });
+    auto lib = async(launch::async, [&] { return db.saveLibros(DATA_DIR + "/libros.csv"); });
+    auto est = async(launch::async, [&] { return db.saveEstudiantes(DATA_DIR + "/estudiantes.csv"); });
+    bool ok = db.savePrestamos(DATA_DIR + "/prestamos.csv");
+    ok = aut.get() && ok;
+    ok = lib.get() && ok;
+    return est.get() && ok;
+}
+
+// WAL sobre el snapshot: WAL_VIEJO es el log rotado mientras se escribe el snapshot nuevo
+const string WAL = "/biblioteca.wal";
+const string WAL_VIEJO = "/biblioteca.wal.1";
+ConfigWAL CONFIG_WAL;
+RegistroWAL REGISTRO;
+future<bool> COMPACTANDO;  // Snapshot de la compactación en curso (ver compactar)
+
+// Arranque: snapshot binario (o los CSV si no hay / --csv) y encima el WAL pendiente.
+// abrirWal=false para las conversiones de un solo paso, que no deben anotar nada.
+void cargarTodo(DB& db, bool abrirWal = true) {
+    initDataDir();
+    if (MODO_CSV) {
+        importarCSV(db);
+        avisarProblemasCarga(db);
+        return;
     }
-    bool idLibroExiste(int id) {
-        return any_of(libros.begin(), libros.end(), [id](auto& l){ return l.id == id; });
+    string error;
+    uint64_t lsn = 0;
+    bool haySnapshot = db.cargarSnapshot(DATA_DIR + SNAPSHOT, error, &lsn);
+    if (!haySnapshot) {
+        if (error != "no existe") cerr << "Aviso: snapshot ignorado (" << error << "), se cargan los CSV\n";
+        importarCSV(db);
+    }
+    size_t aplicados = 0, fallidos = 0;
+    auto aplicar = [&](OpWAL op, LectorRegistroWAL r) { fallidos += !db.aplicarWAL(op, r); };
+    lsn = RegistroWAL::reproducir(DATA_DIR + WAL_VIEJO, lsn, false, aplicar, aplicados);
+    lsn = RegistroWAL::reproducir(DATA_DIR + WAL, lsn, abrirWal, aplicar, aplicados);
+    if (fallidos) cerr << "Aviso: " << fallidos << " de " << aplicados << " registros del WAL no se pudieron reaplicar\n";
+    avisarProblemasCarga(db);
+    if (!abrirWal) return;
+    // Primer arranque desde CSV: se fija un snapshot para que el WAL siempre tenga base
+    if (!haySnapshot && !db.guardarSnapshot(DATA_DIR + SNAPSHOT, lsn)) cerr << "Aviso: no se pudo crear el snapshot inicial\n";
+    if (REGISTRO.abrir(DATA_DIR + WAL, lsn, CONFIG_WAL)) db.wal = &REGISTRO;
+    else cerr << "Aviso: no se pudo abrir el WAL; los cambios se guardan solo al salir\n";
+}
+
+// Recoge la compactación si ya terminó (o la espera, con esperar): si el snapshot quedó escrito,
+// WAL_VIEJO sobra
+void recogerCompactacion(bool esperar) {
+    if (!COMPACTANDO.valid()) return;
+    if (!esperar && COMPACTANDO.wait_for(chrono::seconds(0)) != future_status::ready) return;
+    if (COMPACTANDO.get()) remove((DATA_DIR + WAL_VIEJO).c_str());
+    else cerr << "Aviso: la compactación del WAL falló; se reintentará\n";
+}
+
+// Vuelca el estado actual a un snapshot nuevo con el lsn del WAL. Lo escribe otro hilo desde
+// una copia de la DB tomada aquí, y el menú sigue atendiendo. Un hilo y no fork(): con el hilo
+// del WAL y los trabajadores del servidor corriendo, el hijo solo podría usar funciones
+// async-signal-safe, y guardarSnapshot reserva memoria y toma locks que en el hijo podrían
+// quedar tomados para siempre. La copia cuesta memoria y una pausa de memcpy, no la escritura.
+void compactar(DB& db) {
+    // Si quedó un WAL rotado de un intento fallido no se rota otra vez: sus registros siguen haciendo falta
+    if (!filesystem::exists(DATA_DIR + WAL_VIEJO)) {
+        if (!REGISTRO.rotar(DATA_DIR + WAL_VIEJO)) return;
+    } else {
+        REGISTRO.sincronizar();
     }
-    bool idEstudianteExiste(int id) {
-        return any_of(estudiantes.begin(), estudiantes.end(), [id](auto& e){ return e.id == id; });
+    uint64_t lsn = REGISTRO.ultimoLsn();
+    COMPACTANDO = async(launch::async, [copia = db.copiaParaSnapshot(), ruta = DATA_DIR + SNAPSHOT, lsn] {
+        return copia->guardarSnapshot(ruta, lsn);
+    });
+}
+
+// Opción 21: operaciones medidas desde el arranque (solo las que se usaron) y memoria por tabla
+void mostrarEstadisticas(const DB& db) {
+    if (!ESTADISTICAS_ACTIVAS) cout << "Operaciones: (compilado con BIBLIOTECADB_SIN_ESTADISTICAS)\n";
+    else cout << "Operaciones (desde el arranque):\n";
+    Estadisticas::Resumen r = Estadisticas::leer();
+    for (size_t i = 0; i < Estadisticas::OPS; i++) {
+        const Estadisticas::Op& o = r.op[i];
+        if (!o.llamadas) continue;
+        cout << " - " << NOMBRES_OP_MEDIDA[i] << ": " << o.llamadas << " llamadas (" << o.fallidas << " fallidas), media " << o.mediaUs()
+             << " us, p50 " << o.percentilUs(0.5) << " us, p99 " << o.percentilUs(0.99) << " us, máx " << o.maxUs() << " us\n";
     }
-    bool idPrestamoExiste(int id) {
-        return any_of(prestamos.begin(), prestamos.end(), [id](auto& p){ return p.id == id; });
+    size_t total = 0;
+    cout << "Tablas (memoria estimada):\n";
+    for (auto& t : db.usoMemoria()) {
+        cout << " - " << t.tabla << ": " << t.filas << " filas, " << double(t.bytes) / (1 << 20) << " MB";
+        if (t.borradas) cout << " (" << t.borradas << " borradas sin compactar)";
+        if (t.bytesMuertos) cout << " (" << double(t.bytesMuertos) / (1 << 20) << " MB de texto sin usar)";
+        cout << "\n";
+        total += t.bytes;
     }
+    cout << " Total: " << double(total) / (1 << 20) << " MB\n";
+}
 
-    bool libroDisponible(int id_libro) {
-        for (auto& p : prestamos) {
-            if (p.id_libro == id_libro && p.fecha_devolucion.empty()) return false;
+// --estadisticas=ruta: lo mismo en CSV, reemplazando el archivo cada --estadisticas-s segundos
+// (entre comandos, desde mantenimiento) y al salir. Dos secciones, cada una con su encabezado.
+string RUTA_ESTADISTICAS;
+int SEGUNDOS_ESTADISTICAS = 60;
+
+bool volcarEstadisticas(const DB& db, const string& ruta) {
+    string tmp = ruta + ".tmp";
+    {
+        ofstream f(tmp);
+        if (!f) return false;
+        Estadisticas::Resumen r = Estadisticas::leer();
+        f << "operacion,llamadas,fallidas,total_ms,media_us,p50_us,p90_us,p99_us,max_us\n";
+        for (size_t i = 0; i < Estadisticas::OPS; i++) {
+            const Estadisticas::Op& o = r.op[i];
+            f << NOMBRES_OP_MEDIDA[i] << "," << o.llamadas << "," << o.fallidas << "," << o.totalMs() << "," << o.mediaUs() << ","
+              << o.percentilUs(0.5) << "," << o.percentilUs(0.9) << "," << o.percentilUs(0.99) << "," << o.maxUs() << "\n";
         }
-        return true;
+        f << "\ntabla,filas,bytes,borradas,bytes_muertos\n";
+        for (auto& t : db.usoMemoria()) f << t.tabla << "," << t.filas << "," << t.bytes << "," << t.borradas << "," << t.bytesMuertos << "\n";
+        if (!f.flush()) return false;
     }
+    return rename(tmp.c_str(), ruta.c_str()) == 0;
+}
 
-    // CRUD Autor
-    bool addAutor(Autor a) {
-        if (idAutorExiste(a.id)) return false;
-        autores.push_back(a);
-        return true;
+void volcarEstadisticasSiToca(const DB& db, bool forzar = false) {
+    static auto ultimo = chrono::steady_clock::now();
+    if (RUTA_ESTADISTICAS.empty()) return;
+    auto ahora = chrono::steady_clock::now();
+    if (!forzar && ahora - ultimo < chrono::seconds(SEGUNDOS_ESTADISTICAS)) return;
+    ultimo = ahora;
+    if (!volcarEstadisticas(db, RUTA_ESTADISTICAS)) cerr << "Aviso: no se pudieron escribir las estadísticas en " << RUTA_ESTADISTICAS << "\n";
+}
+
+// Entre comandos: avanza un tramo la compactación de filas borradas, recoge la compactación del
+// WAL terminada y lanza otra si el WAL pasó el umbral
+void mantenimiento(DB& db) {
+    volcarEstadisticasSiToca(db);
+    db.compactarBorradas();
+    recogerCompactacion(false);
+    if (COMPACTANDO.valid()) return;
+    if (REGISTRO.activo() && REGISTRO.bytes() >= CONFIG_WAL.compactarBytes) compactar(db);
+}
+
+// Con WAL todo cambio ya está anotado: guardar es hacerlo durable (coste según lo cambiado)
+bool guardarTodo(DB& db) {
+    initDataDir();
+    if (MODO_CSV) return exportarCSV(db);
+    recogerCompactacion(true);
+    if (REGISTRO.activo() && db.wal == &REGISTRO) return REGISTRO.sincronizar();
+    return db.guardarSnapshot(DATA_DIR + SNAPSHOT);
+}
+
+// --importar-lote=dir: agrega a la DB los CSV de dir en bloque (ver DB::importar) y lo informa
+bool importarLote(DB& db, const string& dir, bool parcial) {
+    LoteImportacion lote;
+    string error;
+    if (!DB::leerLoteCSV(dir, lote, error)) {
+        cerr << "Error: " << error << "\n";
+        return false;
     }
-    bool updateAutor(int id, string nombre, string nac) {
-        for (auto& a : autores) {
-            if (a.id == id) {
-                a.nombre = nombre;
-                a.nacionalidad = nac;
-                return true;
-            }
-        }
+    InformeImportacion inf;
+    db.importar(lote, inf, parcial);
+    const size_t MOSTRAR = 50;
+    for (size_t i = 0; i < inf.rechazos.size() && i < MOSTRAR; i++) {
+        auto& r = inf.rechazos[i];
+        cout << "Rechazada " << r.tabla << " fila " << r.fila << " (id " << r.id << "): " << r.motivo << "\n";
+    }
+    if (inf.rechazos.size() > MOSTRAR) cout << "... y " << inf.rechazos.size() - MOSTRAR << " rechazos más\n";
+    if (!inf.confirmado) {
+        cout << "Lote rechazado: " << inf.rechazos.size() << " de " << lote.size() << " filas con problemas; no se agregó nada"
+             << (parcial ? "\n" : " (--parcial agrega las válidas)\n");
         return false;
     }
-    bool deleteAutor(int id) {
-        // No borrar si referenciado por libros
-        for (auto& l : libros) if (l.id_autor == id) return false;
-        auto it = remove_if(autores.begin(), autores.end(), [id](auto& a){ return a.id == id; });
-        if (it == autores.end()) return false;
-        autores.erase(it, autores.end());
-        return true;
+    cout << "Agregados: " << inf.autores << " autores, " << inf.libros << " libros, " << inf.estudiantes << " estudiantes, "
+         << inf.prestamos << " préstamos (" << inf.rechazos.size() << " filas rechazadas)\n";
+    return true;
+}
+
+/*
+ * Opciones de un listado por páginas, una por token: desde=N, limite=N (o N solo), despues=id
+ * (cursor: sigue tras esa fila), orden=tabla|id|fecha y archivo=ruta (- es la salida estándar).
+ */
+bool leerPagina(const string_view* opciones, int n, DB::Pagina& p, string& archivo, string& error) {
+    int i = 0;
+    for (; i < n; i++) {
+        string_view o = opciones[i];
+        if (o.empty()) continue;
+        size_t igual = o.find('=');
+        string_view clave = igual == string_view::npos ? string_view() : o.substr(0, igual);
+        string_view valor = igual == string_view::npos ? o : o.substr(igual + 1);
+        int v = 0;
+        bool numero = DB::entero(valor, v);
+        if (clave.empty() || clave == "limite" || clave == "desde") {
+            if (!numero || v < 0) break;
+            (clave == "desde" ? p.desde : p.limite) = size_t(v);
+        } else if (clave == "despues") {
+            if (!numero) break;
+            p.conCursor = true;
+            p.despuesDe = v;
+        } else if (clave == "orden" && valor == "tabla") {
+            p.orden = DB::OrdenListado::Tabla;
+        } else if (clave == "orden" && valor == "id") {
+            p.orden = DB::OrdenListado::Id;
+        } else if (clave == "orden" && valor == "fecha") {
+            p.orden = DB::OrdenListado::Fecha;
+        } else if (clave == "archivo") {
+            archivo = string(valor);
+        } else {
+            break;
+        }
     }
+    if (i < n) error = "opción inválida: " + string(opciones[i]);
+    return i == n;
+}
 
-    // CRUD Libro
-    bool addLibro(Libro l) {
-        if (idLibroExiste(l.id)) return false;
-        if (!idAutorExiste(l.id_autor)) return false;
-        libros.push_back(l);
-        return true;
+// Un listado con opciones de página, a la salida estándar o a un archivo (exportación en bloque)
+bool listarPagina(const DB& db, string_view tabla, const string_view* opciones, int n) {
+    DB::Pagina p;
+    string archivo, error;
+    if (!leerPagina(opciones, n, p, archivo, error)) {
+        cout << "Error: " << error << "\n";
+        return false;
     }
-    bool updateLibro(int id, string titulo, string isbn, int ano, int id_autor) {
-        for (auto& l : libros) {
-            if (l.id == id) {
-                if (!idAutorExiste(id_autor)) return false;
-                l.titulo = titulo;
-                l.isbn = isbn;
-                l.ano = ano;
-                l.id_autor = id_autor;
-                return true;
-            }
-        }
+    bool aArchivo = !archivo.empty() && archivo != "-";
+    FILE* f = aArchivo ? fopen(archivo.c_str(), "wb") : stdout;
+    if (!f) {
+        cout << "Error: no se pudo abrir " << archivo << "\n";
         return false;
     }
-    bool deleteLibro(int id) {
-        if (!libroDisponible(id)) return false;
-        auto it = remove_if(libros.begin(), libros.end(), [id](auto& l){ return l.id == id; });
-        if (it == libros.end()) return false;
-        libros.erase(it, libros.end());
-        return true;
+    bool ok;
+    {
+        SalidaListado out(f);
+        ok = db.listar(tabla, p, out, error);
+        if (!out.cerrar() && ok) ok = false, error = "no se pudo escribir " + archivo;
     }
+    if (aArchivo && fclose(f) != 0 && ok) ok = false, error = "no se pudo escribir " + archivo;
+    if (!ok) cout << "Error: " << error << "\n";
+    else if (aArchivo) cout << "Listado escrito en " << archivo << "\n";
+    return ok;
+}
 
-    // CRUD Estudiante
-    bool addEstudiante(Estudiante e) {
-        if (idEstudianteExiste(e.id)) return false;
-        estudiantes.push_back(e);
-        return true;
-    }
-    bool updateEstudiante(int id, string nombre, string grado) {
-        for (auto& e : estudiantes) {
-            if (e.id == id) {
-                e.nombre = nombre;
-                e.grado = grado;
-                return true;
+/*
+ * Guion de comandos (--guion=archivo, o - para stdin): las opciones del menú sin preguntas, una
+ * por línea como "opción,campo,campo,...", con los campos en el formato de los CSV (comillas si
+ * llevan comas). Líneas vacías o con # al principio se saltan; 0 termina el guion.
+ *   1/3 id,título,isbn,año,id_autor    5/7 id,nombre,nacionalidad    9/11 id,nombre,grado
+ *   4/8/12/16 id    13 id,id_libro,id_est,fecha    15 id,fecha    17 id_est[ id_est...]
+ *   18 [topN]    19 texto    20 desde,hasta    21 sin campos
+ *   2/6/10/14 [opción,...]    22 tabla[,opción,...]    (opciones de página: ver leerPagina)
+ *   23 fecha (purga los préstamos devueltos antes de esa fecha)
+ * La salida de cada comando es la del menú, sin prompts ni flush por línea.
+ */
+enum class ResultadoComando { Bien, Fallo, Malformado };
+
+ResultadoComando ejecutarComando(DB& db, int opcion, const string_view* c, int n) {
+    using R = ResultadoComando;
+    string tmp[DB::MAX_CAMPOS];
+    auto txt = [&](int i) { return DB::texto(c[i], tmp[i]); };
+    int id = 0, a = 0, b = 0;
+    auto hay = [&](int campos) { return n >= campos && DB::entero(c[0], id); };
+    auto resultado = [](bool ok, const char* error) {
+        cout << (ok ? "OK\n" : error);
+        return ok ? R::Bien : R::Fallo;
+    };
+    switch (opcion) {
+        case 1:
+        case 3:
+            if (!hay(5) || !DB::entero(c[3], a) || !DB::entero(c[4], b)) return R::Malformado;
+            if (opcion == 1) return resultado(db.addLibro(id, txt(1), txt(2), a, b), "Error: ID duplicado o autor inexistente\n");
+            return resultado(db.updateLibro(id, txt(1), txt(2), a, b), "Error\n");
+        case 5:
+        case 7:
+            if (!hay(3)) return R::Malformado;
+            if (opcion == 5) return resultado(db.addAutor(id, txt(1), txt(2)), "Error: ID duplicado\n");
+            return resultado(db.updateAutor(id, txt(1), txt(2)), "Error\n");
+        case 9:
+        case 11:
+            if (!hay(3)) return R::Malformado;
+            if (opcion == 9) return resultado(db.addEstudiante(id, txt(1), txt(2)), "Error: ID duplicado\n");
+            return resultado(db.updateEstudiante(id, txt(1), txt(2)), "Error\n");
+        case 4: return hay(1) ? resultado(db.deleteLibro(id), "Error: Tiene préstamos (activos o históricos)\n") : R::Malformado;
+        case 8: return hay(1) ? resultado(db.deleteAutor(id), "Error: Referenciado por libros\n") : R::Malformado;
+        case 12: return hay(1) ? resultado(db.deleteEstudiante(id), "Error: Tiene préstamos\n") : R::Malformado;
+        case 16: return hay(1) ? resultado(db.deletePrestamo(id), "Error: Activo o inexistente\n") : R::Malformado;
+        case 13:
+            if (!hay(4) || !DB::entero(c[1], a) || !DB::entero(c[2], b)) return R::Malformado;
+            return resultado(db.addPrestamo(id, a, b, txt(3)), "Error: IDs o fecha inválidos, o libro no disponible\n");
+        case 15:
+            if (!hay(2)) return R::Malformado;
+            return resultado(db.devolverPrestamo(id, txt(1)), "Error: Ya devuelto, inválido, fecha ilegible o anterior al préstamo\n");
+        case 2: return listarPagina(db, "libros", c, n) ? R::Bien : R::Fallo;
+        case 6: return listarPagina(db, "autores", c, n) ? R::Bien : R::Fallo;
+        case 10: return listarPagina(db, "estudiantes", c, n) ? R::Bien : R::Fallo;
+        case 14: return listarPagina(db, "prestamos", c, n) ? R::Bien : R::Fallo;
+        case 22:
+            if (n < 1) return R::Malformado;
+            return listarPagina(db, c[0], c + 1, n - 1) ? R::Bien : R::Fallo;
+        case 23: {
+            Fecha antes;
+            if (n < 1 || !leerFecha(txt(0), antes) || antes == SIN_FECHA) return R::Malformado;
+            cout << "Purgados: " << db.purgarDevueltos(antes) << " préstamos\n";
+            return R::Bien;
+        }
+        case 21: mostrarEstadisticas(db); return R::Bien;
+        case 17: {  // Ids en uno o varios campos, separados por espacios como en el menú
+            vector<int> ids;
+            for (int i = 0; i < n && i < DB::MAX_CAMPOS; i++) {
+                string_view s = c[i];
+                while (!s.empty()) {
+                    size_t fin = min(s.find(' '), s.size());
+                    if (fin > 0) {
+                        if (!DB::entero(s.substr(0, fin), id)) return R::Malformado;
+                        ids.push_back(id);
+                    }
+                    s.remove_prefix(min(fin + 1, s.size()));
+                }
             }
+            if (ids.empty()) return R::Malformado;
+            if (ids.size() == 1) db.listarLibrosPrestadosPorEstudiante(ids[0]);
+            else db.listarLibrosPrestadosPorEstudiantes(ids);
+            return R::Bien;
         }
-        return false;
+        case 18:
+            a = 10;
+            if (n >= 1 && !c[0].empty() && !DB::entero(c[0], a)) return R::Malformado;
+            db.rankingAutoresPorCantidadLibros(a);
+            return R::Bien;
+        case 19:
+            if (n < 1) return R::Malformado;
+            db.listarBusquedaLibros(txt(0));
+            return R::Bien;
+        case 20: {
+            Fecha desde, hasta;
+            if (n < 2 || !leerFecha(txt(0), desde) || !leerFecha(txt(1), hasta) || desde == SIN_FECHA || hasta == SIN_FECHA ||
+                hasta < desde || hasta - desde > 100 * 366)
+                return R::Malformado;
+            db.informePrestamos(desde, hasta);
+            return R::Bien;
+        }
+        default: return R::Malformado;
     }
-    bool deleteEstudiante(int id) {
-        // No borrar si tiene préstamos
-        for (auto& p : prestamos) if (p.id_estudiante == id) return false;
-        auto it = remove_if(estudiantes.begin(), estudiantes.end(), [id](auto& e){ return e.id == id; });
-        if (it == estudiantes.end()) return false;
-        estudiantes.erase(it, estudiantes.end());
-        return true;
+}
+
+// Corre el guion de in sobre db y deja en cerr el tiempo por opción (CSV: opcion, comandos,
+// fallidos, total_ms, media_us, p50_us, p99_us, max_us). Con tiempos, además una fila por
+// comando (linea, opcion, us, resultado). false si hubo líneas malformadas.
+bool correrGuion(DB& db, istream& in, ostream* tiempos) {
+    struct PorOpcion {
+        vector<double> us;
+        size_t fallidos = 0;
+    };
+    map<int, PorOpcion> porOpcion;
+    size_t malformadas = 0, nLinea = 0;
+    string linea;
+    string_view campos[DB::MAX_CAMPOS];
+    if (tiempos) *tiempos << "linea,opcion,us,resultado\n";
+    auto inicioGuion = chrono::steady_clock::now();
+    while (getline(in, linea)) {
+        nLinea++;
+        if (!linea.empty() && linea.back() == '\r') linea.pop_back();
+        size_t ini = linea.find_first_not_of(" \t");
+        if (ini == string::npos || linea[ini] == '#') continue;
+        // La opción va aparte: los campos que siguen usan todo el espacio de camposCSV
+        string_view resto = string_view(linea).substr(ini);
+        size_t coma = min(resto.find(','), resto.size());
+        int opcion;
+        if (!DB::entero(resto.substr(0, coma), opcion)) opcion = -1;
+        if (opcion == 0) break;
+        int n = 0;
+        if (coma < resto.size()) n = DB::camposCSV(resto.substr(coma + 1), campos);
+        mantenimiento(db);  // Como en el menú, fuera de la medición
+        auto t0 = chrono::steady_clock::now();
+        ResultadoComando r = n > DB::MAX_CAMPOS ? ResultadoComando::Malformado : ejecutarComando(db, opcion, campos, n);
+        double us = chrono::duration<double, micro>(chrono::steady_clock::now() - t0).count();
+        if (r == ResultadoComando::Malformado) {
+            cout << "Error: línea " << nLinea << " mal formada\n";
+            malformadas++;
+        } else {
+            PorOpcion& p = porOpcion[opcion];
+            p.us.push_back(us);
+            if (r == ResultadoComando::Fallo) p.fallidos++;
+        }
+        if (tiempos) {
+            *tiempos << nLinea << "," << opcion << "," << us << ","
+                     << (r == ResultadoComando::Bien ? "ok" : r == ResultadoComando::Fallo ? "fallo" : "malformado") << "\n";
+        }
     }
+    double totalMs = chrono::duration<double, milli>(chrono::steady_clock::now() - inicioGuion).count();
+    cout.flush();  // Que la salida de los comandos no se mezcle con el informe
 
-    // CRUD Préstamo
-    bool addPrestamo(Prestamo p) {
-        if (idPrestamoExiste(p.id)) return false;
-        if (!idLibroExiste(p.id_libro) || !idEstudianteExiste(p.id_estudiante)) return false;
-        if (!libroDisponible(p.id_libro)) return false;
-        prestamos.push_back(p);
+    auto percentil = [](vector<double>& v, double p) {
+        size_t k = min(v.size() - 1, size_t(p * double(v.size())));
+        nth_element(v.begin(), v.begin() + static_cast<ptrdiff_t>(k), v.end());
+        return v[k];
+    };
+    size_t comandos = 0;
+    cerr << "opcion,comandos,fallidos,total_ms,media_us,p50_us,p99_us,max_us\n";
+    for (auto& kv : porOpcion) {
+        vector<double>& v = kv.second.us;
+        double suma = 0;
+        for (double x : v) suma += x;
+        comandos += v.size();
+        cerr << kv.first << "," << v.size() << "," << kv.second.fallidos << "," << suma / 1000 << "," << suma / double(v.size()) << ","
+             << percentil(v, 0.5) << "," << percentil(v, 0.99) << "," << *max_element(v.begin(), v.end()) << "\n";
+    }
+    cerr << "# " << comandos << " comandos (" << malformadas << " mal formados) en " << totalMs << " ms\n";
+    return malformadas == 0;
+}
+
+// Interpreta --fsync=siempre|nunca|<ms>, --grupo-ms=N y --compactar-mb=N
+bool leerOpcionWAL(const string& arg) {
+    auto valor = [&](const string& pre) { return arg.compare(0, pre.size(), pre) == 0 ? arg.substr(pre.size()) : string("\x01"); };
+    string v;
+    if ((v = valor("--fsync=")) != "\x01") {
+        CONFIG_WAL.fsyncMs = v == "siempre" ? 0 : v == "nunca" ? -1 : atoi(v.c_str());
         return true;
     }
-    bool devolverPrestamo(int id_prestamo, string fecha_devolucion) {
-        for (auto& p : prestamos) {
-            if (p.id == id_prestamo) {
-                if (!p.fecha_devolucion.empty()) return false;
-                p.fecha_devolucion = fecha_devolucion;
-                return true;
+    if ((v = valor("--grupo-ms=")) != "\x01") { CONFIG_WAL.grupoMs = max(1, atoi(v.c_str())); return true; }
+    if ((v = valor("--compactar-mb=")) != "\x01") {
+        CONFIG_WAL.compactarBytes = uint64_t(max(1, atoi(v.c_str()))) << 20;
+        return true;
+    }
+    return false;
+}
+
+#ifdef BIBLIOTECADB_POSIX
+/*
+ * Modo servidor (--servidor[=ruta]): una DB cargada una vez y atendida por un socket local para
+ * muchos clientes a la vez, en vez de que cada proceso recargue los datos.
+ * Mensajes como EscritorMensaje: largo (uint32) + cuerpo.
+ *  - Petición: op (uint8) + argumentos. Las escrituras son las de OpWAL, con sus argumentos
+ *    (AddPrestamo/DevPrestamo llevan fechas AAAA-MM-DD; las *Dia, nº de día); las lecturas, OpLectura.
+ *  - Respuesta: estado (uint8) + nº de columnas + nº de filas (int32) + nombres de columna + celdas
+ *    (textos, fila por fila). Un error trae una columna "error" con el motivo.
+ * El cliente puede mandar muchas peticiones sin esperar respuesta: las de una conexión se
+ * ejecutan y se responden en orden.
+ */
+enum class OpLectura : uint8_t {
+    Disponible = 64,      // id_libro -> disponible
+    PrestadosEstudiante,  // id_estudiante -> id_prestamo, id_libro, titulo, isbn, fecha_prestamo
+    BuscarTexto,          // consulta, max -> id_libro, puntaje, por_autor
+    TopAutores,           // n -> id_autor, nombre, libros
+    Informe,              // desde, hasta (AAAA-MM-DD) -> un resumen por mes
+    Consultar,            // ver escribirConsulta
+};
+enum class EstadoRespuesta : uint8_t { Bien = 0, Rechazada = 1, Error = 2 };  // Rechazada: el CRUD dio false
+
+const uint32_t MAX_MENSAJE = 16u << 20;
+
+// Consultar: tabla + nº de filtros + {columna, op, valor} + nº de columnas + columnas + agruparPor
+// + ordenarPor + descendente + límite (< 0: sin límite)
+void escribirConsulta(EscritorMensaje& m, const Consulta& q) {
+    m.entero(int(q.desde)).entero(int(q.donde.size()));
+    for (auto& f : q.donde) m.texto(f.columna).entero(int(f.op)).texto(f.valor);
+    m.entero(int(q.columnas.size()));
+    for (auto& c : q.columnas) m.texto(c);
+    m.texto(q.agruparPor).texto(q.ordenarPor).entero(q.descendente);
+    m.entero(q.limite > size_t(INT_MAX) ? -1 : int(q.limite));
+}
+bool leerConsulta(LectorRegistroWAL& r, Consulta& q) {
+    int t = r.entero();
+    if (t < 0 || t > int(TablaConsulta::Prestamo)) return false;
+    q.desde = TablaConsulta(t);
+    for (int i = 0, n = r.entero(); r.ok() && i < n; i++) {
+        FiltroConsulta f;
+        f.columna = string(r.texto());
+        int op = r.entero();
+        f.valor = string(r.texto());
+        if (op < 0 || op > int(OpFiltro::Contiene)) return false;
+        f.op = OpFiltro(op);
+        q.donde.push_back(move(f));
+    }
+    for (int i = 0, n = r.entero(); r.ok() && i < n; i++) q.columnas.emplace_back(r.texto());
+    q.agruparPor = string(r.texto());
+    q.ordenarPor = string(r.texto());
+    q.descendente = r.entero() != 0;
+    int limite = r.entero();
+    q.limite = limite < 0 ? SIZE_MAX : size_t(limite);
+    return r.ok();
+}
+
+// Respuesta con filas: las columnas se dan al crearla, el nº de filas se completa al cerrar
+class RespuestaTabla {
+public:
+    RespuestaTabla(initializer_list<string_view> columnas) : RespuestaTabla(vector<string_view>(columnas)) {}
+    explicit RespuestaTabla(const vector<string_view>& columnas) {
+        m.byte(uint8_t(EstadoRespuesta::Bien)).entero(int(columnas.size()));
+        posFilas = m.posicion();
+        m.entero(0);
+        for (auto c : columnas) m.texto(c);
+    }
+    RespuestaTabla& fila() {
+        filas++;
+        return *this;
+    }
+    RespuestaTabla& celda(string_view t) {
+        m.texto(t);
+        return *this;
+    }
+    RespuestaTabla& celda(long long v) {
+        char buf[24];
+        auto r = to_chars(buf, buf + sizeof(buf), v);
+        return celda(string_view(buf, size_t(r.ptr - buf)));
+    }
+    string cerrar() {
+        m.fijarEntero(posFilas, filas);
+        return m.cerrar();
+    }
+
+private:
+    EscritorMensaje m;
+    size_t posFilas = 0;
+    int filas = 0;
+};
+string respuestaEstado(EstadoRespuesta e, string_view motivo = "") {
+    EscritorMensaje m;
+    m.byte(uint8_t(e));
+    if (motivo.empty()) m.entero(0).entero(0);
+    else m.entero(1).entero(1).texto("error").texto(motivo);
+    return m.cerrar();
+}
+
+// Lado cliente: una respuesta ya separada del largo
+struct RespuestaServidor {
+    EstadoRespuesta estado = EstadoRespuesta::Error;
+    vector<string> columnas;
+    vector<vector<string>> filas;
+};
+bool leerRespuesta(string_view cuerpo, RespuestaServidor& res) {
+    if (cuerpo.empty()) return false;
+    res = RespuestaServidor();
+    res.estado = EstadoRespuesta(uint8_t(cuerpo[0]));
+    LectorRegistroWAL r(cuerpo.substr(1));
+    int nc = r.entero(), nf = r.entero();
+    for (int c = 0; r.ok() && c < nc; c++) res.columnas.emplace_back(r.texto());
+    for (int f = 0; r.ok() && f < nf; f++) {
+        res.filas.emplace_back();
+        for (int c = 0; r.ok() && c < nc; c++) res.filas.back().emplace_back(r.texto());
+    }
+    return r.ok();
+}
+
+// Ejecuta una petición (cuerpo sin el largo) sobre la DB compartida y arma la respuesta
+string atenderPeticion(DBCompartida& db, string_view cuerpo) {
+    if (cuerpo.empty()) return respuestaEstado(EstadoRespuesta::Error, "petición vacía");
+    uint8_t op = uint8_t(cuerpo[0]);
+    LectorRegistroWAL r(cuerpo.substr(1));
+    auto incompleta = [] { return respuestaEstado(EstadoRespuesta::Error, "argumentos incompletos"); };
+    if (op >= uint8_t(OpWAL::AddAutor) && op <= uint8_t(OpWAL::Lote)) {
+        bool ok = db.escribir([&](DB& d) { return d.aplicar(OpWAL(op), r); });
+        if (!r.ok()) return incompleta();
+        return respuestaEstado(ok ? EstadoRespuesta::Bien : EstadoRespuesta::Rechazada);
+    }
+    switch (OpLectura(op)) {
+        case OpLectura::Disponible: {
+            int id = r.entero();
+            if (!r.ok()) return incompleta();
+            RespuestaTabla t{"disponible"};
+            t.fila().celda(db.libroDisponible(id) ? 1 : 0);
+            return t.cerrar();
+        }
+        case OpLectura::PrestadosEstudiante: {
+            int id = r.entero();
+            if (!r.ok()) return incompleta();
+            return db.leer([&](const DB& d) {
+                RespuestaTabla t{"id_prestamo", "id_libro", "titulo", "isbn", "fecha_prestamo"};
+                for (auto& lp : d.librosPrestadosPorEstudiante(id))
+                    t.fila().celda(lp.id_prestamo).celda(lp.id_libro).celda(lp.titulo).celda(lp.isbn).celda(textoFecha(lp.fecha_prestamo));
+                return t.cerrar();
+            });
+        }
+        case OpLectura::BuscarTexto: {
+            string_view consulta = r.texto();
+            int max = r.entero();
+            if (!r.ok() || max < 0) return incompleta();
+            RespuestaTabla t{"id_libro", "puntaje", "por_autor"};
+            for (auto& e : db.buscarLibrosPorTexto(consulta, size_t(max))) t.fila().celda(e.id_libro).celda(e.puntaje).celda(e.porAutor ? 1 : 0);
+            return t.cerrar();
+        }
+        case OpLectura::TopAutores: {
+            int n = r.entero();
+            if (!r.ok()) return incompleta();
+            return db.leer([&](const DB& d) {
+                RespuestaTabla t{"id_autor", "nombre", "libros"};
+                for (auto& pr : d.topAutores(n)) {
+                    const Autor* a = d.buscarAutor(pr.first);
+                    t.fila().celda(pr.first).celda(a ? a->nombre : string_view()).celda(pr.second);
+                }
+                return t.cerrar();
+            });
+        }
+        case OpLectura::Informe: {
+            string_view t1 = r.texto(), t2 = r.texto();
+            Fecha desde, hasta;
+            if (!r.ok()) return incompleta();
+            if (!leerFecha(t1, desde) || !leerFecha(t2, hasta) || desde == SIN_FECHA || hasta == SIN_FECHA || hasta < desde ||
+                hasta - desde > 100 * 366)
+                return respuestaEstado(EstadoRespuesta::Error, "fechas inválidas");
+            return db.leer([&](const DB& d) {
+                RespuestaTabla t{"desde", "hasta", "iniciados", "devueltos", "dias_devueltos", "activos_al_cierre", "max_activos"};
+                for (auto& p : d.serieMensual(desde, hasta))
+                    t.fila().celda(textoFecha(p.desde)).celda(textoFecha(p.hasta)).celda(p.iniciados).celda(p.devueltos)
+                        .celda(p.diasDevueltos).celda(p.activosAlCierre).celda(p.maxActivos);
+                return t.cerrar();
+            });
+        }
+        case OpLectura::Consultar: {
+            Consulta q;
+            if (!leerConsulta(r, q)) return respuestaEstado(EstadoRespuesta::Error, "consulta mal formada");
+            ResultadoConsulta res;
+            string error;
+            if (!db.consultar(q, res, error)) return respuestaEstado(EstadoRespuesta::Error, error);
+            RespuestaTabla t(vector<string_view>(res.columnas.begin(), res.columnas.end()));
+            for (auto& f : res.filas) {
+                t.fila();
+                for (auto& c : f) t.celda(c);
             }
+            return t.cerrar();
         }
-        return false;
     }
-    bool deletePrestamo(int id) {
-        // Solo históricos (no activos)
-        for (auto& p : prestamos) {
-            if (p.id == id && p.fecha_devolucion.empty()) return false;
+    return respuestaEstado(EstadoRespuesta::Error, "operación desconocida");
+}
+
+/*
+ * Un hilo hace todo el I/O con poll() (sockets no bloqueantes); los pedidos de una conexión pasan
+ * en un lote al pool de trabajadores y, mientras ese lote se ejecuta, los nuevos esperan al
+ * siguiente: así cada conexión conserva su orden y conexiones distintas avanzan en paralelo.
+ * Los trabajadores dejan las respuestas en `hechos` y despiertan al bucle por un pipe.
+ * Con muchos pedidos sin contestar o mucha salida sin enviar se deja de leer esa conexión.
+ */
+class ServidorDB {
+public:
+    ServidorDB(DBCompartida& base, size_t trabajadores) : db(base), nTrabajadores(max<size_t>(1, trabajadores)) {}
+    ~ServidorDB() { cerrar(); }
+
+    bool abrir(const string& rutaSocket, string& error) {
+        sockaddr_un dir{};
+        dir.sun_family = AF_UNIX;
+        if (rutaSocket.size() >= sizeof(dir.sun_path)) { error = "ruta del socket demasiado larga"; return false; }
+        memcpy(dir.sun_path, rutaSocket.c_str(), rutaSocket.size() + 1);
+        escucha = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (escucha < 0) { error = "no se pudo crear el socket"; return false; }
+        // Un socket que quedó de una ejecución anterior se reemplaza; uno que atiende, no
+        if (connect(escucha, reinterpret_cast<sockaddr*>(&dir), sizeof(dir)) == 0) {
+            error = "ya hay un servidor en " + rutaSocket;
+            cerrar();
+            return false;
+        }
+        unlink(rutaSocket.c_str());
+        if (bind(escucha, reinterpret_cast<sockaddr*>(&dir), sizeof(dir)) != 0 || listen(escucha, SOMAXCONN) != 0 ||
+            pipe(despertar) != 0) {
+            error = "no se pudo escuchar en " + rutaSocket;
+            cerrar();
+            return false;
         }
-        auto it = remove_if(prestamos.begin(), prestamos.end(), [id](auto& p){ return p.id == id; });
-        if (it == prestamos.end()) return false;
-        prestamos.erase(it, prestamos.end());
+        ruta = rutaSocket;
+        noBloqueante(escucha);
+        noBloqueante(despertar[0]);
+        noBloqueante(despertar[1]);
         return true;
     }
 
-    // Consultas
-    void listarLibrosPrestadosPorEstudiante(int id_est) {
-        cout << "Libros prestados (activos) por estudiante " << id_est << ":\n";
-        for (auto& p : prestamos) {
-            if (p.id_estudiante == id_est && p.fecha_devolucion.empty()) {
-                auto it = find_if(libros.begin(), libros.end(), [p](auto& l){ return l.id == p.id_libro; });
-                if (it != libros.end()) {
-                    cout << " - [" << it->id << "] " << it->titulo << " (ISBN " << it->isbn << ") prestado el " << p.fecha_prestamo << "\n";
-                }
+    // Atiende hasta detener(); cadaTanto (si está) corre en el hilo del bucle cada ~100 ms
+    void correr(const function<void()>& cadaTanto = nullptr) {
+        vector<thread> trabajadores;
+        for (size_t i = 0; i < nTrabajadores; i++) trabajadores.emplace_back([this] { trabajar(); });
+        vector<pollfd> fds;
+        vector<uint64_t> deFd;  // fds[i + 2] es la conexión deFd[i]
+        auto ultimo = chrono::steady_clock::now();
+        while (!parar.load()) {
+            fds.clear();
+            deFd.clear();
+            fds.push_back({escucha, POLLIN, 0});
+            fds.push_back({despertar[0], POLLIN, 0});
+            for (auto& kv : conexiones) {
+                Conexion& c = kv.second;
+                short ev = 0;
+                if (!c.finLectura && !c.muerta && c.pendientes.size() < MAX_PENDIENTES && c.salida.size() - c.enviado < MAX_SALIDA)
+                    ev |= POLLIN;
+                if (!c.muerta && c.enviado < c.salida.size()) ev |= POLLOUT;
+                if (!ev) continue;
+                fds.push_back({c.fd, ev, 0});
+                deFd.push_back(kv.first);
+            }
+            if (poll(fds.data(), fds.size(), 100) < 0 && errno != EINTR) break;
+            if (fds[1].revents & POLLIN) {
+                char buf[256];
+                while (read(despertar[0], buf, sizeof(buf)) > 0) {}
+            }
+            recogerHechos();
+            if (fds[0].revents & POLLIN) aceptar();
+            for (size_t i = 2; i < fds.size(); i++) {
+                auto it = conexiones.find(deFd[i - 2]);
+                if (it == conexiones.end()) continue;
+                Conexion& c = it->second;
+                if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) leer(c);
+                if (fds[i].revents & POLLOUT) enviar(c);
+                despachar(it->first, c);
+            }
+            cerrarTerminadas();
+            auto ahora = chrono::steady_clock::now();
+            if (cadaTanto && ahora - ultimo >= chrono::milliseconds(100)) {
+                cadaTanto();
+                ultimo = ahora;
             }
         }
+        {
+            lock_guard<mutex> l(mCola);
+            fin = true;
+        }
+        cvCola.notify_all();
+        for (auto& t : trabajadores) t.join();
+        for (auto& kv : conexiones) close(kv.second.fd);
+        conexiones.clear();
+        cola.clear();
+        hechos.clear();
+        parar = false;
+        fin = false;
     }
 
-    void rankingAutoresPorCantidadLibros(int topN = 10) {
-        unordered_map<int, int> cnt;
-        for (auto& l : libros) cnt[l.id_autor]++;
-        vector<pair<int, int>> v(cnt.begin(), cnt.end());
-        sort(v.begin(), v.end(), [](auto& a, auto& b){ return a.second > b.second; });
-        cout << "Autores con mas libros:\n";
-        int shown = 0;
-        for (auto& pr : v) {
-            auto it = find_if(autores.begin(), autores.end(), [pr](auto& a){ return a.id == pr.first; });
-            string nombre = (it != autores.end() ? it->nombre : "Autor#" + to_string(pr.first));
-            cout << " - " << nombre << " : " << pr.second << "\n";
-            if (++shown >= topN) break;
+    // Se puede llamar desde otro hilo o desde un manejador de señal
+    void detener() {
+        parar = true;
+        char c = 0;
+        if (despertar[1] >= 0) (void)!write(despertar[1], &c, 1);
+    }
+
+private:
+    static constexpr size_t MAX_PENDIENTES = 4096;     // Pedidos leídos sin despachar por conexión
+    static constexpr size_t MAX_SALIDA = 8u << 20;     // Bytes de respuesta sin enviar por conexión
+
+    struct Conexion {
+        int fd;
+        string entrada;             // Bytes leídos aún sin formar un mensaje completo
+        vector<string> pendientes;  // Pedidos completos esperando al lote siguiente
+        string salida;
+        size_t enviado = 0;
+        bool ocupada = false;    // Tiene un lote en los trabajadores
+        bool finLectura = false; // El cliente cerró su lado: se contesta lo pendiente y se cierra
+        bool muerta = false;     // Error o protocolo inválido: se cierra en cuanto vuelva su lote
+    };
+    struct Lote {
+        uint64_t conexion;
+        vector<string> pedidos;
+    };
+    struct Hecho {
+        uint64_t conexion;
+        string respuestas;
+    };
+
+    DBCompartida& db;
+    size_t nTrabajadores;
+    string ruta;
+    int escucha = -1;
+    int despertar[2] = {-1, -1};
+    atomic<bool> parar{false};
+    unordered_map<uint64_t, Conexion> conexiones;  // Solo las toca el hilo del bucle
+    uint64_t ultimaConexion = 0;
+
+    mutex mCola;  // cola, fin
+    condition_variable cvCola;
+    deque<Lote> cola;
+    bool fin = false;
+    mutex mHechos;  // hechos
+    vector<Hecho> hechos;
+
+    static void noBloqueante(int fd) { fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK); }
+
+    void cerrar() {
+        if (escucha >= 0) close(escucha);
+        for (int& fd : despertar) {
+            if (fd >= 0) close(fd);
+            fd = -1;
         }
+        escucha = -1;
+        if (!ruta.empty()) unlink(ruta.c_str());
+        ruta.clear();
     }
 
-    // Listados para Read
-    void listarLibros() {
-        cout << "Libros:\n";
-        for (auto& l : libros) {
-            cout << "[" << l.id << "] " << l.titulo << " | ISBN " << l.isbn << " | " << l.ano << " | autor " << l.id_autor << "\n";
+    void aceptar() {
+        while (true) {
+            int fd = accept(escucha, nullptr, nullptr);
+            if (fd < 0) return;
+            noBloqueante(fd);
+            Conexion c;
+            c.fd = fd;
+            conexiones.emplace(++ultimaConexion, move(c));
         }
     }
-    void listarAutores() {
-        cout << "Autores:\n";
-        for (auto& a : autores) {
-            cout << "[" << a.id << "] " << a.nombre << " (" << a.nacionalidad << ")\n";
+
+    // Lee lo disponible y separa los mensajes completos
+    void leer(Conexion& c) {
+        char buf[64 * 1024];
+        for (size_t leidos = 0; leidos < (1u << 20);) {
+            ssize_t n = read(c.fd, buf, sizeof(buf));
+            if (n > 0) {
+                c.entrada.append(buf, size_t(n));
+                leidos += size_t(n);
+                continue;
+            }
+            if (n == 0) c.finLectura = true;
+            else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) c.muerta = true;
+            break;
+        }
+        size_t ini = 0;
+        while (c.entrada.size() - ini >= 4) {
+            uint32_t largo;
+            memcpy(&largo, c.entrada.data() + ini, 4);
+            if (largo == 0 || largo > MAX_MENSAJE) {
+                c.muerta = true;
+                break;
+            }
+            if (c.entrada.size() - ini - 4 < largo) break;
+            c.pendientes.emplace_back(c.entrada, ini + 4, largo);
+            ini += 4 + largo;
         }
+        c.entrada.erase(0, ini);
     }
-    void listarEstudiantes() {
-        cout << "Estudiantes:\n";
-        for (auto& e : estudiantes) {
-            cout << "[" << e.id << "] " << e.nombre << " - " << e.grado << "\n";
+
+    void enviar(Conexion& c) {
+        while (c.enviado < c.salida.size()) {
+            ssize_t n = send(c.fd, c.salida.data() + c.enviado, c.salida.size() - c.enviado, MSG_NOSIGNAL);
+            if (n > 0) {
+                c.enviado += size_t(n);
+                continue;
+            }
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) c.muerta = true;
+            break;
+        }
+        if (c.enviado == c.salida.size()) {
+            c.salida.clear();
+            c.enviado = 0;
+        } else if (c.enviado > (1u << 20)) {
+            c.salida.erase(0, c.enviado);
+            c.enviado = 0;
         }
     }
-    void listarPrestamos() {
-        cout << "Préstamos:\n";
-        for (auto& p : prestamos) {
-            cout << "[" << p.id << "] Libro " << p.id_libro << " a Est " << p.id_estudiante << " (" << p.fecha_prestamo;
-            if (p.fecha_devolucion.empty()) cout << " - ACTIVO)\n";
-            else cout << " - Devuelto " << p.fecha_devolucion << ")\n";
+
+    void despachar(uint64_t id, Conexion& c) {
+        if (c.ocupada || c.muerta || c.pendientes.empty()) return;
+        c.ocupada = true;
+        {
+            lock_guard<mutex> l(mCola);
+            cola.push_back(Lote{id, move(c.pendientes)});
         }
+        c.pendientes.clear();
+        cvCola.notify_one();
     }
-};
 
-string DATA_DIR = "./data";
+    void recogerHechos() {
+        vector<Hecho> listos;
+        {
+            lock_guard<mutex> l(mHechos);
+            listos.swap(hechos);
+        }
+        for (auto& h : listos) {
+            auto it = conexiones.find(h.conexion);
+            if (it == conexiones.end()) continue;
+            Conexion& c = it->second;
+            c.ocupada = false;
+            if (c.muerta) continue;
+            c.salida += h.respuestas;
+            enviar(c);  // Sin esperar otra vuelta de poll
+            despachar(it->first, c);
+        }
+    }
 
-void initDataDir() {
-    system("mkdir -p data");  // Crea dir si no existe
-}
+    void cerrarTerminadas() {
+        for (auto it = conexiones.begin(); it != conexiones.end();) {
+            Conexion& c = it->second;
+            bool terminada = c.finLectura && c.pendientes.empty() && c.salida.size() == c.enviado;
+            if (!c.ocupada && (c.muerta || terminada)) {
+                close(c.fd);
+                it = conexiones.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
 
-void cargarTodo(DB& db) {
-    initDataDir();
-    db.loadAutores(DATA_DIR + "/autores.csv");
-    db.loadLibros(DATA_DIR + "/libros.csv");
-    db.loadEstudiantes(DATA_DIR + "/estudiantes.csv");
-    db.loadPrestamos(DATA_DIR + "/prestamos.csv");
-}
+    void trabajar() {
+        while (true) {
+            Lote lote;
+            {
+                unique_lock<mutex> l(mCola);
+                cvCola.wait(l, [this] { return fin || !cola.empty(); });
+                if (cola.empty()) return;
+                lote = move(cola.front());
+                cola.pop_front();
+            }
+            string respuestas;
+            for (auto& p : lote.pedidos) respuestas += atenderPeticion(db, p);
+            bool avisar;
+            {
+                lock_guard<mutex> l(mHechos);
+                avisar = hechos.empty();  // Si no, el bucle ya tiene un aviso pendiente
+                hechos.push_back(Hecho{lote.conexion, move(respuestas)});
+            }
+            if (avisar) {
+                char c = 0;
+                (void)!write(despertar[1], &c, 1);
+            }
+        }
+    }
+};
 
-void guardarTodo(DB& db) {
-    initDataDir();
-    db.saveAutores(DATA_DIR + "/autores.csv");
-    db.saveLibros(DATA_DIR + "/libros.csv");
-    db.saveEstudiantes(DATA_DIR + "/estudiantes.csv");
-    db.savePrestamos(DATA_DIR + "/prestamos.csv");
+ServidorDB* SERVIDOR = nullptr;  // Para pararlo desde el manejador de señales
+extern "C" void pararServidor(int) {
+    if (SERVIDOR) SERVIDOR->detener();
 }
+#endif
 
-int main() {
+#ifndef BIBLIOTECADB_SIN_MAIN  // Los benchmarks incluyen este archivo sin su main
+int main(int argc, char** argv) {
     ios::sync_with_stdio(false);
     cin.tie(nullptr);
 
+    // --csv: lee y guarda los CSV (sin WAL). --importar-csv / --exportar-csv: convierte entre CSV y
+    // snapshot y sale. --fsync / --grupo-ms / --compactar-mb: ajustes del WAL.
+    // --servidor[=ruta]: atiende por un socket local (por omisión data/biblioteca.sock) con
+    // --hilos=N trabajadores hasta Ctrl-C, y guarda al salir.
+    // --importar-lote=dir [--parcial]: agrega los CSV de dir de una vez, todo o nada (o solo lo válido).
+    // --guion=archivo|- [--tiempos=ruta]: corre las opciones del menú desde un archivo, sin
+    // preguntas, informa el tiempo por opción en cerr (ver correrGuion) y guarda al terminar.
+    // --estadisticas=ruta [--estadisticas-s=N]: vuelca contadores y memoria en CSV cada N segundos y al salir.
+    string modo, rutaSocket = DATA_DIR + "/biblioteca.sock", dirLote, rutaGuion, rutaTiempos;
+    size_t hilos = max(2u, thread::hardware_concurrency());
+    bool parcial = false;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (leerOpcionWAL(arg)) continue;
+        if (arg.compare(0, 11, "--servidor=") == 0) {
+            rutaSocket = arg.substr(11);
+            modo = "--servidor";
+        } else if (arg.compare(0, 8, "--hilos=") == 0) {
+            hilos = size_t(max(1, atoi(arg.c_str() + 8)));
+        } else if (arg.compare(0, 16, "--importar-lote=") == 0) {
+            dirLote = arg.substr(16);
+            modo = "--importar-lote";
+        } else if (arg == "--parcial") {
+            parcial = true;
+        } else if (arg.compare(0, 8, "--guion=") == 0) {
+            rutaGuion = arg.substr(8);
+            modo = "--guion";
+        } else if (arg.compare(0, 10, "--tiempos=") == 0) {
+            rutaTiempos = arg.substr(10);
+        } else if (arg.compare(0, 15, "--estadisticas=") == 0) {
+            RUTA_ESTADISTICAS = arg.substr(15);
+        } else if (arg.compare(0, 17, "--estadisticas-s=") == 0) {
+            SEGUNDOS_ESTADISTICAS = max(1, atoi(arg.c_str() + 17));
+        } else {
+            modo = arg;
+        }
+    }
+    if (modo == "--csv") MODO_CSV = true;
+    if (modo == "--importar-csv") {
+        DB db;
+        MODO_CSV = true;
+        cargarTodo(db, false);
+        bool ok = db.guardarSnapshot(DATA_DIR + SNAPSHOT);
+        if (ok) {  // El snapshot nuevo reemplaza todo: el WAL anterior ya no aplica
+            remove((DATA_DIR + WAL).c_str());
+            remove((DATA_DIR + WAL_VIEJO).c_str());
+        }
+        cout << (ok ? "OK\n" : "Error al guardar\n");
+        return ok ? 0 : 1;
+    }
+    if (modo == "--exportar-csv") {
+        DB db;
+        cargarTodo(db, false);
+        bool ok = exportarCSV(db);
+        cout << (ok ? "OK\n" : "Error al guardar\n");
+        return ok ? 0 : 1;
+    }
+
+    if (modo == "--importar-lote") {
+        DB db;
+        cargarTodo(db);
+        bool ok = importarLote(db, dirLote, parcial);
+        if (!guardarTodo(db)) {
+            cout << "Error al guardar\n";
+            return 1;
+        }
+        return ok ? 0 : 1;
+    }
+    if (modo == "--guion") {
+        ifstream archivo;
+        if (rutaGuion != "-") {
+            archivo.open(rutaGuion);
+            if (!archivo) {
+                cerr << "Error: no se pudo abrir " << rutaGuion << "\n";
+                return 1;
+            }
+        }
+        ofstream tiempos;
+        if (!rutaTiempos.empty()) {
+            tiempos.open(rutaTiempos);
+            if (!tiempos) {
+                cerr << "Error: no se pudo crear " << rutaTiempos << "\n";
+                return 1;
+            }
+        }
+        DB db;
+        cargarTodo(db);
+        bool ok = correrGuion(db, rutaGuion == "-" ? cin : archivo, rutaTiempos.empty() ? nullptr : &tiempos);
+        if (!guardarTodo(db)) {
+            cerr << "Error: no se pudieron guardar los datos en " << DATA_DIR << "\n";
+            return 1;
+        }
+        volcarEstadisticasSiToca(db, true);
+        return ok ? 0 : 1;
+    }
+    if (modo == "--servidor") {
+#ifdef BIBLIOTECADB_POSIX
+        DBCompartida compartida;
+        DB& db = compartida.sinLock();
+        cargarTodo(db);
+        ServidorDB servidor(compartida, hilos);
+        string error;
+        if (!servidor.abrir(rutaSocket, error)) {
+            cerr << "Error: " << error << "\n";
+            return 1;
+        }
+        SERVIDOR = &servidor;
+        signal(SIGINT, pararServidor);
+        signal(SIGTERM, pararServidor);
+        signal(SIGPIPE, SIG_IGN);
+        cerr << "Atendiendo en " << rutaSocket << " con " << hilos << " trabajadores (Ctrl-C guarda y sale)\n";
+        // La compactación copia la DB con el lock exclusivo: la copia queda entre dos cambios
+        servidor.correr([&] { compartida.escribir([](DB& d) { mantenimiento(d); }); });
+        SERVIDOR = nullptr;
+        bool ok = guardarTodo(db);
+        volcarEstadisticasSiToca(db, true);
+        cerr << (ok ? "Datos guardados\n" : "Error al guardar\n");
+        return ok ? 0 : 1;
+#else
+        cerr << "Error: el modo servidor necesita sockets POSIX\n";
+        return 1;
+#endif
+    }
+
     DB db;
     cargarTodo(db);
 
     int opcion;
     while (true) {
+        mantenimiento(db);
         cout << "\n--- Menú BibliotecaDB ---\n";
         cout << "1. Agregar Libro\n2. Listar Libros\n3. Actualizar Libro\n4. Borrar Libro\n";
         cout << "5. Agregar Autor\n6. Listar Autores\n7. Actualizar Autor\n8. Borrar Autor\n";
         cout << "9. Agregar Estudiante\n10. Listar Estudiantes\n11. Actualizar Estudiante\n12. Borrar Estudiante\n";
         cout << "13. Agregar Préstamo\n14. Listar Préstamos\n15. Devolver Préstamo\n16. Borrar Préstamo (histórico)\n";
         cout << "17. Listar libros prestados por estudiante\n18. Autores con más libros\n";
+        cout << "19. Buscar libros por título o autor\n20. Informe de préstamos por fechas\n21. Estadísticas\n";
+        cout << "22. Listar página o exportar tabla\n23. Purgar préstamos devueltos antes de una fecha\n";
         cout << "0. Salir y guardar\nElección: ";
         cin >> opcion;
         if (cin.fail()) {
@@ -415,15 +5275,16 @@ int main() {
 
         switch (opcion) {
             case 1: {  // Agregar Libro
-                Libro l;
+                int id, ano, id_autor;
+                string titulo, isbn;
                 cout << "ID Título ISBN Año ID_Autor: ";
-                cin >> l.id;
+                cin >> id;
                 cin.ignore(numeric_limits<streamsize>::max(), '\n');  // FIX: Limpia después de cin>>
-                getline(cin, l.titulo);
-                getline(cin, l.isbn);
-                cin >> l.ano >> l.id_autor;
+                getline(cin, titulo);
+                getline(cin, isbn);
+                cin >> ano >> id_autor;
                 cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                cout << (db.addLibro(l) ? "OK\n" : "Error: ID duplicado o autor inexistente\n");
+                cout << (db.addLibro(id, titulo, isbn, ano, id_autor) ? "OK\n" : "Error: ID duplicado o autor inexistente\n");
                 break;
             }
             case 2: db.listarLibros(); break;  // Listar
@@ -445,17 +5306,18 @@ int main() {
                 cout << "ID a borrar: ";
                 cin >> id;
                 cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                cout << (db.deleteLibro(id) ? "OK\n" : "Error: Préstamo activo\n");
+                cout << (db.deleteLibro(id) ? "OK\n" : "Error: Tiene préstamos (activos o históricos)\n");
                 break;
             }
             case 5: {  // Agregar Autor
-                Autor a;
+                int id;
+                string nombre, nac;
                 cout << "ID Nombre Nacionalidad: ";
-                cin >> a.id;
+                cin >> id;
                 cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                getline(cin, a.nombre);
-                getline(cin, a.nacionalidad);
-                cout << (db.addAutor(a) ? "OK\n" : "Error: ID duplicado\n");
+                getline(cin, nombre);
+                getline(cin, nac);
+                cout << (db.addAutor(id, nombre, nac) ? "OK\n" : "Error: ID duplicado\n");
                 break;
             }
             case 6: db.listarAutores(); break;
@@ -479,13 +5341,14 @@ int main() {
                 break;
             }
             case 9: {  // Agregar Estudiante
-                Estudiante e;
+                int id;
+                string nombre, grado;
                 cout << "ID Nombre Grado: ";
-                cin >> e.id;
+                cin >> id;
                 cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                getline(cin, e.nombre);
-                getline(cin, e.grado);
-                cout << (db.addEstudiante(e) ? "OK\n" : "Error: ID duplicado\n");
+                getline(cin, nombre);
+                getline(cin, grado);
+                cout << (db.addEstudiante(id, nombre, grado) ? "OK\n" : "Error: ID duplicado\n");
                 break;
             }
             case 10: db.listarEstudiantes(); break;
@@ -509,13 +5372,13 @@ int main() {
                 break;
             }
             case 13: {  // Agregar Préstamo
-                Prestamo p;
+                int id, id_libro, id_est;
+                string fecha;
                 cout << "ID ID_Libro ID_Est Fecha (AAAA-MM-DD): ";
-                cin >> p.id >> p.id_libro >> p.id_estudiante;
+                cin >> id >> id_libro >> id_est;
                 cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                getline(cin, p.fecha_prestamo);
-                p.fecha_devolucion = "";
-                cout << (db.addPrestamo(p) ? "OK\n" : "Error: IDs inválidos o libro no disponible\n");
+                getline(cin, fecha);
+                cout << (db.addPrestamo(id, id_libro, id_est, fecha) ? "OK\n" : "Error: IDs o fecha inválidos, o libro no disponible\n");
                 break;
             }
             case 14: db.listarPrestamos(); break;
@@ -526,7 +5389,7 @@ int main() {
                 cin >> id;
                 cin.ignore(numeric_limits<streamsize>::max(), '\n');
                 getline(cin, fecha);
-                cout << (db.devolverPrestamo(id, fecha) ? "OK\n" : "Error: Ya devuelto o inválido\n");
+                cout << (db.devolverPrestamo(id, fecha) ? "OK\n" : "Error: Ya devuelto, inválido, fecha ilegible o anterior al préstamo\n");
                 break;
             }
             case 16: {  // Delete Préstamo histórico
@@ -537,12 +5400,15 @@ int main() {
                 cout << (db.deletePrestamo(id) ? "OK\n" : "Error: Activo o inexistente\n");
                 break;
             }
-            case 17: {  // Consulta 1
-                int id_est;
-                cout << "ID_Estudiante: ";
-                cin >> id_est;
-                cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                db.listarLibrosPrestadosPorEstudiante(id_est);
+            case 17: {  // Consulta 1 (varios IDs en la línea: una sola pasada)
+                cout << "ID_Estudiante (o varios separados por espacios): ";
+                string input;
+                getline(cin, input);
+                stringstream ss(input);
+                vector<int> ids;
+                for (int id; ss >> id;) ids.push_back(id);
+                if (ids.size() == 1) db.listarLibrosPrestadosPorEstudiante(ids[0]);
+                else if (!ids.empty()) db.listarLibrosPrestadosPorEstudiantes(ids);
                 break;
             }
             case 18: {  // Consulta 2
@@ -557,8 +5423,68 @@ int main() {
                 db.rankingAutoresPorCantidadLibros(topN);
                 break;
             }
+            case 19: {  // Búsqueda por texto (parcial, sin tildes ni mayúsculas)
+                cout << "Título o autor (o parte): ";
+                string consulta;
+                getline(cin, consulta);
+                db.listarBusquedaLibros(consulta);
+                break;
+            }
+            case 20: {  // Informe por rango de fechas (calendario de préstamos)
+                string d1, d2;
+                Fecha desde, hasta;
+                cout << "Desde (AAAA-MM-DD): ";
+                getline(cin, d1);
+                cout << "Hasta (AAAA-MM-DD): ";
+                getline(cin, d2);
+                if (!leerFecha(d1, desde) || !leerFecha(d2, hasta) || desde == SIN_FECHA || hasta == SIN_FECHA || hasta < desde) {
+                    cout << "Error: fechas inválidas\n";
+                    break;
+                }
+                if (hasta - desde > 100 * 366) {
+                    cout << "Error: rango de más de 100 años\n";
+                    break;
+                }
+                db.informePrestamos(desde, hasta);
+                break;
+            }
+            case 21: mostrarEstadisticas(db); break;
+            case 22: {  // Listado por páginas: "tabla opción opción..."
+                string linea;
+                cout << "Tabla (libros, autores, estudiantes, prestamos) y opciones\n"
+                        "(limite=N desde=N despues=id orden=tabla|id|fecha archivo=ruta): ";
+                getline(cin, linea);
+                vector<string_view> partes;
+                for (string_view s = linea; !s.empty();) {
+                    size_t fin = min(s.find(' '), s.size());
+                    if (fin > 0) partes.push_back(s.substr(0, fin));
+                    s.remove_prefix(min(fin + 1, s.size()));
+                }
+                if (partes.empty()) {
+                    cout << "Error: falta la tabla\n";
+                    break;
+                }
+                listarPagina(db, partes[0], partes.data() + 1, int(partes.size()) - 1);
+                break;
+            }
+            case 23: {  // Purga del histórico
+                string f;
+                Fecha antes;
+                cout << "Devueltos antes de (AAAA-MM-DD): ";
+                getline(cin, f);
+                if (!leerFecha(f, antes) || antes == SIN_FECHA) {
+                    cout << "Error: fecha inválida\n";
+                    break;
+                }
+                cout << "Purgados: " << db.purgarDevueltos(antes) << " préstamos\n";
+                break;
+            }
             case 0: {
-                guardarTodo(db);
+                if (!guardarTodo(db)) {
+                    cout << "Error: no se pudieron guardar los datos en " << DATA_DIR << "\n";
+                    break;
+                }
+                volcarEstadisticasSiToca(db, true);
                 cout << "Datos guardados en ./data/. ¡Adiós!\n";
                 return 0;
             }
@@ -566,4 +5492,5 @@ int main() {
         }
     }
     return 0;
-}
\ No newline at end of file
+}
+#endif
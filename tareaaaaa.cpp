@@ -1,7 +1,31 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <deque>
+#include <string_view>
 #include <limits>
+#include <cctype>
+#include <unordered_map>
+#include <algorithm>
+
+// Texto para buscar: minusculas, sin tildes (UTF-8) y los signos como un solo espacio
+std::string normalizar(const std::string& s) {
+    static const char BASE[] = "aaaaaaaceeeeiiiidnooooo ouuuuyts"
+                               "aaaaaaaceeeeiiiidnooooo ouuuuyty";
+    std::string r;
+    r.reserve(s.size());  // Nunca sale mas largo: una sola reserva
+    for (size_t i = 0; i < s.size(); i++) {
+        unsigned char c = s[i];
+        char b;
+        if (c == 0xC3 && i + 1 < s.size()) b = BASE[(static_cast<unsigned char>(s[++i]) - 0x80) & 0x3F];
+        else if (c >= 0x80) b = char(c);
+        else b = std::isalnum(c) ? char(std::tolower(c)) : ' ';
+        if (b != ' ') r += b;
+        else if (!r.empty() && r.back() != ' ') r += ' ';
+    }
+    if (!r.empty() && r.back() == ' ') r.pop_back();
+    return r;
+}
 
 class Libro {
 public:
@@ -10,45 +34,91 @@ public:
     int  anioPublicacion;
     bool esta_disponible;
 
-    
+    // Por valor y movidos: quien pasa un temporal (o hace std::move) no paga ninguna copia
     Libro(std::string _titulo, std::string _autor, int _anio)
-        : titulo(_titulo), autor(_autor), anioPublicacion(_anio), esta_disponible(true) {}
-
-    void mostrarDetallesCompletos() const {
-        std::cout<< "_____________________"<< std::endl;
-        std::cout<<"Titulo: "<< titulo << std::endl;
-        std::cout<<"Autor: "<< autor << std::endl;
-        std::cout<<"Anio: "<< anioPublicacion << std::endl;
-        std::cout<<"Disponibilidad: "<< (esta_disponible ? "Disponible" : "No disponible");
-              
+        : titulo(std::move(_titulo)), autor(std::move(_autor)), anioPublicacion(_anio), esta_disponible(true) {}
+
+    // Sin std::endl: el flush por linea era la mayor parte del coste de mostrar el inventario
+    void mostrarDetallesCompletos(std::ostream& out = std::cout) const {
+        out << "_____________________\n";
+        out << "Titulo: " << titulo << '\n';
+        out << "Autor: " << autor << '\n';
+        out << "Anio: " << anioPublicacion << '\n';
+        out << "Disponibilidad: " << (esta_disponible ? "Disponible" : "No disponible");
     }
 };
 
 class Biblioteca {
 private:
-    std::vector<Libro> coleccion;
+    // deque y no vector: agregar al final no mueve lo ya guardado, asi los punteros que dan
+    // buscarLibro/buscarLibros siguen validos despues de agregar mas libros
+    std::deque<Libro> coleccion;
+    // Titulo y autor normalizados de cada posicion, para las busquedas parciales
+    std::deque<std::string> titulos, autores;
+    // Titulo normalizado -> posicion en coleccion (el primero si se repite). La clave mira el
+    // string de titulos, que tampoco se mueve: no se guarda una segunda copia del titulo.
+    std::unordered_map<std::string_view, size_t> porTitulo;
+
+    Libro& indexar(Libro& libro) {
+        titulos.push_back(normalizar(libro.titulo));
+        autores.push_back(normalizar(libro.autor));
+        porTitulo.emplace(titulos.back(), coleccion.size() - 1);
+        return libro;
+    }
 
 public:
     // 1
-    void agregarLibro(const Libro& nuevoLibro) {
-        coleccion.push_back(nuevoLibro);
+    Libro& agregarLibro(Libro nuevoLibro) {
+        coleccion.push_back(std::move(nuevoLibro));
+        return indexar(coleccion.back());
+    }
+    // Construye el libro ya dentro de la coleccion
+    Libro& agregarLibro(std::string titulo, std::string autor, int anio) {
+        coleccion.emplace_back(std::move(titulo), std::move(autor), anio);
+        return indexar(coleccion.back());
     }
 
     // 2
-    void mostrarInventario() {
+    void mostrarInventario() const {
         for (const auto& libro : coleccion) {
-            libro.mostrarDetallesCompletos();
+            libro.mostrarDetallesCompletos(std::cout);
         }
+        std::cout.flush();
     }
 
-    // 3
+    // 3 (sin importar mayusculas ni tildes)
     Libro* buscarLibro(const std::string& tituloBuscado) {
-        for (auto& libro : coleccion) {
-            if (libro.titulo == tituloBuscado) {
-                return &libro;
-            }
+        auto it = porTitulo.find(normalizar(tituloBuscado));
+        return it == porTitulo.end() ? nullptr : &coleccion[it->second];
+    }
+
+    // Titulo o autor parcial: primero el titulo exacto, luego los que empiezan asi, luego los
+    // que lo contienen y al final los que coinciden por autor
+    std::vector<Libro*> buscarLibros(const std::string& consulta, size_t maximo = 10) {
+        std::string q = normalizar(consulta);
+        std::vector<std::pair<int, size_t>> hallados;  // {rango, posicion}
+        if (q.empty()) return {};
+        for (size_t i = 0; i < coleccion.size(); i++) {
+            size_t pos = titulos[i].find(q);
+            if (titulos[i] == q) hallados.push_back({0, i});
+            else if (pos == 0) hallados.push_back({1, i});
+            else if (pos != std::string::npos) hallados.push_back({2, i});
+            else if (autores[i].find(q) != std::string::npos) hallados.push_back({3, i});
+        }
+        std::stable_sort(hallados.begin(), hallados.end(),
+                         [](const auto& a, const auto& b) { return a.first < b.first; });
+        std::vector<Libro*> res;
+        for (size_t k = 0; k < hallados.size() && k < maximo; k++) res.push_back(&coleccion[hallados[k].second]);
+        return res;
+    }
+
+    void mostrarBusqueda(const std::string& consulta) {
+        std::vector<Libro*> res = buscarLibros(consulta);
+        if (res.empty()) std::cout << "Sin resultados para '" << consulta << "'."<<std::endl;
+        for (Libro* libro : res) {
+            std::cout << "- " << libro->titulo << " (" << libro->autor << ", " << libro->anioPublicacion << ") "
+                      << (libro->esta_disponible ? "Disponible" : "No disponible") << std::endl;
         }
-        return nullptr;
     }
 
     // 4
@@ -85,19 +155,16 @@ public:
 };
 
 //*parte 3
+#ifndef TAREA_SIN_MAIN  // bench_fase3.cpp incluye la Biblioteca sin el menu
 int main() {
     Biblioteca miBiblioteca;
     int opcion = 0;
 
     // Agregar algunos libros de ejemplo para empezar
-    Libro libro1("El Hobbit", "J.R.R. Tolkien", 1937);
-    miBiblioteca.agregarLibro(libro1);
-    Libro libro2("1984", "George Orwell", 1949); // corrige si quieres
-    miBiblioteca.agregarLibro(libro2);
-    Libro libro3("La ladrona de libros", "Markus Zusak", 2005);
-    miBiblioteca.agregarLibro(libro3);
-    Libro libro4("Little Women", "Louisa May Alcott", 1869);
-    miBiblioteca.agregarLibro(libro4);
+    miBiblioteca.agregarLibro("El Hobbit", "J.R.R. Tolkien", 1937);
+    miBiblioteca.agregarLibro("1984", "George Orwell", 1949); // corrige si quieres
+    miBiblioteca.agregarLibro("La ladrona de libros", "Markus Zusak", 2005);
+    miBiblioteca.agregarLibro("Little Women", "Louisa May Alcott", 1869);
 
     // Demo rápida
     miBiblioteca.mostrarInventario();
@@ -109,6 +176,7 @@ int main() {
         std::cout << "3. Prestar libro" << std::endl;
         std::cout << "4. Devolver libro" << std::endl;
         std::cout << "5. Salir" << std::endl;
+        std::cout << "6. Buscar libro (titulo o autor, parcial)" << std::endl;
         std::cout << "Seleccione una opcion: ";
         std::cin >> opcion;
 
@@ -130,7 +198,7 @@ int main() {
             }
             std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
 
-            miBiblioteca.agregarLibro(Libro(titulo, autor, anio));
+            miBiblioteca.agregarLibro(std::move(titulo), std::move(autor), anio);
             std::cout << "Libro agregado correctamente."<<std::endl;
         }
         else if (opcion == 2) {
@@ -151,6 +219,12 @@ int main() {
         else if (opcion == 5) {
             std::cout << "Saliendo del sistema..."<<std::endl;
         }
+        else if (opcion == 6) {
+            std::string consulta;
+            std::cout << "Titulo o autor (o parte): ";
+            std::getline(std::cin, consulta);
+            miBiblioteca.mostrarBusqueda(consulta);
+        }
         else {
             std::cout << "Opcion invalida. Intente de nuevo."<<std::endl;
         }
@@ -160,3 +234,4 @@ int main() {
             
     return 0;
 };
+#endif